@@ -0,0 +1,18 @@
+find_path(EGL_INCLUDE_DIR EGL/egl.h
+  HINTS
+  /usr/include
+  /usr/local/include
+  )
+
+find_library(EGL_LIBRARIES
+  NAMES
+  EGL
+  HINTS
+  /usr/local/lib
+  /usr/lib
+  )
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(EGL DEFAULT_MSG
+  EGL_INCLUDE_DIR
+  EGL_LIBRARIES)
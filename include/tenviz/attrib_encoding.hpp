@@ -0,0 +1,42 @@
+#pragma once
+
+#include <torch/torch.h>
+
+namespace tenviz {
+
+/**
+ * Compressed formats for uploading vertex attributes. Shaders decode
+ * them with uniforms named after the attribute, see
+ * EncodedAttrib.
+ */
+enum class AttribEncoding {
+  kRaw,              /**< As the tensor's type. */
+  kHalf,             /**< Float16, decoded by the hardware. */
+  kNormalizedInt16,  /**< Int16 relative to the attribute's bounds. */
+  kOctahedral        /**< Unit vectors as two int16, for normals. */
+};
+
+/**
+ * Attribute values ready for uploading and their decoding
+ * parameters. Shaders decode int16 values with
+ * `value*<name>_scale + <name>_offset`, and octahedral ones if the
+ * `<name>_octahedral` uniform is true.
+ */
+struct EncodedAttrib {
+  /**
+   * Encodes a [N x channels] or [N] tensor.
+   *
+   * @param tensor The attribute values.
+   * @param encoding Target encoding.
+   */
+  static EncodedAttrib Encode(const torch::Tensor &tensor,
+                              AttribEncoding encoding);
+
+  torch::Tensor tensor;  /**< Encoded values. */
+  bool normalize;        /**< Whatever shaders read it normalized. */
+  torch::Tensor scale;   /**< Float [channels] decoding scale. */
+  torch::Tensor offset;  /**< Float [channels] decoding offset. */
+  bool octahedral;
+};
+
+}  // namespace tenviz
@@ -10,6 +10,11 @@
 
 #include "camera_manipulator.hpp"
 #include "context_resource.hpp"
+#include "egl_context.hpp"
+#include "gl_buffer_arena.hpp"
+#include "gl_state_cache.hpp"
+#include "gl_uniform_block.hpp"
+#include "render_stats.hpp"
 
 class GLFWwindow;
 
@@ -21,6 +26,16 @@ class Viewer;
 class Scene;
 class IContextResource;
 
+/**
+ * Window system used for creating the OpenGL context.
+ */
+enum ContextBackend {
+  kGLFW, /**<Hidden GLFW window. Requires a display server, but
+          * supports viewers.*/
+  kEGL   /**<Headless EGL context. No display server is needed, but
+          * viewers can't be created.*/
+};
+
 /**
  * OpenGL context manager. Almost all operations envolve this class.
  *
@@ -35,8 +50,12 @@ class Context {
    * @param width Context's window width.
    * @param height Context's window height.
    * @param profile Whatever the to enable OpenGL's core profile.
+   * @param backend Which window system creates the OpenGL context.
+   * @param share Context to share objects (buffers, textures and
+   * programs) with. Both must use the same backend.
    */
-  Context(int width, int height, bool profile = false);
+  Context(int width, int height, bool profile = false,
+          ContextBackend backend = kGLFW, Context *share = nullptr);
   Context &operator=(const Context &copy) = delete;
   Context(const Context &copy) = delete;
 
@@ -59,6 +78,18 @@ class Context {
    */
   void DetachCurrent();
 
+  /**
+   * Creates the OpenGL context if not done before, without making it
+   * current. The context current on the calling thread, if any, is
+   * kept.
+   */
+  void EnsureInitialized();
+
+  /**
+   * @return The context current on the calling thread, or nullptr.
+   */
+  static Context *GetCurrent();
+
   /**
    * @return Whatever the context is current.
    */
@@ -89,6 +120,23 @@ class Context {
               std::shared_ptr<GLFramebuffer> framebuffer,
               std::shared_ptr<Scene> scene, int width = -1, int height = -1);
 
+  /**
+   * Render several views of a scene into a layered framebuffer, one
+   * layer per view. The framebuffer's textures become 2D arrays, so
+   * each attachment is read as a single [KxHxWxC] tensor.
+   *
+   * @param projections [Kx4x4] OpenGL's projection matrices.
+   *
+   * @param cameras [Kx4x4] OpenGL's view matrices.
+   *
+   * The other parameters are the same of Render.
+   */
+  void RenderMany(const torch::Tensor &projections,
+                  const torch::Tensor &cameras,
+                  std::shared_ptr<GLFramebuffer> framebuffer,
+                  std::shared_ptr<Scene> scene, int width = -1,
+                  int height = -1);
+
   /**
    * Resize the context dimensions.
    *
@@ -113,6 +161,12 @@ class Context {
    */
   void CollectGarbage();
 
+  /**
+   * @return The arena that sub-allocates the context's small
+   * buffers, see GLBuffer::Create.
+   */
+  std::shared_ptr<GLBufferArena> GetBufferArena();
+
   /**
    * @return The current width.
    */
@@ -123,6 +177,30 @@ class Context {
    */
   int get_height() const { return height_; }
 
+  /**
+   * @return The context's window system backend.
+   */
+  ContextBackend get_backend() const { return backend_; }
+
+  /**
+   * Enables or disables the collection of rendering statistics.
+   */
+  void SetStatsEnabled(bool enable);
+
+  bool is_stats_enabled() const { return stats_enabled_; }
+
+  /**
+   * @return The rendering statistics. Only updated while enabled.
+   */
+  const RenderStats &get_stats() const { return stats_; }
+
+  /**
+   * @return Whatever the OpenGL context was already created.
+   */
+  bool is_initialized() const {
+    return window_ != nullptr || egl_context_.is_initialized();
+  }
+
   Eigen::Vector4f clear_color; /** Clear color property. */
 
  protected:
@@ -133,6 +211,7 @@ class Context {
 
   int width_, height_;
   GLFWwindow *window_;
+  EGLOffscreenContext egl_context_;
 
  private:
   /**
@@ -143,19 +222,48 @@ class Context {
   static void RegisterResourceOnCurrent(
       std::shared_ptr<IContextResource> resource);
 
+  void InitializeGLFW();
+
+  void InitializeEGL();
+
+  void InitializeGLState();
+
+  void BindPlatformContext();
+
+  void UnbindPlatformContext();
+
+  /**
+   * @param camera_block The caller's OpenGL context CameraBlock
+   * buffer, updated with the frame's camera.
+   * @param own_gl_context Whatever the caller's OpenGL context is
+   * this context's one. Statistics are only collected on it, as
+   * query objects aren't shared.
+   */
   void RenderFrameImpl(std::shared_ptr<Scene> scene,
                        const Eigen::Matrix4f &projection,
-                       const Eigen::Matrix4f &camera);
+                       const Eigen::Matrix4f &camera,
+                       GLUniformBlock &camera_block,
+                       bool own_gl_context = true);
 
   friend class Viewer;
   friend class IContextResource;
 
   std::set<std::shared_ptr<IContextResource>> resources_;
+  std::shared_ptr<GLBufferArena> buffer_arena_;
 
   std::mutex context_lock_;
 
   int viewer_count_;
   bool profile_;
+  ContextBackend backend_;
+  Context *share_;
+
+  RenderStats stats_;
+  bool stats_enabled_;
+
+  GLStateCache state_cache_;
+  GLUniformBlock camera_block_;
+  bool debug_output_;
 };
 
 /**
@@ -1,11 +1,36 @@
 #pragma once
 
-#include <cuda_gl_interop.h>
 #include <torch/torch.h>
 
+#ifdef TENVIZ_WITH_CUDA
+#include <cuda_gl_interop.h>
+
 #include "cuda_error.hpp"
+#else
+struct cudaGraphicsResource;
+typedef cudaGraphicsResource *cudaGraphicsResource_t;
+#endif
+
+#include "modification_stamp.hpp"
 
 namespace tenviz {
+
+/**
+ * @return Whatever tensors can be transfered through CUDA-OpenGL
+ * interop. False if tenviz was built without CUDA or no GPU is
+ * visible to PyTorch, on which case transfers go through OpenGL calls
+ * and CPU tensors.
+ */
+inline bool IsCudaInteropAvailable() {
+#ifdef TENVIZ_WITH_CUDA
+  static const bool available = torch::cuda::is_available();
+  return available;
+#else
+  return false;
+#endif
+}
+
+#ifdef TENVIZ_WITH_CUDA
 /**
  * RAII for mapping/unmapping cudaGraphicsResource_t.
  */
@@ -31,6 +56,7 @@ class ScopedCudaMapper {
   void *data;
   size_t size;
 };  // namespace
+#endif
 
 /**
  * Holds a PyTorch tensor created from a Graphics Resource data.
@@ -43,10 +69,14 @@ class CudaMappedTensor {
   torch::Tensor tensor; /**<Mapped tensor. */
 
   /**
-   * Call this after using.
-   */ 
+   * Call this after using. The tensor may have been written, so
+   * viewers are told to redraw.
+   */
   void Unmap() {
+#ifdef TENVIZ_WITH_CUDA
     CudaSafeCall(cudaGraphicsUnmapResources(1, &cuda_resource_, 0));
+#endif
+    ModificationStamp::Touch();
   }
 
  private:
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "context_resource.hpp"
+#include "eigen_common.hpp"
+#include "gl_common.hpp"
+#include "gl_uniform_block.hpp"
+
+namespace tenviz {
+
+class ANode;
+class Context;
+class DrawProgram;
+
+/**
+ * Draws nodes that only differ by their transforms with a single
+ * multi-draw indirect call. Nodes are batched when:
+ *
+ * - Their program declares the ObjectBuffer storage block, see
+ * ObjectBlock. The transforms are read from it by gl_DrawIDARB;
+ * - They share the program, draw mode, style, uniforms and textures;
+ * - Their attributes have the same format and lie in the same
+ * buffers, usually the context's arena. Their offsets must differ by a
+ * whole number of vertices, the same for every attribute, like nodes
+ * with a single attribute buffer or with interleaved vertices;
+ * - They don't have instanced attributes, matrix placeholders, draw
+ * ranges, alpha blending or stream buffers.
+ *
+ * Batched nodes are drawn after the other opaque nodes of their
+ * scene, and before its alpha blended ones, see Scene::Draw.
+ */
+class DrawBatcher {
+ private:
+  /**
+   * A vertex attribute's source. Offsets of batched nodes are relative
+   * to their base vertex.
+   */
+  struct Attrib {
+    GLint location;
+    GLuint buffer;
+    size_t offset, stride;
+    int channels;
+    GLenum gl_type;
+    bool integer, normalize;
+
+    bool operator==(const Attrib &other) const {
+      return location == other.location && buffer == other.buffer &&
+             offset == other.offset && stride == other.stride &&
+             channels == other.channels && gl_type == other.gl_type &&
+             integer == other.integer && normalize == other.normalize;
+    }
+  };
+
+ public:
+  /**
+   * GL objects reused by the batches of the frames, kept per context
+   * and released with it.
+   */
+  class Cache {
+   public:
+    Cache() {}
+
+    Cache(const Cache &copy) = delete;
+
+    Cache &operator=(const Cache &copy) = delete;
+
+   private:
+    struct BatchObjects {
+      BatchObjects() : vao(0), element_buffer(0), deletion_epoch(-1) {}
+
+      GLuint vao;
+      std::vector<Attrib> attribs; /**< The VAO's attributes.*/
+      GLuint element_buffer;       /**< The VAO's element buffer.*/
+      int64_t deletion_epoch;      /**< GLStateCache's, when set up.*/
+      GLUniformBlock objects;      /**< The ObjectBuffer's values.*/
+      GLUniformBlock commands;     /**< Indirect draw commands.*/
+    };
+
+    /**
+     * The batch objects of a context, registered as its resource.
+     */
+    class ContextBatches : public IContextResource {
+     public:
+      ContextBatches() : released(false) {}
+
+      void Release() override;
+
+      std::vector<std::unique_ptr<BatchObjects>> batches;
+      std::atomic<bool> released;
+    };
+
+    /**
+     * @return The current context's objects for a batch. Prefers ones
+     * whose VAO is set up with the same attributes and element
+     * buffer, otherwise takes any one or creates it.
+     *
+     * @param attribs The batch's attributes.
+     * @param element_buffer The batch's element buffer.
+     * @param used Objects already taken by the flush.
+     */
+    BatchObjects &Get(const std::vector<Attrib> &attribs,
+                      GLuint element_buffer,
+                      const std::vector<const BatchObjects *> &used);
+
+    std::map<const Context *, std::shared_ptr<ContextBatches>> contexts_;
+    std::mutex mutex_;
+
+    friend class DrawBatcher;
+  };
+
+  /**
+   * @return Whatever the current context has multi-draw indirect and
+   * shader draw parameters.
+   */
+  static bool IsSupported();
+
+  DrawBatcher(Cache &cache) : cache_(cache) {}
+
+  DrawBatcher(const DrawBatcher &copy) = delete;
+
+  DrawBatcher &operator=(const DrawBatcher &copy) = delete;
+
+  /**
+   * Queues a node for Flush.
+   *
+   * @return false if the node can't be batched, and must be drawn by
+   * the caller.
+   */
+  bool Add(std::shared_ptr<ANode> node);
+
+  /**
+   * Draws the queued nodes. Nodes left alone in their batch are drawn
+   * by themselves.
+   *
+   * @param projection Projection matrix.
+   * @param view The view given to the nodes' Draw.
+   */
+  void Flush(const Eigen::Matrix4f &projection, const Eigen::Matrix4f &view);
+
+ private:
+  /**
+   * Layout of glMultiDrawElementsIndirect's commands.
+   */
+  struct ElementsCommand {
+    GLuint count, instance_count, first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+  };
+
+  /**
+   * Layout of glMultiDrawArraysIndirect's commands.
+   */
+  struct ArraysCommand {
+    GLuint count, instance_count, first, base_instance;
+  };
+
+  /**
+   * Nodes drawn by a single call.
+   */
+  struct Batch {
+    std::vector<std::shared_ptr<DrawProgram>> nodes;
+    std::vector<Attrib> attribs;
+    GLuint element_buffer;
+    GLenum index_type; /**< GL_NONE for drawing arrays.*/
+    std::vector<ObjectBlock> objects;
+    std::vector<ElementsCommand> elements_commands;
+    std::vector<ArraysCommand> arrays_commands;
+    int64_t vertices;
+  };
+
+  /**
+   * @return Whatever the nodes share the state set by the program's
+   * binding, so they can be drawn by the same call.
+   */
+  static bool SharesState(const DrawProgram &lfs, const DrawProgram &rhs);
+
+  /**
+   * Gets a node's attributes and draw command. Must be called with
+   * its program bound. Arrays are drawn from the command's
+   * first_index.
+   *
+   * @return false if the node's vertices can't be batched.
+   */
+  static bool GetNodeDraw(DrawProgram &node, std::vector<Attrib> *attribs,
+                          GLuint *element_buffer, GLenum *index_type,
+                          ElementsCommand *command);
+
+  /**
+   * Issues the batch's multi-draw call, with its program bound.
+   */
+  void DrawBatch(const Batch &batch);
+
+  Cache &cache_;
+
+  /**
+   * Queued nodes, grouped by SharesState.
+   */
+  std::vector<std::vector<std::shared_ptr<DrawProgram>>> groups_;
+
+  /**
+   * Cache objects taken by this batcher's batches.
+   */
+  std::vector<const Cache::BatchObjects *> used_objects_;
+};
+
+}  // namespace tenviz
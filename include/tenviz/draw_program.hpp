@@ -2,14 +2,21 @@
 
 #include <map>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <torch/csrc/utils/pybind.h>
 #include <torch/torch.h>
 
 #include "anode.hpp"
+#include "attrib_encoding.hpp"
 #include "gl_common.hpp"
+#include "gl_uniform_block.hpp"
 #include "style.hpp"
+#include "uniform_value.hpp"
 
 namespace tenviz {
 enum MatPlaceholder {
@@ -28,9 +35,22 @@ enum DrawMode {
   kPoints = GL_POINTS
 };
 
+class Context;
 class GLShaderProgram;
 class GLBuffer;
 class GLTexture;
+class InterleavedVertices;
+
+/**
+ * Program item, stored by its slot so it's drawn without looking up
+ * names, see GLShaderProgram::GetUniformSlot.
+ */
+template <typename Value>
+struct SlotItem {
+  int slot;
+  std::string name;
+  Value value;
+};
 
 class DrawProgram : public ANode {
  public:
@@ -52,8 +72,57 @@ class DrawProgram : public ANode {
 
   void SetItem(const std::string &name, std::shared_ptr<GLBuffer> buffer);
 
+  /**
+   * Sets attributes interleaved into a single buffer, replacing the
+   * ones from previous calls. They're drawn instead of buffers set by
+   * SetItem with the same names.
+   *
+   * @param attributes Tensors by attribute name, all of them with the
+   * same number of vertices.
+   */
+  void SetVertices(const std::map<std::string, torch::Tensor> &attributes);
+
   void SetItem(const std::string &name, const torch::Tensor &tensor);
 
+  /**
+   * Uploads an attribute in a compressed format. The program's
+   * `<name>_scale`, `<name>_offset` and `<name>_octahedral` uniforms,
+   * when declared, receive its decoding parameters.
+   *
+   * @param name Attribute name.
+   * @param tensor Attribute values, [N x channels] or [N].
+   * @param encoding The format uploaded to the GPU.
+   */
+  void SetAttrib(const std::string &name, const torch::Tensor &tensor,
+                 AttribEncoding encoding);
+
+  /**
+   * Sets a per-instance attribute. The node is drawn once per
+   * instance with a single instanced draw call, while shaders read a
+   * row of it every `divisor` instances. Other attributes are per
+   * vertex, shared by all instances. Assigning the attribute again
+   * with SetItem keeps it per-instance, while SetAttrib makes it per
+   * vertex.
+   *
+   * @param name Attribute name.
+   * @param tensor Attribute values, [N x channels] or [N].
+   * @param divisor Instances drawn with each row.
+   */
+  void SetInstanced(const std::string &name, const torch::Tensor &tensor,
+                    int divisor = 1);
+
+  /**
+   * Sets a per-instance attribute from a buffer, see the tensor
+   * overload.
+   */
+  void SetInstanced(const std::string &name, std::shared_ptr<GLBuffer> buffer,
+                    int divisor = 1);
+
+  /**
+   * Sets a matrix computed for each node. Programs declaring the
+   * CameraBlock read the matrices from the uniform blocks instead, so
+   * placeholders of uniforms that they don't declare are ignored.
+   */
   void SetItem(const std::string &name, MatPlaceholder placeholder);
 
   void SetItem(const std::string &name, std::shared_ptr<GLTexture> texture);
@@ -73,18 +142,166 @@ class DrawProgram : public ANode {
   void SetMaxDrawElems(int max_draw_elems) {
     max_draw_elems_ = max_draw_elems;
   }
-  
+
+  /**
+   * Draws only ranges of the vertices, or of the indices if set, with
+   * a single glMultiDrawArrays or glMultiDrawElements. Changing the
+   * ranges doesn't upload any buffer, and they override
+   * SetMaxDrawElems.
+   *
+   * @param ranges Integer [N x 2] tensor of (first, count) rows.
+   * Rows are vertices, or indices' rows, like the triangles of [F x
+   * 3] indices. Ranges past the current rows are clipped.
+   */
+  void SetDrawRanges(const torch::Tensor &ranges);
+
+  /**
+   * Draws all the vertices or indices again.
+   */
+  void ClearDrawRanges();
+
  private:
   std::shared_ptr<GLShaderProgram> program_;
-  std::map<std::string, std::shared_ptr<GLBuffer>> buffers_;
-  std::map<std::string, MatPlaceholder> matrix_placeholders_;
-  std::map<std::string, torch::Tensor> uniforms_;
-  std::map<std::string, std::shared_ptr<GLTexture>> textures_;
+  std::vector<SlotItem<std::shared_ptr<GLBuffer>>> buffers_; /**< By
+                                                              * attribute
+                                                              * slot.*/
+  std::shared_ptr<InterleavedVertices> vertices_;
+  std::vector<SlotItem<MatPlaceholder>> matrix_placeholders_;
+  std::vector<SlotItem<UniformValue>> uniforms_;
+  std::vector<SlotItem<std::shared_ptr<GLTexture>>> textures_;
+  std::set<std::string> decoded_attribs_;
+  std::map<int, int> attrib_divisors_; /**< Instanced attributes'
+                                        * divisors by slot.*/
   Bounds bounds_;
   DrawMode draw_mode_;
+  std::vector<std::pair<int64_t, int64_t>> draw_ranges_; /**< First
+                                                          * and count
+                                                          * rows.*/
+  bool has_draw_ranges_;
+
+  /**
+   * @return The transform relative to the frame's camera.
+   */
+  Eigen::Matrix4f GetObjectMatrix(const Eigen::Matrix4f &view) const;
+
+  /**
+   * Updates the ObjectBlock with the transform relative to the
+   * frame's camera, and binds it to the blocks used by the program.
+   */
+  void BindObjectBlock(const Eigen::Matrix4f &view);
+
+  /**
+   * Binds the textures and sets the uniforms into the bound program.
+   */
+  void BindUniforms();
+
+  void UnbindTextures();
+
+  /**
+   * @return The indices' type accepted by glDrawElements.
+   */
+  GLenum GetIndexType() const;
 
-  GLuint vao_;
+  /**
+   * @return The number of indices drawn.
+   */
+  size_t GetIndexCount() const;
+
+  /**
+   * Draws the ranges set by SetDrawRanges.
+   *
+   * @param draw_mode The primitive type.
+   * @param index_type GL_NONE for drawing vertices, or the indices'
+   * type from GetIndexType.
+   * @param rows The number of vertices or indices' rows.
+   * @param instance_count The number of instances, or -1 if not
+   * instanced.
+   */
+  void DrawRanges(GLenum draw_mode, GLenum index_type, int64_t rows,
+                  int instance_count);
+
+  static void SetAttribPointer(GLint attrib_loc, int channels, GLenum gl_type,
+                               bool integer, bool normalize, size_t stride,
+                               size_t offset);
+
+  /**
+   * SetAttrib with the attribute's divisor, 0 for per-vertex ones.
+   */
+  void SetAttrib(const std::string &name, const torch::Tensor &tensor,
+                 AttribEncoding encoding, int divisor);
+
+  /**
+   * Makes an attribute per-instance, or per-vertex if divisor is 0.
+   */
+  void SetDivisor(const std::string &name, int divisor);
+
+  /**
+   * @return An attribute slot's divisor, 0 if it's per-vertex.
+   */
+  int GetDivisor(int slot) const;
+
+  void SetDecodeUniforms(const std::string &name,
+                         const EncodedAttrib &encoded);
+
+  /**
+   * Sets a uniform value, validated against its declared type.
+   */
+  void SetUniformItem(const std::string &name, const UniformValue &value);
+
+  /**
+   * Vertex array object and the layout that its attributes were set
+   * up with.
+   */
+  struct VertexArray {
+    VertexArray() : vao(0), draws_vertices(false) {}
+
+    GLuint vao;
+    std::vector<uint64_t> layout; /**< UpdateLayout's value when set up.*/
+    std::set<GLint> enabled_attribs;
+    std::vector<std::shared_ptr<GLBuffer>> attrib_buffers; /**< Buffers
+                                                            * with an
+                                                            * attribute.*/
+    std::vector<std::pair<std::shared_ptr<GLBuffer>, int>>
+        instance_buffers; /**< Instanced buffers and their divisors.*/
+    bool draws_vertices; /**< Whatever vertices_ has attributes.*/
+  };
+
+  /**
+   * @return The vertex array object of the current context. VAOs
+   * aren't shared between contexts, so one is created for each
+   * context drawing this node.
+   */
+  VertexArray &GetVertexArray();
+
+  /**
+   * Updates, in place, the values that change whenever the attributes
+   * must be set up again: the program's link, and the buffers'
+   * generations and formats.
+   *
+   * @param layout The vertex array's last layout.
+   * @return Whatever any value changed.
+   */
+  bool UpdateLayout(std::vector<uint64_t> &layout) const;
+
+  /**
+   * Points the bound vertex array's attributes to the buffers.
+   */
+  void SetupVertexArray(VertexArray &vertex_array);
+
+  VertexArray vertex_array_;
+  const Context *vao_owner_;
+  std::map<const Context *, VertexArray> context_vertex_arrays_;
+  std::mutex vao_mutex_;
+  uint64_t layout_generation_; /**< Incremented when attributes are
+                                * assigned to other buffers.*/
+  std::shared_ptr<GLUniformBlock> object_block_; /**< Registered into the
+                                                   * creator context.*/
+  Eigen::Matrix4f object_matrix_; /**< Last uploaded into object_block_.*/
+  bool has_object_matrix_;
+  std::mutex object_block_mutex_;
   bool ignore_missing_;
   int max_draw_elems_;
+
+  friend class DrawBatcher;
 };
 }  // namespace tenviz
@@ -114,11 +114,16 @@ inline torch::ScalarType cast_type(GLenum scalar_type) {
       return torch::kFloat;
     case GL_INT:
       return torch::kInt32;
+    // Unsigned indices are stored with the same bits in signed tensors.
+    case GL_UNSIGNED_INT:
+      return torch::kInt32;
 
     case GL_HALF_FLOAT:
       return torch::kHalf;
     case GL_SHORT:
       return torch::kInt16;
+    case GL_UNSIGNED_SHORT:
+      return torch::kInt16;
 
     case GL_BYTE:
       return torch::kInt8;
@@ -138,6 +143,7 @@ enum DType {
   kInt64 = GL_INT64_ARB,
   kFloat = GL_FLOAT,
   kInt32 = GL_INT,
+  kHalf = GL_HALF_FLOAT,
   kInt16 = GL_SHORT,
   kUint8 = GL_UNSIGNED_BYTE,
   kInt8 = GL_BYTE
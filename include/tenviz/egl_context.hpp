@@ -0,0 +1,68 @@
+#pragma once
+
+namespace tenviz {
+
+/**
+ * Headless OpenGL context created through EGL. It uses the first EGL
+ * device (EGL_EXT_platform_device) when available, falling back to
+ * Mesa's surfaceless platform and then to the default display. No
+ * window system is required.
+ *
+ * EGL types are kept opaque in this header to avoid leaking the
+ * platform headers (and their X11 macros) into the rest of the
+ * library.
+ */
+class EGLOffscreenContext {
+ public:
+  /**
+   * @return Whatever the library was built with EGL support.
+   */
+  static bool IsSupported();
+
+  EGLOffscreenContext();
+
+  EGLOffscreenContext(const EGLOffscreenContext &copy) = delete;
+
+  EGLOffscreenContext &operator=(const EGLOffscreenContext &copy) = delete;
+
+  ~EGLOffscreenContext() { Release(); }
+
+  /**
+   * Creates the EGL context. Throws Error on failure.
+   *
+   * @param width Pbuffer width, only used if the driver doesn't
+   * support surfaceless contexts.
+   * @param height Pbuffer height.
+   * @param profile Whatever to request an OpenGL core profile.
+   * @param share Context to share objects with. May be nullptr.
+   */
+  void Initialize(int width, int height, bool profile,
+                  const EGLOffscreenContext *share = nullptr);
+
+  /**
+   * Binds the context into the calling thread.
+   */
+  void MakeCurrent();
+
+  /**
+   * Unbinds any EGL context from the calling thread.
+   */
+  void DetachCurrent();
+
+  /**
+   * Destroys the context and its surface.
+   */
+  void Release();
+
+  /**
+   * @return Whatever Initialize was successfully called.
+   */
+  bool is_initialized() const { return context_ != nullptr; }
+
+ private:
+  void *display_;
+  void *context_;
+  void *surface_;
+};
+
+}  // namespace tenviz
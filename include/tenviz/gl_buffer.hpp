@@ -1,19 +1,25 @@
 #pragma once
 
 #include <inttypes.h>
+#include <atomic>
+#include <map>
+#include <mutex>
 #include <vector>
 
 #include "gl_common.hpp"
 
-#include <cuda_gl_interop.h>
 #include <torch/torch.h>
 
 #include "context_resource.hpp"
 #include "cuda_memory.hpp"
 #include "dtype.hpp"
+#include "gl_buffer_arena.hpp"
+#include "shared_buffer_channel.hpp"
 
 namespace tenviz {
 
+class Context;
+
 /**
  * Supported buffer targets.
  */
@@ -23,9 +29,15 @@ enum BufferTarget {
 };
 
 /**
- * Supported buffer usages.
+ * Supported buffer usages. Stream buffers are rings of persistently
+ * mapped buffers for rewriting every frame, see
+ * GLBuffer::BeginStreamWrite.
  */
-enum BufferUsage { kDynamic = GL_DYNAMIC_DRAW, kStatic = GL_STATIC_DRAW };
+enum BufferUsage {
+  kDynamic = GL_DYNAMIC_DRAW,
+  kStatic = GL_STATIC_DRAW,
+  kStream = GL_STREAM_DRAW
+};
 
 /**
  * OpenGL array buffer that can be mapped as PyTorch tensors.
@@ -36,14 +48,14 @@ enum BufferUsage { kDynamic = GL_DYNAMIC_DRAW, kStatic = GL_STATIC_DRAW };
 class GLBuffer : public IContextResource {
  public:
   /**
-   * Create an empty buffer.
+   * Create an empty buffer. Dynamic and static ones start as slices of
+   * the current context's arena, see Context::GetBufferArena. They
+   * move into their own buffer object, with CUDA interop, when they
+   * grow beyond kMaxArenaSize, are first filled from a CUDA tensor,
+   * or are mapped as tensors.
    */
   static std::shared_ptr<GLBuffer> Create(BufferTarget target = kArray,
-                                          BufferUsage usage = kDynamic) {
-    auto buf = std::make_shared<GLBuffer>(target, usage);
-    IContextResource::RegisterResourceOnCurrent(buf);
-    return buf;
-  }
+                                          BufferUsage usage = kDynamic);
 
   static void RegisterPybind(pybind11::module &m,
                              IContextResource::PythonClassDef &base_class);
@@ -51,8 +63,12 @@ class GLBuffer : public IContextResource {
   /**
    * @param target OpenGL's buffer target to use
    * @param usage OpenGL's usage
+   * @param arena If not null, then the buffer's storage starts as a
+   * slice of it, and CUDA interop isn't used until it leaves the
+   * arena.
    */
-  GLBuffer(GLenum target, GLenum usage);
+  GLBuffer(GLenum target, GLenum usage,
+           std::shared_ptr<GLBufferArena> arena = nullptr);
 
   ~GLBuffer();
 
@@ -84,30 +100,97 @@ class GLBuffer : public IContextResource {
 
   /**
    * Map the buffer to a Tensor. The tensor must be unmapped by the
-   * user.
+   * user. Needs CUDA interop, see IsCudaInteropAvailable.
    *
    * @return mapped tensor. 
    */
   std::shared_ptr<CudaMappedTensor> AsTensor();
 
   /**
-   * Copies the tensor values to the buffer.
+   * Copies the tensor values to the buffer. CPU tensors are uploaded
+   * by OpenGL, and CUDA ones through CUDA interop. The storage is
+   * only reallocated when the tensor doesn't fit its capacity. Stream
+   * buffers that fit are written into their next ring slot.
+   *
+   * Element buffers take int64, int32, int16 or uint8 indices, and
+   * store them as GL_UNSIGNED_SHORT if the maximum index is below
+   * 65536, or as GL_UNSIGNED_INT otherwise. Negative or larger indices
+   * throw an Error.
    */
   void FromTensor(const torch::Tensor &tensor);
 
+  /**
+   * Overwrites a range of rows without reallocating, costing only the
+   * updated rows.
+   *
+   * @param tensor Values with the buffer's type and columns. Element
+   * buffers take any integer indices that fit their index type.
+   *
+   * @param offset_rows First row to overwrite.
+   */
+  void Update(const torch::Tensor &tensor, int offset_rows = 0);
+
+  /**
+   * Gets the next slot of a stream buffer's ring as a CPU tensor that
+   * views the OpenGL memory, so it's written without extra copies.
+   * Only waits the GPU if it's still drawing from that slot.
+   *
+   * @return The slot's tensor, valid until EndStreamWrite.
+   */
+  torch::Tensor BeginStreamWrite();
+
+  /**
+   * Makes the slot returned by BeginStreamWrite the one used for
+   * drawing.
+   */
+  void EndStreamWrite();
+
+  /**
+   * Marks the commands issued until now by the current context as
+   * readers of the stream buffer's current slot. Does nothing on
+   * other buffers.
+   */
+  void FenceStream();
+
+  /**
+   * Binds the buffer to a shared memory channel, whose latest frames
+   * are uploaded by PollChannel.
+   *
+   * @param channel The channel, or nullptr for unbinding.
+   */
+  void BindChannel(std::shared_ptr<SharedBufferChannel> channel);
+
+  /**
+   * Uploads the rows changed by the channel's frames published since
+   * the last poll. DrawProgram calls it before drawing, from any
+   * thread.
+   *
+   * @return Whatever a new frame was uploaded.
+   */
+  bool PollChannel();
+
+  /**
+   * @return Whatever any buffer has channel frames not uploaded yet,
+   * so viewers know they must redraw.
+   */
+  static bool HasPendingChannelFrames();
+
   /**
    * Copies the buffer into a tensor.
    * 
    * @param keep_on_device Whatever the tensor should be kept on the
    * device. If the final Tensor target is the CPU, then GPU -> CPU
-   * copying is faster.
+   * copying is faster. Ignored without CUDA interop.
 
    * @return A new tensor with the copied data from the buffer.
+   * Unsigned indices are widened to int32 or int64.
    */
   torch::Tensor ToTensor(bool keep_on_device = true);
 
   /**
-   * Same as torch::index_put into the buffer.
+   * Same as torch::index_put into the buffer. CPU tensors are written
+   * in runs of consecutive rows, and repeated indices write only one
+   * of their rows.
    *
    * @param indices Selected indices.
    *
@@ -122,7 +205,7 @@ class GLBuffer : public IContextResource {
    *
    * @param keep_on_device Whatever the tensor should be kept on the
    * device. If the final Tensor target is the CPU, then GPU -> CPU
-   * copying is faster.
+   * copying is faster. Ignored without CUDA interop.
    *
    * @return A new tensor the copied data from the buffer.
    */
@@ -154,14 +237,48 @@ class GLBuffer : public IContextResource {
   GLenum get_gl_type() const { return gltype_; }
 
   /**
-   * @return OpenGL's creation ID.
+   * @return OpenGL's creation ID. Arena's slices share it with
+   * others.
    */
-  GLuint get_buffer_id() const { return buffer_id_; }
+  GLuint get_buffer_id() const {
+    if (arena_ != nullptr) {
+      return (slice_ != nullptr) ? slice_->get_buffer() : 0;
+    }
+    return buffer_id_;
+  }
+
+  /**
+   * @return The byte offset of the data inside the OpenGL buffer, non
+   * zero for arena's slices.
+   */
+  size_t get_offset() const {
+    return (slice_ != nullptr) ? slice_->get_offset() : 0;
+  }
+
+  /**
+   * @return A counter incremented when the buffer object, offset,
+   * type or columns change, so vertex array objects know they must be
+   * set up again.
+   */
+  uint64_t get_generation() const {
+    return generation_ + ((slice_ != nullptr) ? slice_->get_generation() : 0);
+  }
 
   /**
    * @return Whatever if the tensor is empty.
    */
   bool is_empty() const { return size_.empty(); }
+
+  /**
+   * @return The allocated bytes, which may be larger than the
+   * tensor's.
+   */
+  size_t get_capacity() const { return capacity_; }
+
+  /**
+   * @return Whatever the buffer has the stream usage.
+   */
+  bool is_stream() const { return usage_ == GL_STREAM_DRAW; }
   
   bool normalize = false; /**< If true, the buffer will be normalized
                            * into 0.0-1.0 in shaders.*/
@@ -170,11 +287,98 @@ class GLBuffer : public IContextResource {
                                 * shaders..*/
 
  private:
-  void AllocateImpl(size_t size);
+  static const int kStreamRingSize = 3;
+
+  /**
+   * Larger buffers don't take arena slices, so they keep CUDA
+   * interop and don't fill the arena's blocks.
+   */
+  static const size_t kMaxArenaSize = 256 << 10;
+
+  struct StreamSlot {
+    GLuint buffer;
+    void *data;
+    /**
+     * Last fence of each context drawing from the slot, as contexts'
+     * commands don't finish in order.
+     */
+    std::map<const Context *, GLsync> fences;
+  };
+
+  /**
+   * Reallocates only if the size exceeds the capacity.
+   */
+  void AllocateImpl(size_t size, const void *data = nullptr);
+
+  size_t GetByteSize() const;
+
+  /**
+   * @return The arena slice's alignment. Array buffers' slices start
+   * at a multiple of their row size, so their offset is a whole
+   * number of vertices, see DrawBatcher.
+   */
+  size_t GetArenaAlignment() const;
+
+  /**
+   * Moves the storage from the arena's slice into its own buffer
+   * object.
+   *
+   * @param keep_data Whatever to copy the slice's contents.
+   */
+  void LeaveArena(bool keep_data);
+
+  /**
+   * Sets the type and dimensions, incrementing the generation if the
+   * type or the columns change.
+   */
+  void SetShape(GLenum gltype, const std::vector<int64_t> &size);
+
+  /**
+   * Increments the generation. Must be called before replacing the
+   * arena's slice.
+   */
+  void NextGeneration();
+
+  /**
+   * @return Whatever transfers with CUDA tensors should use CUDA
+   * interop.
+   */
+  bool UseCudaInterop() const;
+
+  /**
+   * @return The indices as a contiguous int64 CPU tensor, checked
+   * against the buffer's rows.
+   */
+  torch::Tensor GetCPUIndices(const torch::Tensor &indices) const;
+
+  void AllocateStream(size_t size);
+
+  void ReleaseStream();
+
+#ifdef TENVIZ_WITH_CUDA
+  /**
+   * Registers the buffer on CUDA on the first use.
+   */
+  cudaGraphicsResource_t GetCudaResource();
+#endif
 
   GLuint buffer_id_;
   cudaGraphicsResource_t cuda_resource_;
   GLenum target_, usage_, gltype_;
   std::vector<int64_t> size_;
+  size_t capacity_;
+  uint64_t generation_;
+
+  std::shared_ptr<GLBufferArena> arena_;
+  std::shared_ptr<GLBufferArena::Slice> slice_;
+
+  std::vector<StreamSlot> stream_slots_;
+  int stream_current_, stream_writing_;
+  std::mutex fence_mutex_; /**< Guards the slots' fences.*/
+
+  std::shared_ptr<SharedBufferChannel> channel_;
+  std::atomic<uint64_t> channel_frame_;
+  std::mutex channel_mutex_; /**< Render pool's workers poll the same
+                              * buffer.*/
 };
 }  // namespace tenviz
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <memory>
+#include <set>
+
+#include "context_resource.hpp"
+#include "gl_common.hpp"
+
+namespace tenviz {
+
+/**
+ * Sub-allocates ranges of a few large OpenGL buffers, so many small
+ * GLBuffers don't need a buffer object each. Free ranges are kept
+ * sorted by offset and merged with their neighbours when released.
+ *
+ * Its methods must be called with the owner context current, see
+ * Context::GetBufferArena.
+ */
+class GLBufferArena : public IContextResource {
+ private:
+  struct Block;
+
+ public:
+  static const size_t kBlockSize = 4 << 20;
+
+  /**
+   * Slice's offsets alignment, enough for any vertex attribute or
+   * index type.
+   */
+  static const size_t kAlignment = 16;
+
+  /**
+   * Range of an arena's buffer. Its buffer and offset change when
+   * the arena is defragmented.
+   */
+  class Slice {
+   public:
+    GLuint get_buffer() const { return buffer_; }
+
+    size_t get_offset() const { return offset_; }
+
+    size_t get_size() const { return size_; }
+
+    /**
+     * @return A counter incremented when defragmenting moves the
+     * slice.
+     */
+    uint64_t get_generation() const { return generation_; }
+
+   private:
+    GLuint buffer_;
+    size_t offset_, size_, alignment_;
+    uint64_t generation_;
+    Block *block_;
+
+    friend class GLBufferArena;
+  };
+
+  static void RegisterPybind(pybind11::module &m,
+                             IContextResource::PythonClassDef &base_class);
+
+  GLBufferArena();
+
+  GLBufferArena(const GLBufferArena &copy) = delete;
+
+  GLBufferArena &operator=(const GLBufferArena &copy) = delete;
+
+  ~GLBufferArena();
+
+  /**
+   * Reserves a range, taken from the first free one that fits, or
+   * from a new buffer.
+   *
+   * @param size Range size in bytes.
+   * @param alignment The range's offset is a multiple of it, also
+   * after defragmenting. Must be a multiple of kAlignment.
+   */
+  std::shared_ptr<Slice> Allocate(size_t size, size_t alignment = kAlignment);
+
+  /**
+   * Gives back a slice's range. Buffers left empty are deleted,
+   * except the last one.
+   *
+   * @param slice Slice from Allocate, or nullptr for no-op.
+   */
+  void Free(const std::shared_ptr<Slice> &slice);
+
+  /**
+   * Moves the slices of buffers with scattered free ranges into new
+   * buffers, packed from their start.
+   */
+  void Defragment();
+
+  void Release() override;
+
+  /**
+   * @return The number of OpenGL buffers.
+   */
+  int get_block_count() const { return int(blocks_.size()); }
+
+  /**
+   * @return The bytes held by slices.
+   */
+  size_t get_used_size() const { return used_size_; }
+
+  /**
+   * @return The bytes held by the OpenGL buffers.
+   */
+  size_t get_allocated_size() const;
+
+ private:
+  struct Block {
+    GLuint buffer;
+    size_t size;
+    std::map<size_t, size_t> free_ranges; /**< Offset to size. */
+    std::set<Slice *> slices;
+  };
+
+  Block *CreateBlock(size_t size);
+
+  void DeleteBlock(std::list<Block>::iterator block);
+
+  std::list<Block> blocks_;
+  size_t used_size_;
+  bool released_;
+};
+
+}  // namespace tenviz
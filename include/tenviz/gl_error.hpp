@@ -1,29 +1,74 @@
 #pragma once
 
+#include <atomic>
 #include <string>
 
 #include "error.hpp"
 #include "gl_common.hpp"
 
+#ifdef TENVIZ_NO_GL_CHECK
+#define GLCheckError()
+#else
 #define GLCheckError() tenviz::_glCheckError(__FILE__, __LINE__)
+#endif
 
 namespace tenviz {
 
+/**
+ * How GLCheckError reports OpenGL errors.
+ */
+enum class GLErrorMode {
+  kCheck,       /**<Polls glGetError after each call and throws on
+                 * errors. Forces the driver to synchronize.*/
+  kDebugOutput, /**<The driver reports errors to a KHR_debug callback,
+                 * which logs them with the last checked call.*/
+  kDisabled     /**<No checking.*/
+};
+
 /* @return converted OpenGL error enum to its string version.
  */
 const char *GetGLErrorString(GLenum gl_err);
 
+/**
+ * Sets the error mode of all contexts. Contexts switch their debug
+ * output on the next time they're made current. The default is
+ * kCheck, or kDisabled on NDEBUG builds.
+ */
+void SetGLErrorMode(GLErrorMode mode);
+
+GLErrorMode GetGLErrorMode();
+
+/**
+ * Turns the KHR_debug callback of the current OpenGL context on or
+ * off.
+ *
+ * @return Whatever the debug output is on. False if the context
+ * doesn't support KHR_debug.
+ */
+bool SetGLDebugOutput(bool enable);
+
+/**
+ * Records the last checked call, which debug output messages refer
+ * to.
+ */
+void SetGLCheckpoint(const char *file, int line);
+
+extern std::atomic<GLErrorMode> g_gl_error_mode;
+
 inline void _glCheckError(const char *file, const int line) {
-#ifndef NDEBUG
-  const GLenum err = glGetError();
-
-  if (err != GL_NO_ERROR && err != GL_FRAMEBUFFER_COMPLETE) {
-    std::stringstream format;
-    format << "GL call " << file << "(" << line
-           << "): " << GetGLErrorString(err);
-    throw Error(format);
+  const GLErrorMode mode = g_gl_error_mode.load(std::memory_order_relaxed);
+  if (mode == GLErrorMode::kCheck) {
+    const GLenum err = glGetError();
+
+    if (err != GL_NO_ERROR && err != GL_FRAMEBUFFER_COMPLETE) {
+      std::stringstream format;
+      format << "GL call " << file << "(" << line
+             << "): " << GetGLErrorString(err);
+      throw Error(format);
+    }
+  } else if (mode == GLErrorMode::kDebugOutput) {
+    SetGLCheckpoint(file, line);
   }
-#endif
 }
 
 }  // namespace tenviz
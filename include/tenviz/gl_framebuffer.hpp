@@ -52,8 +52,21 @@ class GLFramebuffer : public IContextResource {
   /**
    * Sets the size of the frame buffer (width and height).
    * @size the buffer's width and height.
+   * @layers Number of layers. Layered framebuffers use 2D array
+   * textures, one layer per image, and 0 layers means a single
+   * rectangle texture image.
    */
-  void SetSize(int width, int height);
+  void SetSize(int width, int height, int layers = 0);
+
+  /**
+   * Redirects the rendering to a layer of the attachments. The
+   * framebuffer must be bound.
+   *
+   * @layer Layer index, less than the number of layers.
+   */
+  void SetLayer(int layer);
+
+  int get_layers() const { return layers_; }
 
   /**
    * Binds or unbinds the framebuffer from the current GL's context.
@@ -77,7 +90,7 @@ class GLFramebuffer : public IContextResource {
   GLuint fbo_;
   std::map<int, TargetEntry> targets_;
   std::shared_ptr<GLTexture> depth_;
-  int width_, height_;
+  int width_, height_, layers_;
   bool dirty_;
 };
 }  // namespace tenviz
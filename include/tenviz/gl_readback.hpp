@@ -0,0 +1,110 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <torch/csrc/utils/pybind.h>
+#include <torch/torch.h>
+
+#include "gl_common.hpp"
+
+namespace tenviz {
+
+class GLReadbackRing;
+
+/**
+ * Handle to a texture read that the GPU is still transferring into a
+ * pixel pack buffer. Its methods must be called with the owner
+ * context current.
+ */
+class GLReadback {
+ public:
+  static void RegisterPybind(pybind11::module &m);
+
+  GLReadback(const GLReadback &copy) = delete;
+
+  GLReadback &operator=(const GLReadback &copy) = delete;
+
+  /**
+   * @return Whatever the transfer has finished, so Get won't block.
+   */
+  bool IsReady();
+
+  /**
+   * Waits the transfer and copies the pixels into a CPU tensor.
+   *
+   * @return The texture image, shaped as in GLTexture::ToTensor.
+   */
+  torch::Tensor Get();
+
+ private:
+  GLReadback(GLuint pbo, const std::vector<int64_t> &sizes,
+             torch::ScalarType dtype);
+
+  /**
+   * Copies the pixels out of the buffer, so it can be reused.
+   */
+  void Resolve();
+
+  GLuint pbo_;
+  GLsync fence_;
+  std::vector<int64_t> sizes_;
+  torch::ScalarType dtype_;
+  torch::Tensor result_;
+  bool resolved_;
+
+  friend class GLReadbackRing;
+};
+
+/**
+ * Ring of pixel pack buffers for issuing texture reads without
+ * waiting the GPU. A buffer is reused once its previous read has been
+ * resolved, reads still pending at that moment are resolved first.
+ */
+class GLReadbackRing {
+ public:
+  static const int kDefaultSize = 3;
+
+  GLReadbackRing(int size = kDefaultSize);
+
+  GLReadbackRing(const GLReadbackRing &copy) = delete;
+
+  GLReadbackRing &operator=(const GLReadbackRing &copy) = delete;
+
+  ~GLReadbackRing() { Release(); }
+
+  /**
+   * Queues the read of a texture's first level.
+   *
+   * @param target Texture target.
+   * @param texture Texture name.
+   * @param format Pixel format, as in glGetTexImage.
+   * @param type Pixel type, as in glGetTexImage.
+   * @param sizes Result's tensor shape.
+   * @param dtype Result's tensor type.
+   */
+  std::shared_ptr<GLReadback> Read(GLenum target, GLuint texture,
+                                   GLenum format, GLenum type,
+                                   const std::vector<int64_t> &sizes,
+                                   torch::ScalarType dtype);
+
+  /**
+   * Resolves the pending reads and deletes the buffers. Must be called
+   * with the owner context current.
+   */
+  void Release();
+
+ private:
+  struct Slot {
+    Slot() : pbo(0), capacity(0) {}
+
+    GLuint pbo;
+    size_t capacity;
+    std::shared_ptr<GLReadback> pending;
+  };
+
+  std::vector<Slot> slots_;
+  int next_slot_;
+};
+
+}  // namespace tenviz
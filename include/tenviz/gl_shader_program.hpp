@@ -1,6 +1,8 @@
 #pragma once
 
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <vector>
 
@@ -11,9 +13,18 @@
 #include "eigen_common.hpp"
 #include "gl_common.hpp"
 #include "gl_shader.hpp"
+#include "uniform_value.hpp"
 
 namespace tenviz {
 
+class Context;
+
+/**
+ * Shader program. Programs can be used from contexts sharing objects
+ * with the one that created them: as uniform values are part of the
+ * program object state, each context draws with its own linked copy
+ * of the program.
+ */
 class GLShaderProgram : public IContextResource {
  public:
   enum ShaderType {
@@ -22,6 +33,27 @@ class GLShaderProgram : public IContextResource {
     kGeometry = GL_GEOMETRY_SHADER
   };
 
+  /**
+   * Active attribute or uniform, enumerated when the program is
+   * linked.
+   */
+  struct Variable {
+    std::string name; /**< Arrays are named without the "[0]".*/
+    GLint location;   /**< -1 for uniforms inside blocks.*/
+    GLenum type;      /**< Like GL_FLOAT_VEC3 or GL_SAMPLER_2D.*/
+    GLint size;       /**< Array length, or 1.*/
+  };
+
+  /**
+   * Loads a program from shader files. Programs are shared by the
+   * calls with the same files on the current context, so nodes using
+   * the same shaders compile them once, and are drawn in batches.
+   * Shared programs recompile changed files for all of their users.
+   *
+   * @param vertex_filepath Vertex shader file, or empty.
+   * @param frag_filepath Fragment shader file, or empty.
+   * @param geo_filepath Geometry shader file, or empty.
+   */
   static std::shared_ptr<GLShaderProgram> LoadFS(
       const std::string &vertex_filepath, const std::string &frag_filepath = "",
       const std::string &geo_filepath = "");
@@ -29,6 +61,19 @@ class GLShaderProgram : public IContextResource {
   static void RegisterPybind(pybind11::module &m,
                              IContextResource::PythonClassDef &base_class);
 
+  /**
+   * Gets the tensor that sets a uniform type.
+   *
+   * @param type Uniform type, like GL_FLOAT_VEC3.
+   * @param scalar_type Set to torch::kFloat or torch::kInt32.
+   * @param shape Set to [components] for scalars and vectors, or
+   * [rows, cols] for matrices.
+   *
+   * @return false if tensors can't set this type.
+   */
+  static bool GetUniformShape(GLenum type, torch::ScalarType *scalar_type,
+                              std::vector<int64_t> *shape);
+
   GLShaderProgram();
 
   ~GLShaderProgram();
@@ -52,58 +97,206 @@ class GLShaderProgram : public IContextResource {
 
   const std::string &get_link_log() const { return last_link_log_; }
 
+  /**
+   * @return A counter incremented when shaders are recompiled, which
+   * may move attribute locations.
+   */
+  int get_link_generation() const { return link_generation_; }
+
+  /**
+   * @return The active attributes of the last link.
+   */
+  std::vector<Variable> get_attribs() const;
+
+  /**
+   * @return The active uniforms of the last link.
+   */
+  std::vector<Variable> get_uniforms() const;
+
+  /**
+   * @return Whatever the linked program declares the CameraBlock
+   * uniform block, see GLUniformBlock.
+   */
+  bool UsesCameraBlock() const { return instance_.has_camera_block; }
+
+  /**
+   * @return Whatever the linked program declares the ObjectBlock
+   * uniform block.
+   */
+  bool UsesObjectBlock() const { return instance_.has_object_block; }
+
+  /**
+   * @return Whatever the linked program declares the ObjectBuffer
+   * storage block, so its nodes can be drawn in batches.
+   */
+  bool UsesObjectBuffer() const { return instance_.has_object_buffer; }
+
   bool HasUniform(const std::string &name) const;
 
   bool HasAttrib(const std::string &name) const;
 
+  /**
+   * @return The uniform's reflection, or nullptr if it isn't active.
+   */
+  const Variable *FindUniform(const std::string &name) const;
+
+  /**
+   * @return The attribute's reflection, or nullptr if it isn't
+   * active.
+   */
+  const Variable *FindAttrib(const std::string &name) const;
+
+  /**
+   * Validates a value for a uniform against its reflected type.
+   * Throws Error if they don't match. Accepts anything for inactive
+   * uniforms.
+   */
+  void CheckUniformValue(const std::string &name,
+                         const UniformValue &value) const;
+
+  /**
+   * Slots are indices for names that stay valid when the program is
+   * relinked, so locations are looked up without strings while
+   * drawing.
+   *
+   * @return The uniform's slot, created on the first call.
+   */
+  int GetUniformSlot(const std::string &name);
+
+  /**
+   * @return The attribute's slot, created on the first call. See
+   * GetUniformSlot.
+   */
+  int GetAttribSlot(const std::string &name);
+
   GLint GetUniformLocation(const std::string &name);
 
   GLint GetAttribLocation(const std::string &name);
 
+  /**
+   * @return The location of a slot in the current context's program,
+   * or -1 if it isn't active.
+   */
+  GLint GetUniformLocation(int slot);
+
+  /**
+   * @return The location of a slot in the current context's program,
+   * or -1 if it isn't active.
+   */
+  GLint GetAttribLocation(int slot);
+
   void SetUniform(const std::string &name, const torch::Tensor &tensor);
 
+  void SetUniform(int slot, const torch::Tensor &tensor);
+
+  /**
+   * Sets a slot's uniform on the current context's program. Values
+   * equal to the last one set since the program was linked aren't
+   * uploaded again, as programs keep their uniforms.
+   */
+  void SetUniform(int slot, const UniformValue &value);
+
+  /**
+   * @return Whatever the program is bound on the current context.
+   */
+  bool is_binded() { return GetCurrentInstance().is_binded; }
+
   void SetUniformValue(const std::string &name, float v) {
-    if (is_binded_) glUniform1f(GetUniformLocation(name), v);
+    SetUniform(GetUniformSlot(name), UniformValue(v));
   }
   void SetUniformValue(const std::string &name, int v) {
-    if (is_binded_) glUniform1i(GetUniformLocation(name), v);
+    SetUniform(GetUniformSlot(name), UniformValue(v));
   }
   void SetUniformValue(const std::string &name, short v) {
-    if (is_binded_) glUniform1i(GetUniformLocation(name), v);
+    SetUniform(GetUniformSlot(name), UniformValue(int(v)));
   }
   void SetUniformValue(const std::string &name, char v) {
-    if (is_binded_) glUniform1i(GetUniformLocation(name), v);
+    SetUniform(GetUniformSlot(name), UniformValue(int(v)));
   }
 
   void SetUniformValue(const std::string &name, const Eigen::Vector2f &v) {
-    if (is_binded_) glUniform2f(GetUniformLocation(name), v[0], v[1]);
+    SetUniform(GetUniformSlot(name), UniformValue::Vector(v.data(), 2));
   }
   void SetUniformValue(const std::string &name, const Eigen::Vector3f &v) {
-    if (is_binded_) glUniform3f(GetUniformLocation(name), v[0], v[1], v[2]);
+    SetUniform(GetUniformSlot(name), UniformValue::Vector(v.data(), 3));
   }
   void SetUniformValue(const std::string &name, const Eigen::Vector4f &v) {
-    if (is_binded_)
-      glUniform4f(GetUniformLocation(name), v[0], v[1], v[2], v[3]);
+    SetUniform(GetUniformSlot(name), UniformValue::Vector(v.data(), 4));
   }
   void SetUniformValue(const std::string &name, const Eigen::Matrix3f &mat) {
-    if (is_binded_)
-      glUniformMatrix3fv(GetUniformLocation(name), 1, GL_FALSE, mat.data());
+    SetUniform(GetUniformSlot(name), UniformValue(mat));
   }
   void SetUniformValue(const std::string &name, const Eigen::Matrix4f &mat) {
-    if (is_binded_)
-      glUniformMatrix4fv(GetUniformLocation(name), 1, GL_FALSE, mat.data());
+    SetUniform(GetUniformSlot(name), UniformValue(mat));
+  }
+
+  void SetUniformValue(int slot, int v) { SetUniform(slot, UniformValue(v)); }
+  void SetUniformValue(int slot, const Eigen::Matrix3f &mat) {
+    SetUniform(slot, UniformValue(mat));
+  }
+  void SetUniformValue(int slot, const Eigen::Matrix4f &mat) {
+    SetUniform(slot, UniformValue(mat));
   }
 
  private:
   void AddShader(std::shared_ptr<GLShader> shader);
 
+  /**
+   * Program object linked for one context.
+   */
+  struct Instance {
+    Instance()
+        : program_id(0),
+          is_linked(false),
+          is_binded(false),
+          has_camera_block(false),
+          has_object_block(false),
+          has_object_buffer(false) {
+      link_generation = 0;
+    }
+
+    GLuint program_id;
+    bool is_linked, is_binded;
+    bool has_camera_block, has_object_block, has_object_buffer;
+    int link_generation; /**<Value of link_generation_ when linked.*/
+
+    std::map<std::string, Variable> attribs, uniforms;
+    std::vector<GLint> attrib_locations,
+        uniform_locations; /**<Locations by slot.*/
+    std::vector<UniformValue> uniform_values; /**<Last set by slot.*/
+  };
+
+  Instance &GetCurrentInstance();
+
+  bool Link(Instance &instance);
+
+  /**
+   * Enumerates the active attributes and uniforms of a linked
+   * instance.
+   */
+  void Reflect(Instance &instance);
+
+  /**
+   * Looks up the locations of slots created after the last lookup.
+   */
+  void ResolveSlots(const std::map<std::string, Variable> &variables,
+                    const std::vector<std::string> &slot_names,
+                    std::vector<GLint> *locations);
+
   void WriteLog(const std::string &logr);
 
-  GLuint program_id_;
+  Instance instance_;
+  Context *owner_;
+  std::map<const Context *, Instance> replicas_;
+  int link_generation_;
+  std::mutex mutex_;
+
   std::vector<std::shared_ptr<GLShader>> shaders_;
   std::string last_link_log_;
-  bool is_linked_, is_binded_;
 
   std::set<std::string> not_found_variables_;
+
+  std::map<std::string, int> attrib_slots_, uniform_slots_;
+  std::vector<std::string> attrib_slot_names_, uniform_slot_names_;
 };
 }  // namespace tenviz
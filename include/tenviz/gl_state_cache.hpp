@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <utility>
+
+#include "gl_common.hpp"
+#include "style.hpp"
+
+namespace tenviz {
+
+/**
+ * Shadow copy of the binding state of an OpenGL context. Binds that
+ * would set the state that is already current are skipped, and
+ * resources don't unbind themselves while a cache is current: they
+ * stay bound until something else is bound in their place.
+ *
+ * The static methods act on the cache current on the calling thread,
+ * or go straight to OpenGL when there's none. Contexts set their
+ * cache while current, and start it empty, as the state may have been
+ * changed by others.
+ */
+class GLStateCache {
+ public:
+  /**
+   * @return The cache current on the calling thread, or nullptr.
+   */
+  static GLStateCache *GetCurrent();
+
+  /**
+   * Sets the cache current on the calling thread.
+   *
+   * @return The previous one.
+   */
+  static GLStateCache *SetCurrent(GLStateCache *cache);
+
+  /**
+   * Must be called after deleting OpenGL objects. Their names may be
+   * reused by any context of the share group, so all caches forget
+   * their state.
+   */
+  static void NotifyDeleted();
+
+  /**
+   * @return A count that changes with every NotifyDeleted. State
+   * kept outside the caches, like VAOs' attributes, is stale if it
+   * changes.
+   */
+  static int64_t GetDeletionEpoch();
+
+  static void UseProgram(GLuint program);
+
+  static void BindBuffer(GLenum target, GLuint buffer);
+
+  /**
+   * Binds a buffer into an indexed binding point, like uniform
+   * blocks'. It's also bound to the target, as glBindBufferBase does.
+   */
+  static void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+
+  static void BindVertexArray(GLuint vao);
+
+  static void BindFramebuffer(GLuint fbo);
+
+  static void ActiveTexture(int unit);
+
+  /**
+   * Binds a texture into the active texture unit.
+   */
+  static void BindTexture(GLenum target, GLuint texture);
+
+  /**
+   * Fixed-function enable of a texture target on the active unit.
+   */
+  static void EnableTexture(GLenum target);
+
+  /**
+   * Activates only the style properties that differ from the current
+   * ones.
+   */
+  static void ApplyStyle(const Style &style);
+
+  GLStateCache();
+
+  /**
+   * Forgets all state.
+   */
+  void Invalidate();
+
+ private:
+  /**
+   * Invalidates if objects were deleted since the last call.
+   */
+  void Sync();
+
+  GLuint program_, vao_, framebuffer_;
+  std::map<GLenum, GLuint> buffers_;
+  std::map<std::pair<GLenum, GLuint>, GLuint> indexed_buffers_;
+  std::map<GLuint, GLuint> vao_elements_; /**< Element buffer by VAO. */
+  int active_unit_;
+  std::map<std::pair<int, GLenum>, GLuint> textures_;
+  std::set<std::pair<int, GLenum>> enabled_textures_;
+  bool has_style_;
+  Style style_;
+  int64_t deletion_epoch_;
+};
+
+/**
+ * RAII for setting the state cache of the calling thread.
+ */
+class ScopedGLStateCache {
+ public:
+  ScopedGLStateCache(GLStateCache *cache)
+      : previous_(GLStateCache::SetCurrent(cache)) {}
+
+  ~ScopedGLStateCache() { GLStateCache::SetCurrent(previous_); }
+
+ private:
+  GLStateCache *previous_;
+};
+
+}  // namespace tenviz
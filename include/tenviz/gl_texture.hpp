@@ -5,7 +5,6 @@
 
 #include "gl_common.hpp"
 
-#include <cuda_gl_interop.h>
 #include <torch/torch.h>
 
 #include "context_resource.hpp"
@@ -14,6 +13,7 @@
 #include "dtype.hpp"
 #include "error.hpp"
 #include "gl_error.hpp"
+#include "gl_readback.hpp"
 
 namespace tenviz {
 
@@ -61,7 +61,8 @@ enum TexTarget {
   k1D = GL_TEXTURE_1D,
   k2D = GL_TEXTURE_2D,
   k3D = GL_TEXTURE_3D,
-  kRectangle = GL_TEXTURE_RECTANGLE
+  kRectangle = GL_TEXTURE_RECTANGLE,
+  k2DArray = GL_TEXTURE_2D_ARRAY
 };
 
 class GLTexture : public IContextResource {
@@ -101,6 +102,15 @@ class GLTexture : public IContextResource {
 
   torch::Tensor ToTensor(bool keep_device = true, bool non_blocking = false);
 
+  /**
+   * Queues the read of the texture into a pixel pack buffer and
+   * returns without waiting the GPU. Useful for rendering the next
+   * frame while the current one is transferred.
+   *
+   * @return Handle that resolves into a CPU tensor.
+   */
+  std::shared_ptr<GLReadback> ToTensorAsync();
+
   void Empty(const std::vector<long> &dim_sizes, DType btype);
 
   void TexImage(GLenum internal_format, int width, int height, GLenum format,
@@ -124,16 +134,23 @@ class GLTexture : public IContextResource {
   DType get_type() const { return cast_type<DType>(type_); }
 
  private:
+#ifdef TENVIZ_WITH_CUDA
   torch::Tensor ToTensorCUDA(bool keep_on_device, bool non_blocking);
+#endif
+
+  void UnregisterCuda();
 
   torch::Tensor ToTensorGL();
 
+  std::vector<int64_t> GetTensorSizes() const;
+
   GLuint tex_;
   cudaGraphicsResource_t cuda_resource_;
-  GLenum target_, format_, type_;
+  GLenum target_, internal_format_, format_, type_;
   GLTextureParameters parms_;
   Dim3 dim_;
 
   torch::Tensor tex_tensor_;
+  std::unique_ptr<GLReadbackRing> readback_ring_;
 };
 }  // namespace tenviz
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "context_resource.hpp"
+#include "eigen_common.hpp"
+#include "gl_common.hpp"
+
+namespace tenviz {
+
+/**
+ * Binding points of the uniform blocks shared by all programs.
+ * Programs declaring them get these bindings when linked.
+ */
+enum UniformBlockBinding { kCameraBlockBinding = 0, kObjectBlockBinding = 1 };
+
+/**
+ * Binding points of the shader storage blocks shared by all programs.
+ */
+enum StorageBlockBinding { kObjectBufferBinding = 0 };
+
+/**
+ * std140 layout of the per-frame block:
+ *
+ * layout(std140) uniform CameraBlock {
+ *   mat4 Projection;
+ *   mat4 View;
+ *   mat4 ProjectionView;
+ *   mat4 NormalView;
+ * };
+ *
+ * NormalView is the view's inverse-transpose, its mat3 transforms
+ * normals.
+ */
+struct CameraBlock {
+  static const char *const kName;
+
+  CameraBlock(const Eigen::Matrix4f &projection, const Eigen::Matrix4f &view);
+
+  float projection[16];
+  float view[16];
+  float projection_view[16];
+  float normal_view[16];
+};
+
+/**
+ * std140 layout of the per-node block:
+ *
+ * layout(std140) uniform ObjectBlock {
+ *   mat4 Object;
+ *   mat4 NormalObject;
+ * };
+ *
+ * Object maps the node into the CameraBlock's View space, and
+ * NormalObject is its inverse-transpose.
+ *
+ * It's also the std430 element of the storage block read by programs
+ * drawn in batches, indexed by the draw:
+ *
+ * struct ObjectData {
+ *   mat4 Object;
+ *   mat4 NormalObject;
+ * };
+ *
+ * layout(std430) readonly buffer ObjectBuffer {
+ *   ObjectData Objects[];
+ * };
+ *
+ * gl_Position = ProjectionView * (Objects[gl_DrawIDARB].Object * position);
+ */
+struct ObjectBlock {
+  static const char *const kName;
+  static const char *const kBufferName;
+
+  ObjectBlock(const Eigen::Matrix4f &object);
+
+  float object[16];
+  float normal_object[16];
+};
+
+/**
+ * Buffer holding a block's values. The buffer is created on the
+ * first update, and later updates only upload values that differ
+ * from the last ones. Besides uniform blocks, it holds storage blocks
+ * and indirect draw commands. Blocks owned by objects that may outlive
+ * the current context should be registered into it, see
+ * IContextResource::RegisterResourceOnCurrent.
+ */
+class GLUniformBlock : public IContextResource {
+ public:
+  GLUniformBlock() : ubo_(0) {}
+
+  GLUniformBlock(const GLUniformBlock &copy) = delete;
+
+  GLUniformBlock &operator=(const GLUniformBlock &copy) = delete;
+
+  ~GLUniformBlock() { Release(); }
+
+  /**
+   * Uploads the block's values, if changed.
+   *
+   * @param data The values, laid out as std140.
+   * @param size Data's size in bytes.
+   */
+  void Update(const void *data, size_t size);
+
+  /**
+   * Binds the buffer into a block binding point.
+   *
+   * @param binding The binding point.
+   * @param target GL_UNIFORM_BUFFER or GL_SHADER_STORAGE_BUFFER.
+   */
+  void Bind(GLuint binding, GLenum target = GL_UNIFORM_BUFFER) const;
+
+  /**
+   * Deletes the buffer. Must be called with a context of the creator's
+   * share group current.
+   */
+  void Release() override;
+
+  bool is_empty() const { return ubo_ == 0; }
+
+  GLuint get_buffer() const { return ubo_; }
+
+ private:
+  GLuint ubo_;
+  std::vector<uint8_t> data_;
+  std::mutex mutex_;
+};
+
+/**
+ * The camera of the frame drawn by the calling thread.
+ */
+struct FrameCamera {
+  /**
+   * @return The calling thread's camera, or nullptr if no frame is
+   * being drawn.
+   */
+  static const FrameCamera *GetCurrent();
+
+  Eigen::Matrix4f view, inverse_view;
+};
+
+/**
+ * RAII for drawing a frame: uploads and binds the CameraBlock, and
+ * sets the calling thread's FrameCamera.
+ */
+class ScopedFrameCamera {
+ public:
+  ScopedFrameCamera(GLUniformBlock &camera_block,
+                    const Eigen::Matrix4f &projection,
+                    const Eigen::Matrix4f &view);
+
+  ~ScopedFrameCamera();
+
+  ScopedFrameCamera(const ScopedFrameCamera &copy) = delete;
+
+  ScopedFrameCamera &operator=(const ScopedFrameCamera &copy) = delete;
+
+ private:
+  FrameCamera camera_;
+  const FrameCamera *previous_;
+};
+
+}  // namespace tenviz
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <torch/torch.h>
+
+#include "gl_common.hpp"
+
+namespace tenviz {
+
+class GLBuffer;
+
+/**
+ * Attribute's layout inside an interleaved vertex.
+ */
+struct VertexAttrib {
+  std::string name;
+  size_t offset; /**< Byte offset from the vertex start. */
+  int channels;
+  GLenum gl_type;
+  bool integer;   /**< Whatever it's kept as integers in shaders. */
+  bool normalize; /**< Whatever it's normalized into [0, 1] or [-1, 1]. */
+
+  bool operator==(const VertexAttrib &other) const {
+    return name == other.name && offset == other.offset &&
+           channels == other.channels && gl_type == other.gl_type &&
+           integer == other.integer && normalize == other.normalize;
+  }
+};
+
+/**
+ * Vertex attributes packed into a single buffer, one vertex after the
+ * other, so a vertex is fetched from a single memory region.
+ *
+ * Instances must be created with a context current.
+ */
+class InterleavedVertices {
+ public:
+  InterleavedVertices();
+
+  /**
+   * Packs the attributes into the buffer. Each attribute starts at a
+   * 4 bytes aligned offset. 8 and 16 bits integers are normalized in
+   * shaders, while 32 bits ones are kept as integers.
+   *
+   * @param attributes Tensors of shape [N] or [N, channels] by their
+   * shader's attribute name, all of them with the same N.
+   */
+  void FromTensors(const std::map<std::string, torch::Tensor> &attributes);
+
+  /**
+   * @return The attributes' layouts, sorted by name.
+   */
+  const std::vector<VertexAttrib> &get_attribs() const { return attribs_; }
+
+  /**
+   * @return The vertex size in bytes.
+   */
+  size_t get_stride() const { return stride_; }
+
+  /**
+   * @return The number of vertices.
+   */
+  int64_t get_vertex_count() const { return vertex_count_; }
+
+  std::shared_ptr<GLBuffer> get_buffer() const { return buffer_; }
+
+  /**
+   * @return A counter incremented when the attributes' layouts change.
+   */
+  uint64_t get_generation() const { return generation_; }
+
+ private:
+  std::shared_ptr<GLBuffer> buffer_;
+  std::vector<VertexAttrib> attribs_;
+  size_t stride_;
+  int64_t vertex_count_;
+  uint64_t generation_;
+};
+
+}  // namespace tenviz
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace tenviz {
+
+/**
+ * Global counter of modifications that may change how scenes look:
+ * buffer and texture uploads, program items, node transforms,
+ * styles and scene membership. Viewers compare it against the value
+ * of their last frame to decide whatever they must redraw.
+ */
+class ModificationStamp {
+ public:
+  /**
+   * Marks that something has changed.
+   */
+  static void Touch() { stamp_.fetch_add(1, std::memory_order_relaxed); }
+
+  /**
+   * @return The current stamp value.
+   */
+  static int64_t Get() { return stamp_.load(std::memory_order_relaxed); }
+
+ private:
+  static std::atomic<int64_t> stamp_;
+};
+
+/**
+ * Binds a data member as a Python property that touches the
+ * ModificationStamp when assigned. Like def_readwrite, the getter
+ * references the member, so in place changes through it aren't
+ * tracked.
+ */
+template <typename PyClass, typename Class, typename Type>
+void DefTouchingProperty(PyClass &py_class, const char *name,
+                         Type Class::*member) {
+  py_class.def_property(
+      name, [member](Class &self) -> Type & { return self.*member; },
+      [member](Class &self, const Type &value) {
+        self.*member = value;
+        ModificationStamp::Touch();
+      });
+}
+
+}  // namespace tenviz
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <torch/csrc/utils/pybind.h>
+#include <torch/torch.h>
+
+#include "context.hpp"
+#include "eigen_common.hpp"
+#include "gl_framebuffer.hpp"
+
+namespace tenviz {
+
+class Scene;
+
+/**
+ * Rendered images of a job. Maps the framebuffer attachments to their
+ * image tensors. The depth buffer is on the key RenderPool::kDepth.
+ */
+typedef std::map<int, torch::Tensor> RenderResult;
+
+/**
+ * Handle to the result of a job submitted to a RenderPool.
+ */
+class RenderFuture {
+ public:
+  RenderFuture(std::shared_future<RenderResult> future) : future_(future) {}
+
+  /**
+   * Waits the job to finish. Rethrows its exception if it failed.
+   *
+   * @return The rendered images.
+   */
+  RenderResult Get() const { return future_.get(); }
+
+  /**
+   * @return Whatever the job has finished.
+   */
+  bool IsReady() const;
+
+ private:
+  std::shared_future<RenderResult> future_;
+};
+
+/**
+ * Renders on worker threads, each one owning an OpenGL context that
+ * shares objects with a main context. Scenes loaded into the main
+ * context can be rendered by any worker, so independent views are
+ * drawn concurrently and the caller doesn't block until it asks for
+ * the results.
+ *
+ * Buffers and textures must not be modified while jobs that use them
+ * are pending.
+ */
+class RenderPool {
+ public:
+  static constexpr int kDepth = -1;
+
+  static void RegisterPybind(pybind11::module &m);
+
+  /**
+   * Creates the worker contexts and starts their threads.
+   *
+   * @param share Main context. It must outlive the pool.
+   * @param num_workers Number of worker threads.
+   * @param attachments Framebuffer attachments of each worker, as in
+   * GLFramebuffer::SetAttachment.
+   * @param keep_on_device Whatever the results stay on the GPU memory.
+   */
+  RenderPool(Context &share, int num_workers,
+             const std::map<int, FramebufferTarget> &attachments,
+             bool keep_on_device = false);
+
+  RenderPool(const RenderPool &copy) = delete;
+
+  RenderPool &operator=(const RenderPool &copy) = delete;
+
+  ~RenderPool() { Release(); }
+
+  /**
+   * Queues the rendering of a scene. The parameters are the same of
+   * Context::Render.
+   */
+  RenderFuture Submit(const Eigen::Matrix4f &projection,
+                      const Eigen::Matrix4f &view, std::shared_ptr<Scene> scene,
+                      int width = -1, int height = -1);
+
+  /**
+   * Queues one job per view.
+   *
+   * @param projections [Kx4x4] projection matrices.
+   * @param views [Kx4x4] view matrices.
+   */
+  std::vector<RenderFuture> SubmitBatch(const torch::Tensor &projections,
+                                        const torch::Tensor &views,
+                                        std::shared_ptr<Scene> scene,
+                                        int width = -1, int height = -1);
+
+  /**
+   * Finishes the pending jobs, stops the threads and destroys the
+   * worker contexts.
+   */
+  void Release();
+
+  int get_num_workers() const { return static_cast<int>(workers_.size()); }
+
+ private:
+  struct Job {
+    Eigen::Matrix4f projection, view;
+    std::shared_ptr<Scene> scene;
+    int width, height;
+    std::promise<RenderResult> promise;
+  };
+
+  void WorkerLoop(Context *context);
+
+  std::vector<std::unique_ptr<Context>> contexts_;
+  std::vector<std::thread> workers_;
+  std::map<int, FramebufferTarget> attachments_;
+  bool keep_on_device_;
+
+  std::deque<Job> jobs_;
+  std::mutex jobs_mutex_;
+  std::condition_variable jobs_cond_;
+  bool stopping_;
+};
+
+}  // namespace tenviz
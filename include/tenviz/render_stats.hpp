@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <torch/csrc/utils/pybind.h>
+
+#include "gl_common.hpp"
+
+namespace tenviz {
+
+class ANode;
+
+/**
+ * Rendering counters.
+ */
+struct RenderCounters {
+  RenderCounters() { Reset(); }
+
+  void Reset() {
+    draw_calls = vertices = state_changes = 0;
+    bytes_uploaded = bytes_read_back = 0;
+  }
+
+  int64_t draw_calls;      /**<Number of glDraw* calls.*/
+  int64_t vertices;        /**<Vertices (or indices) sent to draws.*/
+  int64_t state_changes;   /**<Bindings and style changes that
+                            * reached OpenGL.*/
+  int64_t bytes_uploaded;  /**<Bytes copied into buffers and textures.*/
+  int64_t bytes_read_back; /**<Bytes copied from buffers and textures.*/
+};
+
+/**
+ * Per-context frame instrumentation. While enabled, it counts the
+ * operations issued by the context, and times the drawing of each
+ * scene node with GL_TIME_ELAPSED queries.
+ *
+ * Queries are kept in a ring of frames: the results of a frame are
+ * collected at the end of the first later frame after the GPU
+ * finished them, and frames aren't timed while the ring is full, so
+ * measuring never stalls the pipeline. Elapsed time
+ * queries can't nest, so nodes inside sub-scenes are accounted into
+ * their top-most scene. Nodes drawn by a single batched call split its
+ * time evenly.
+ */
+class RenderStats {
+ public:
+  typedef std::vector<std::pair<std::weak_ptr<ANode>, double>> NodeTimes;
+
+  /**
+   * @return The statistics collected on the calling thread, or
+   * nullptr if they are disabled.
+   */
+  static RenderStats *GetCurrent();
+
+  /**
+   * Sets the statistics collected on the calling thread.
+   *
+   * @return The previous one.
+   */
+  static RenderStats *SetCurrent(RenderStats *stats);
+
+  static void CountDrawCall(int64_t vertices) {
+    if (RenderStats *stats = GetCurrent()) {
+      stats->counters_.draw_calls += 1;
+      stats->counters_.vertices += vertices;
+    }
+  }
+
+  static void CountStateChange() {
+    if (RenderStats *stats = GetCurrent()) {
+      stats->counters_.state_changes += 1;
+    }
+  }
+
+  static void CountUpload(int64_t bytes) {
+    if (RenderStats *stats = GetCurrent()) {
+      stats->counters_.bytes_uploaded += bytes;
+    }
+  }
+
+  static void CountReadback(int64_t bytes) {
+    if (RenderStats *stats = GetCurrent()) {
+      stats->counters_.bytes_read_back += bytes;
+    }
+  }
+
+  RenderStats();
+
+  RenderStats(const RenderStats &copy) = delete;
+
+  RenderStats &operator=(const RenderStats &copy) = delete;
+
+  void BeginFrame();
+
+  /**
+   * Closes the counters of the current frame and collects the
+   * timings of the previous frames that the GPU finished.
+   */
+  void EndFrame();
+
+  void BeginNode(std::shared_ptr<ANode> node);
+
+  /**
+   * Times nodes drawn together, see DrawBatcher. Their time is split
+   * evenly among them.
+   */
+  void BeginNodes(const std::vector<std::shared_ptr<ANode>> &nodes);
+
+  void EndNode();
+
+  /**
+   * Deletes the query objects. Must be called with the owner context
+   * current.
+   */
+  void Release();
+
+  /**
+   * @return The counters of the last finished frame.
+   */
+  const RenderCounters &get_frame_counters() const { return frame_counters_; }
+
+  /**
+   * @return GPU time, in milliseconds, of each node of the last timed
+   * frame.
+   */
+  const NodeTimes &get_node_times() const { return node_times_; }
+
+  /**
+   * @return Sum of the node times.
+   */
+  double get_gpu_time() const { return gpu_time_; }
+
+  int64_t get_frame_count() const { return frame_count_; }
+
+  /**
+   * @return The last frame statistics as a dictionary.
+   */
+  pybind11::dict ToDict() const;
+
+ private:
+  static const int kQueryRingSize = 4;
+
+  struct QueryBuffer {
+    QueryBuffer() : used(0), pending(false) {}
+
+    std::vector<GLuint> queries;
+    std::vector<std::vector<std::weak_ptr<ANode>>> nodes; /**<By query.*/
+    size_t used;
+    bool pending; /**<Whatever its results weren't collected yet.*/
+  };
+
+  /**
+   * Reads the buffer's results, if the GPU finished them.
+   *
+   * @return false if they aren't available yet.
+   */
+  bool CollectQueries(QueryBuffer &buffer);
+
+  RenderCounters counters_, frame_counters_;
+  QueryBuffer query_buffers_[kQueryRingSize];
+  int current_buffer_, node_depth_;
+  bool in_frame_;
+  bool recording_; /**<Whatever the current frame is timed.*/
+  int64_t frame_count_;
+
+  NodeTimes node_times_;
+  double gpu_time_;
+};
+
+/**
+ * RAII for setting the statistics collected on the calling thread.
+ */
+class ScopedRenderStats {
+ public:
+  ScopedRenderStats(RenderStats *stats)
+      : previous_(RenderStats::SetCurrent(stats)) {}
+
+  ~ScopedRenderStats() { RenderStats::SetCurrent(previous_); }
+
+ private:
+  RenderStats *previous_;
+};
+
+/**
+ * RAII for timing nodes with the statistics of the calling thread, so
+ * the query ends even if drawing throws. Does nothing while they're
+ * disabled.
+ */
+class ScopedNodeTimer {
+ public:
+  ScopedNodeTimer(std::shared_ptr<ANode> node)
+      : stats_(RenderStats::GetCurrent()) {
+    if (stats_ != nullptr) stats_->BeginNode(node);
+  }
+
+  /**
+   * Times nodes drawn together, see RenderStats::BeginNodes.
+   */
+  template <typename Node>
+  ScopedNodeTimer(const std::vector<std::shared_ptr<Node>> &nodes)
+      : stats_(RenderStats::GetCurrent()) {
+    if (stats_ != nullptr) {
+      stats_->BeginNodes(
+          std::vector<std::shared_ptr<ANode>>(nodes.begin(), nodes.end()));
+    }
+  }
+
+  ~ScopedNodeTimer() {
+    if (stats_ != nullptr) stats_->EndNode();
+  }
+
+  ScopedNodeTimer(const ScopedNodeTimer &copy) = delete;
+
+  ScopedNodeTimer &operator=(const ScopedNodeTimer &copy) = delete;
+
+ private:
+  RenderStats *stats_;
+};
+
+}  // namespace tenviz
@@ -6,6 +6,7 @@
 #include "eigen_common.hpp"
 
 #include "anode.hpp"
+#include "draw_batcher.hpp"
 
 namespace tenviz {
 
@@ -34,7 +35,9 @@ class Scene : public ANode {
   void Clear();
 
   /**
-   * Send the rendering commands.
+   * Send the rendering commands. Nodes that only differ by their
+   * transforms are drawn in batches, see DrawBatcher. Alpha blended
+   * nodes are drawn last, over the opaque ones.
    *
    * @param projection Projection matrix.
    * @param camera Camera view matrix.
@@ -51,5 +54,6 @@ class Scene : public ANode {
 
  private:
   std::set<std::shared_ptr<ANode>> nodes_;
+  DrawBatcher::Cache batch_cache_;
 };
 }  // namespace tenviz
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <torch/csrc/utils/pybind.h>
+#include <torch/torch.h>
+
+#include "dtype.hpp"
+
+namespace tenviz {
+
+/**
+ * Shared memory channel for publishing buffer frames from another
+ * process. The producer writes rows into a ring of slots and
+ * publishes them as frames, while readers take the latest frame only,
+ * uploading the rows changed since their last one, see
+ * GLBuffer::BindChannel.
+ *
+ * Slots are guarded by sequence counters (seqlocks), so neither side
+ * blocks: readers detect slots rewritten while reading and retry on
+ * their next poll.
+ */
+class SharedBufferChannel {
+ public:
+  static const int kSlotCount = 3;
+
+  /**
+   * Frames whose changed rows are remembered. Readers that fall more
+   * frames behind upload the whole frame.
+   */
+  static const int kHistorySize = 16;
+
+  /**
+   * Latest frame taken by BeginRead.
+   */
+  struct View {
+    const void *data;  /**< Start of the slot's first row. */
+    int64_t begin_row, end_row;  /**< Rows changed since the reader's frame. */
+    uint64_t frame;
+    uint64_t sequence;
+    int slot;
+  };
+
+  static void RegisterPybind(pybind11::module &m);
+
+  /**
+   * Creates the shared memory object, replacing any other with the
+   * same name. It's unlinked when the instance is destroyed.
+   *
+   * @param name The shared memory name, like "/points".
+   * @param rows The number of rows.
+   * @param cols The number of columns, up to 4.
+   * @param dtype The type of values.
+   */
+  static std::shared_ptr<SharedBufferChannel> Create(const std::string &name,
+                                                     int64_t rows,
+                                                     int64_t cols,
+                                                     DType dtype);
+
+  /**
+   * Opens a channel created by another process.
+   *
+   * @param name The shared memory name given to Create.
+   */
+  static std::shared_ptr<SharedBufferChannel> Open(const std::string &name);
+
+  SharedBufferChannel(const SharedBufferChannel &copy) = delete;
+
+  SharedBufferChannel &operator=(const SharedBufferChannel &copy) = delete;
+
+  ~SharedBufferChannel();
+
+  /**
+   * Writes rows into the next slot and publishes it as a new frame.
+   * Rows not written keep their values from the previous frame. Only
+   * one process should publish into a channel.
+   *
+   * @param tensor Values with the channel's type and columns.
+   * @param offset_row First row to write.
+   */
+  void Publish(const torch::Tensor &tensor, int64_t offset_row = 0);
+
+  /**
+   * Starts reading the latest frame, if newer than the given one.
+   *
+   * @param since_frame Last frame taken by the reader, 0 for none.
+   * @param view Set to the frame's data and changed rows.
+   *
+   * @return false if there's no newer frame or its slot is being
+   * written.
+   */
+  bool BeginRead(uint64_t since_frame, View *view) const;
+
+  /**
+   * @return Whatever the view's slot wasn't rewritten since
+   * BeginRead. Otherwise, its data must be read again.
+   */
+  bool EndRead(const View &view) const;
+
+  /**
+   * @return The latest published frame, 0 if none.
+   */
+  uint64_t get_frame() const;
+
+  const std::string &get_name() const { return name_; }
+
+  int64_t get_rows() const;
+
+  int64_t get_cols() const;
+
+  DType get_dtype() const;
+
+ private:
+  struct Header;
+
+  SharedBufferChannel(const std::string &name, bool owner);
+
+  void Map(size_t size);
+
+  /**
+   * Gets the rows changed after `since_frame` up to `until_frame`,
+   * or all of them if the history doesn't cover these frames.
+   */
+  void GetChangedRows(uint64_t since_frame, uint64_t until_frame,
+                      int64_t *begin_row, int64_t *end_row) const;
+
+  uint8_t *GetSlotData(int slot) const;
+
+  size_t get_row_size() const;
+
+  std::string name_;
+  bool owner_;
+  int fd_;
+  size_t mapped_size_;
+  Header *header_;
+};
+
+}  // namespace tenviz
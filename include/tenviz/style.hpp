@@ -28,16 +28,14 @@ class Style {
  public:
   /**
    * Scoped variable for activating style and reseting to the defaults
-   * after scope end.
+   * after scope end. The reset is skipped while a GLStateCache is
+   * current.
    */
   class Scoped {
    public:
     Scoped(const Style &style) { style.Activate(); }
 
-    ~Scoped() {
-      Style default_style;
-      default_style.Activate();
-    }
+    ~Scoped();
   };
 
   static void RegisterPybind(pybind11::module &m);
@@ -52,6 +50,10 @@ class Style {
    */
   void Activate() const;
 
+  bool operator==(const Style &other) const;
+
+  bool operator!=(const Style &other) const { return !(*this == other); }
+
   float line_width;         /**Line width for wireframe rendering.*/
   float point_size;         /**Point size for point rendering.*/
   PolygonMode polygon_mode; /**Polygon rendering mode.*/
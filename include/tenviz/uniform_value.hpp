@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <torch/torch.h>
+
+#include "eigen_common.hpp"
+#include "gl_common.hpp"
+
+namespace tenviz {
+
+/**
+ * Uniform value stored without tensors. It's converted once when
+ * set, so drawing uploads it without dispatching on tensor types,
+ * and it's compared with the last value uploaded, see
+ * GLShaderProgram::SetUniform.
+ */
+class UniformValue {
+ public:
+  enum Type { kNone, kFloat, kInt, kMatrix };
+
+  /**
+   * Converts a CPU tensor. Throws Error if it isn't a float32 or int32
+   * vector of up to 4 values, or a float32 square matrix of up to 4x4.
+   */
+  static UniformValue FromTensor(const torch::Tensor &tensor);
+
+  /**
+   * @param values Float vector.
+   * @param size Number of values, 1 to 4.
+   */
+  static UniformValue Vector(const float *values, int size);
+
+  /**
+   * @param values Column-major matrix.
+   * @param size Number of rows and columns, 2 to 4.
+   */
+  static UniformValue Matrix(const float *values, int size);
+
+  UniformValue() : type_(kNone), size_(0) {}
+
+  UniformValue(float value) : type_(kFloat), size_(1) { floats_[0] = value; }
+
+  UniformValue(int value) : type_(kInt), size_(1) { ints_[0] = value; }
+
+  UniformValue(const Eigen::Matrix3f &matrix)
+      : UniformValue(Matrix(matrix.data(), 3)) {}
+
+  UniformValue(const Eigen::Matrix4f &matrix)
+      : UniformValue(Matrix(matrix.data(), 4)) {}
+
+  /**
+   * Calls the glUniform* of its type.
+   */
+  void Upload(GLint location) const;
+
+  bool operator==(const UniformValue &other) const;
+
+  bool operator!=(const UniformValue &other) const {
+    return !(*this == other);
+  }
+
+  Type get_type() const { return type_; }
+
+  /**
+   * @return The type of tensors holding this value: torch::kFloat or
+   * torch::kInt32.
+   */
+  torch::ScalarType get_scalar_type() const {
+    return (type_ == kInt) ? torch::kInt32 : torch::kFloat;
+  }
+
+  /**
+   * @return The shape of tensors holding this value, like
+   * GLShaderProgram::GetUniformShape's.
+   */
+  std::vector<int64_t> get_shape() const;
+
+ private:
+  int get_count() const { return (type_ == kMatrix) ? size_ * size_ : size_; }
+
+  Type type_;
+  int size_; /**< Vector components, or the matrix rows and columns.*/
+  float floats_[16];
+  int32_t ints_[4];
+};
+
+}  // namespace tenviz
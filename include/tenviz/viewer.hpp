@@ -8,6 +8,8 @@
 
 #include "camera_manipulator.hpp"
 #include "context.hpp"
+#include "gl_state_cache.hpp"
+#include "gl_uniform_block.hpp"
 #include "projection.hpp"
 #include "time_measurer.hpp"
 
@@ -45,10 +47,29 @@ class Viewer {
 
   void ResetView();
 
+  /**
+   * Shows the scene until a key is pressed or swap_interval elapses.
+   * When event_driven is set, the viewer sleeps on window events and
+   * only redraws after input, camera movement or modifications (see
+   * ModificationStamp).
+   *
+   * @return The pressed key, 0 if timed out, or -1 if closed.
+   */
   int WaitKey(int swap_interval);
 
+  /**
+   * Renders a frame and processes the pending events.
+   *
+   * @return false if the window was closed.
+   */
   bool Draw(int swap_interval = 2);
 
+  /**
+   * Forces the next WaitKey to redraw. Use it after modifications
+   * that aren't tracked, like in place changes of transforms.
+   */
+  void Invalidate();
+
   void SetTitle(const std::string &title);
 
   const std::string &get_title() const { return title_; }
@@ -64,11 +85,13 @@ class Viewer {
 
   void SetCameraManipulator(std::shared_ptr<ICameraManipulator> manip) {
     camera_manip_ = manip;
+    dirty_ = true;
   }
 
   void SetViewMatrix(const Eigen::Matrix4f &view) {
     camera_manip_->SetViewMatrix(view);
     first_view_ = false;
+    dirty_ = true;
   }
 
   Eigen::Matrix4f GetViewMatrix() const {
@@ -77,6 +100,9 @@ class Viewer {
 
   std::shared_ptr<Scene> get_scene() { return scene_; }
 
+  bool event_driven; /**<Whatever WaitKey sleeps while nothing
+                      * changes. Default is true.*/
+
   Context* get_context() { return orig_context_; }
 
   int get_width() const { return width_; }
@@ -87,6 +113,14 @@ class Viewer {
  private:
   void UpdateSize(int width, int height);
 
+  void RenderFrame(int swap_interval);
+
+  void UpdateCamera();
+
+  bool NeedsRedraw() const;
+
+  bool IsAnimating() const;
+
   SharedWindow window_;
   Context *orig_context_;
 
@@ -97,7 +131,12 @@ class Viewer {
   bool first_view_;
   int last_key_;
   double elapsed_;
+  bool dirty_;
+  int64_t drawn_stamp_;
   std::map<int, bool> pressed_key_map_;
+  GLStateCache state_cache_;
+  GLUniformBlock camera_block_; /**< Used by non-shared windows, which
+                                 * draw concurrently to the context.*/
   
   std::shared_ptr<ICameraManipulator> camera_manip_;
   std::pair<bool, Projection> user_projection_;
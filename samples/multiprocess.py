@@ -2,7 +2,6 @@
 
 from pathlib import Path
 import math
-from queue import Empty
 
 import torch
 import torch.multiprocessing as mp
@@ -27,13 +26,13 @@ class SurfelAnimation:
         self.time += 0.01
 
 
-def _animation_proc(verts, normals, queue):
-    print(torch.cuda.is_available())
+def _animation_proc(verts, normals, channel_name):
+    channel = tenviz.SharedBufferChannel.open(channel_name)
     anim = SurfelAnimation(verts, normals)
-    
+
     while True:
         anim()
-        queue.put(True)
+        channel.publish(anim.verts)
 
 
 def main():
@@ -76,27 +75,21 @@ def main():
     viewer.reset_view()
 
     if args.mode == 'multi':
-        queue = mp.Queue()
-        mesh.verts.share_memory_()
+        # The viewer uploads the latest published frame when drawing.
+        channel = tenviz.SharedBufferChannel.create(
+            "/tenviz_multiprocess", n_verts, 3, tenviz.DType.Float)
+        with context.current():
+            surfels.points.bind_channel(channel)
 
         proc = mp.Process(target=_animation_proc, args=(
-            mesh.verts, mesh.normals, queue))
+            mesh.verts.cpu(), mesh.normals.cpu(), channel.name))
         proc.start()
     else:
         anim = SurfelAnimation(mesh.verts, mesh.normals)
 
     while True:
-        if args.mode == 'multi':
-            update = False
-            try:
-                update = queue.get_nowait()
-            except Empty:
-                continue
-        else:
+        if args.mode == 'single':
             anim()
-            update = True
-
-        if update:
             context.make_current()
             surfels.points.from_tensor(mesh.verts)
             context.detach_current()
@@ -8,16 +8,21 @@
 #include <torch/python.h>
 #include <torch/torch.h>
 
+#include "cuda_memory.hpp"
 #include "gl_buffer.hpp"
+#include "gl_buffer_arena.hpp"
 #include "gl_common.hpp"
+#include "gl_error.hpp"
 #include "gl_framebuffer.hpp"
 #include "gl_shader_program.hpp"
 #include "gl_texture.hpp"
+#include "shared_buffer_channel.hpp"
 
 #include "camera.hpp"
 #include "draw_program.hpp"
 #include "pose.hpp"
 #include "projection.hpp"
+#include "render_pool.hpp"
 #include "scene.hpp"
 #include "se3.hpp"
 #include "so3.hpp"
@@ -33,13 +38,26 @@ PYBIND11_MODULE(_ctenviz, m) {
   using namespace tenviz;
 
   tenviz::Error::RegisterPybind(m);
+
+  py::enum_<GLErrorMode>(m, "GLErrorMode")
+      .value("Check", GLErrorMode::kCheck)
+      .value("DebugOutput", GLErrorMode::kDebugOutput)
+      .value("Disabled", GLErrorMode::kDisabled)
+      .export_values();
+  m.def("set_gl_error_mode", &SetGLErrorMode);
+  m.def("get_gl_error_mode", &GetGLErrorMode);
+  m.def("is_cuda_interop_available", &IsCudaInteropAvailable);
   tenviz::Context::RegisterPybind(m);
   tenviz::Viewer::RegisterPybind(m);
+  tenviz::RenderPool::RegisterPybind(m);
 
   auto ctx_resource = IContextResource::RegisterPybind(m);
   GLBuffer::RegisterPybind(m, ctx_resource);
+  GLBufferArena::RegisterPybind(m, ctx_resource);
   GLShaderProgram::RegisterPybind(m, ctx_resource);
   GLTexture::RegisterPybind(m, ctx_resource);
+  GLReadback::RegisterPybind(m);
+  SharedBufferChannel::RegisterPybind(m);
   GLFramebuffer::RegisterPybind(m, ctx_resource);
 
   auto node = ANode::RegisterPybind(m);
@@ -2,15 +2,17 @@
 
 #include <pybind11/eigen.h>
 
+#include "modification_stamp.hpp"
+
 namespace tenviz {
 
 pybind11::class_<ANode, std::shared_ptr<ANode>> ANode::RegisterPybind(
     pybind11::module &m) {
   pybind11::class_<ANode, std::shared_ptr<ANode>> node(m, "ANode");
-  node.def_readwrite("transform", &ANode::transform)
-      .def_readwrite("draw_sphere", &ANode::draw_bsphere)
-      .def_readwrite("draw_box", &ANode::draw_bbox)
-      .def_readwrite("visible", &ANode::visible);
+  DefTouchingProperty(node, "transform", &ANode::transform);
+  DefTouchingProperty(node, "draw_sphere", &ANode::draw_bsphere);
+  DefTouchingProperty(node, "draw_box", &ANode::draw_bbox);
+  DefTouchingProperty(node, "visible", &ANode::visible);
 
   return node;
 }
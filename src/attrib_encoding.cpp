@@ -0,0 +1,80 @@
+#include "attrib_encoding.hpp"
+
+#include "error.hpp"
+
+using namespace std;
+
+namespace tenviz {
+
+namespace {
+const float kInt16Max = 32767.0f;
+
+torch::Tensor QuantizeInt16(const torch::Tensor &normalized) {
+  return (normalized * kInt16Max)
+      .round()
+      .clamp(-kInt16Max, kInt16Max)
+      .to(torch::kInt16);
+}
+}  // namespace
+
+EncodedAttrib EncodedAttrib::Encode(const torch::Tensor &tensor,
+                                    AttribEncoding encoding) {
+  const torch::Tensor values =
+      (tensor.dim() == 1) ? tensor.view({-1, 1}) : tensor;
+  const int64_t channels = values.size(1);
+
+  EncodedAttrib result;
+  result.normalize = false;
+  result.octahedral = false;
+  result.scale = torch::ones({channels}, torch::kFloat);
+  result.offset = torch::zeros({channels}, torch::kFloat);
+
+  switch (encoding) {
+    case AttribEncoding::kRaw:
+      result.tensor = tensor;
+      break;
+    case AttribEncoding::kHalf:
+      result.tensor = tensor.to(torch::kHalf);
+      break;
+    case AttribEncoding::kNormalizedInt16: {
+      const torch::Tensor fvalues = values.to(torch::kFloat);
+      const torch::Tensor min = get<0>(fvalues.min(0));
+      const torch::Tensor max = get<0>(fvalues.max(0));
+      const torch::Tensor center = (max + min) * 0.5f;
+      torch::Tensor half_extent = (max - min) * 0.5f;
+      // Constant channels would divide by zero.
+      half_extent = torch::where(half_extent > 0, half_extent,
+                                 torch::ones_like(half_extent));
+
+      result.tensor = QuantizeInt16((fvalues - center) / half_extent)
+                          .view(tensor.sizes());
+      result.normalize = true;
+      result.scale = half_extent.cpu();
+      result.offset = center.cpu();
+    } break;
+    case AttribEncoding::kOctahedral: {
+      if (channels != 3) {
+        throw Error("Octahedral encoding needs 3 channels vectors");
+      }
+
+      const torch::Tensor fvalues = values.to(torch::kFloat);
+      // Projects on the octahedron |x| + |y| + |z| = 1.
+      const torch::Tensor octa =
+          fvalues / fvalues.abs().sum(1, true).clamp_min(1e-12);
+      const torch::Tensor xy = octa.narrow(1, 0, 2);
+      const torch::Tensor signs =
+          torch::where(xy >= 0, torch::ones_like(xy), -torch::ones_like(xy));
+      // Folds the lower half over the upper one.
+      const torch::Tensor folded = (1 - xy.flip(1).abs()) * signs;
+      const torch::Tensor lower = octa.narrow(1, 2, 1) < 0;
+
+      result.tensor = QuantizeInt16(torch::where(lower, folded, xy));
+      result.normalize = true;
+      result.octahedral = true;
+    } break;
+  }
+
+  return result;
+}
+
+}  // namespace tenviz
@@ -4,6 +4,7 @@
 
 #include "bsphere.hpp"
 #include "gl_buffer.hpp"
+#include "gl_state_cache.hpp"
 #include "math.hpp"
 
 using namespace std;
@@ -47,7 +48,6 @@ class UnitSphere {
     m_points.Bind(true);
     glVertexPointer(3, GL_FLOAT, 0, nullptr);
 
-    glLineWidth(2.0);
     glColor3f(0.0f, 1.0f, 0.0f);
     glDrawArrays(GL_LINE_STRIP, 0, TICKS);
 
@@ -74,6 +74,21 @@ void DrawSphere(const BSphere &sphere, const Eigen::Matrix4f &projection,
     g_unit_sphere.reset(new UnitSphere);
   }
 
+  // The fixed-function pipeline needs the default program, vertex
+  // array and no textures, which may still be bound from the last
+  // draw.
+  GLStateCache::UseProgram(0);
+  GLStateCache::BindVertexArray(0);
+  GLStateCache::ActiveTexture(0);
+  for (GLenum target : {GL_TEXTURE_1D, GL_TEXTURE_2D, GL_TEXTURE_3D,
+                        GL_TEXTURE_RECTANGLE}) {
+    GLStateCache::BindTexture(target, 0);
+  }
+
+  Style style;
+  style.line_width = 2.0f;
+  style.Activate();
+
   glMatrixMode(GL_PROJECTION);
   glLoadMatrixf(projection.data());
 
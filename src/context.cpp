@@ -45,11 +45,20 @@ void SafeGLFWTerminate() {
 }
 }  // namespace
 
-Context::Context(int width, int height, bool profile)
+Context::Context(int width, int height, bool profile, ContextBackend backend,
+                 Context *share)
     : width_(width), height_(height), clear_color(0.32, 0.34, 0.87, 1) {
+  if (share != nullptr && share->backend_ != backend) {
+    throw Error("Shared contexts must use the same backend");
+  }
+
   window_ = nullptr;
   viewer_count_ = 0;
   profile_ = profile;
+  backend_ = backend;
+  share_ = share;
+  stats_enabled_ = false;
+  debug_output_ = false;
 }
 
 void Context::RegisterPybind(pybind11::module &m) {
@@ -58,22 +67,62 @@ void Context::RegisterPybind(pybind11::module &m) {
       .value("TrackBall", CameraManipulator::kTrackBall)
       .export_values();
 
+  pybind11::enum_<ContextBackend>(m, "ContextBackend")
+      .value("GLFW", ContextBackend::kGLFW)
+      .value("EGL", ContextBackend::kEGL)
+      .export_values();
+
   pybind11::class_<Context>(m, "Context")
-      .def(py::init<int, int>())
+      .def(py::init<int, int, bool, ContextBackend>(), py::arg("width"),
+           py::arg("height"), py::arg("profile") = false,
+           py::arg("backend") = ContextBackend::kGLFW)
       .def("_make_current", &Context::MakeCurrent)
       .def("_detach_current", &Context::DetachCurrent)
       .def("is_current", &Context::IsCurrent)
       .def("render", &Context::Render)
+      .def("render_many", &Context::RenderMany)
       .def("viewer", &Context::CreateViewer, py::arg("scene") = nullptr,
            py::arg("manip") = CameraManipulator::kTrackBall)
       .def("collect_garbage", &Context::CollectGarbage)
+      .def_property_readonly("buffer_arena", &Context::GetBufferArena)
       .def("resize", &Context::Resize)
       .def_property("width", &Context::get_width, nullptr)
       .def_property("height", &Context::get_height, nullptr)
+      .def_property("backend", &Context::get_backend, nullptr)
+      .def_property("stats_enabled", &Context::is_stats_enabled,
+                    &Context::SetStatsEnabled)
+      .def("get_stats",
+           [](const Context &self) { return self.get_stats().ToDict(); })
       .def_readwrite("clear_color", &Context::clear_color);
 }
 
 void Context::Initialize() {
+  if (share_ != nullptr) {
+    share_->EnsureInitialized();
+  }
+
+  switch (backend_) {
+    case kGLFW:
+      InitializeGLFW();
+      break;
+    case kEGL:
+      InitializeEGL();
+      break;
+  }
+
+  // The initialization unbinds any context from this thread.
+  if (g_current != nullptr && g_current != this) {
+    g_current->BindPlatformContext();
+  }
+}
+
+void Context::EnsureInitialized() {
+  if (!is_initialized()) {
+    Initialize();
+  }
+}
+
+void Context::InitializeGLFW() {
   if (!SafeGLFWInit()) {
     throw Error("Failed to initialize OpenGL extensions");
   }
@@ -87,8 +136,11 @@ void Context::Initialize() {
 
   glfwWindowHint(GLFW_VISIBLE, 0);
   glfwWindowHint(GLFW_SAMPLES, 4);
+  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT,
+                 GetGLErrorMode() == GLErrorMode::kDebugOutput);
 
-  window_ = glfwCreateWindow(width_, height_, "Viewer", NULL, NULL);
+  GLFWwindow *share_window = share_ != nullptr ? share_->window_ : NULL;
+  window_ = glfwCreateWindow(width_, height_, "Viewer", NULL, share_window);
   if (!window_) {
     SafeGLFWTerminate();
     return;
@@ -102,15 +154,37 @@ void Context::Initialize() {
     return;
   }
 
+  InitializeGLState();
+  glfwMakeContextCurrent(nullptr);
+}
+
+void Context::InitializeEGL() {
+  egl_context_.Initialize(width_, height_, profile_,
+                          share_ != nullptr ? &share_->egl_context_ : nullptr);
+  egl_context_.MakeCurrent();
+
+  // glewInit() requires a GLX display, which headless contexts don't
+  // have. glewContextInit() only loads the entry points.
+  glewExperimental = GL_TRUE;
+  if (glewContextInit() != GLEW_OK) {
+    egl_context_.DetachCurrent();
+    egl_context_.Release();
+    throw Error("Failed to initialize OpenGL extensions");
+  }
+
+  InitializeGLState();
+  egl_context_.DetachCurrent();
+}
+
+void Context::InitializeGLState() {
   glPixelStorei(GL_PACK_ALIGNMENT, 1);  // For Texuture reads
   glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
   glHint(GL_POLYGON_SMOOTH_HINT, GL_NICEST);
   glHint(GL_FRAGMENT_SHADER_DERIVATIVE_HINT, GL_NICEST);
-  glfwMakeContextCurrent(nullptr);
 }
 
 void Context::Release() {
-  if (window_ == nullptr) {
+  if (!is_initialized()) {
     return;
   }
 
@@ -121,11 +195,21 @@ void Context::Release() {
       resource->Release();
     }
     resources_.clear();
+    buffer_arena_ = nullptr;
+    camera_block_.Release();
+    stats_.Release();
   }
 
-  glfwDestroyWindow(window_);
-  SafeGLFWTerminate();
-  window_ = nullptr;
+  switch (backend_) {
+    case kGLFW:
+      glfwDestroyWindow(window_);
+      SafeGLFWTerminate();
+      window_ = nullptr;
+      break;
+    case kEGL:
+      egl_context_.Release();
+      break;
+  }
 }
 
 void Context::CollectGarbage() {
@@ -141,10 +225,17 @@ void Context::CollectGarbage() {
   }
 }
 
-void Context::MakeCurrent() {
-  if (!window_) {
-    Initialize();
+shared_ptr<GLBufferArena> Context::GetBufferArena() {
+  if (buffer_arena_ == nullptr) {
+    // Creating doesn't call OpenGL, only its allocations.
+    buffer_arena_ = make_shared<GLBufferArena>();
+    resources_.insert(buffer_arena_);
   }
+  return buffer_arena_;
+}
+
+void Context::MakeCurrent() {
+  EnsureInitialized();
   if (g_current == this) {
     make_current_count += 1;
     return;
@@ -152,7 +243,17 @@ void Context::MakeCurrent() {
 
   context_lock_.lock();
   g_current = this;
-  glfwMakeContextCurrent(window_);
+  BindPlatformContext();
+  RenderStats::SetCurrent(stats_enabled_ ? &stats_ : nullptr);
+
+  const bool debug_output = GetGLErrorMode() == GLErrorMode::kDebugOutput;
+  if (debug_output != debug_output_) {
+    debug_output_ = SetGLDebugOutput(debug_output);
+  }
+
+  // Others may have changed the state since the last time.
+  state_cache_.Invalidate();
+  GLStateCache::SetCurrent(&state_cache_);
   make_current_count = 1;
 }
 
@@ -160,13 +261,46 @@ void Context::DetachCurrent() {
   --make_current_count;
   if (make_current_count > 0) return;
 
-  glfwMakeContextCurrent(nullptr);
+  UnbindPlatformContext();
+  RenderStats::SetCurrent(nullptr);
+  GLStateCache::SetCurrent(nullptr);
   g_current = nullptr;
   context_lock_.unlock();
 }
 
+void Context::BindPlatformContext() {
+  switch (backend_) {
+    case kGLFW:
+      glfwMakeContextCurrent(window_);
+      break;
+    case kEGL:
+      egl_context_.MakeCurrent();
+      break;
+  }
+}
+
+void Context::UnbindPlatformContext() {
+  switch (backend_) {
+    case kGLFW:
+      glfwMakeContextCurrent(nullptr);
+      break;
+    case kEGL:
+      egl_context_.DetachCurrent();
+      break;
+  }
+}
+
 bool Context::IsCurrent() const { return g_current == this; }
 
+void Context::SetStatsEnabled(bool enable) {
+  stats_enabled_ = enable;
+  if (IsCurrent()) {
+    RenderStats::SetCurrent(stats_enabled_ ? &stats_ : nullptr);
+  }
+}
+
+Context *Context::GetCurrent() { return g_current; }
+
 void Context::RegisterResourceOnCurrent(shared_ptr<IContextResource> resource) {
   assert(g_current != nullptr);
   g_current->resources_.insert(resource);
@@ -174,7 +308,9 @@ void Context::RegisterResourceOnCurrent(shared_ptr<IContextResource> resource) {
 
 void Context::Resize(int width, int height) {
   ScopedCurrent curr(*this);
-  glfwSetWindowSize(window_, width, height);
+  if (window_ != nullptr) {
+    glfwSetWindowSize(window_, width, height);
+  }
   width_ = width;
   height_ = height;
 }
@@ -196,15 +332,79 @@ void Context::Render(const Eigen::Matrix4f &projection,
   glViewport(0, 0, width, height);
   GLCheckError();
 
-  RenderFrameImpl(scene, projection, camera);
-  glfwSwapBuffers(window_);
+  RenderFrameImpl(scene, projection, camera, camera_block_);
+  if (backend_ == kGLFW) {
+    glfwSwapBuffers(window_);
+  }
+  glFlush();
+  framebuffer->Bind(false);
+}
+
+void Context::RenderMany(const torch::Tensor &projections,
+                         const torch::Tensor &cameras,
+                         shared_ptr<GLFramebuffer> framebuffer,
+                         shared_ptr<Scene> scene, int width, int height) {
+  if (projections.dim() != 3 || cameras.dim() != 3 ||
+      projections.size(0) != cameras.size(0) || projections.size(0) == 0) {
+    throw Error("Projections and views must be [Kx4x4] tensors");
+  }
+
+  const torch::Tensor cpu_projections = projections.cpu();
+  const torch::Tensor cpu_cameras = cameras.cpu();
+  const int num_views = projections.size(0);
+
+  ScopedCurrent curr(*this);
+
+  if (width < 1) {
+    width = width_;
+    height = height_;
+  }
+
+  framebuffer->SetSize(width, height, num_views);
+  framebuffer->Bind(true);
+
+  glViewport(0, 0, width, height);
+  GLCheckError();
+
+  glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+  GLCheckError();
+
+  glEnable(GL_DEPTH_TEST);
+  GLCheckError();
+
+  RenderStats *stats = RenderStats::GetCurrent();
+  if (stats != nullptr) stats->BeginFrame();
+
+  for (int i = 0; i < num_views; ++i) {
+    framebuffer->SetLayer(i);
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    GLCheckError();
+
+    const Eigen::Matrix4f projection =
+        from_tensorm4<float>(cpu_projections[i]);
+    const Eigen::Matrix4f camera = from_tensorm4<float>(cpu_cameras[i]);
+    ScopedFrameCamera frame_camera(camera_block_, projection, camera);
+    scene->Draw(projection, camera);
+  }
+
+  if (stats != nullptr) stats->EndFrame();
   glFlush();
   framebuffer->Bind(false);
 }
 
 void Context::RenderFrameImpl(shared_ptr<Scene> scene,
                               const Eigen::Matrix4f &projection,
-                              const Eigen::Matrix4f &camera) {
+                              const Eigen::Matrix4f &camera,
+                              GLUniformBlock &camera_block,
+                              bool own_gl_context) {
+  // Viewers draw without making the context current.
+  RenderStats *stats = nullptr;
+  if (stats_enabled_ && own_gl_context) {
+    stats = &stats_;
+  }
+  ScopedRenderStats scoped_stats(stats);
+
   float ratio;
   int width, height;
 
@@ -216,11 +416,20 @@ void Context::RenderFrameImpl(shared_ptr<Scene> scene,
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   GLCheckError();
 
+  if (stats != nullptr) stats->BeginFrame();
+  // Programs read the camera matrices from the block instead of
+  // uploading them for each node.
+  ScopedFrameCamera frame_camera(camera_block, projection, camera);
   scene->Draw(projection, camera);
+  if (stats != nullptr) stats->EndFrame();
 }
 
 shared_ptr<Viewer> Context::CreateViewer(shared_ptr<Scene> scene,
                                          CameraManipulator cam_manip) {
+  if (backend_ != kGLFW) {
+    throw Error("Viewers are only available on GLFW contexts");
+  }
+
   shared_ptr<ICameraManipulator> cam_manip_obj;
 
   switch (cam_manip) {
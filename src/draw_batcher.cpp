@@ -0,0 +1,404 @@
+#include "draw_batcher.hpp"
+
+#include <algorithm>
+
+#include "context.hpp"
+#include "draw_program.hpp"
+#include "dtype.hpp"
+#include "gl_buffer.hpp"
+#include "gl_error.hpp"
+#include "gl_shader_program.hpp"
+#include "gl_state_cache.hpp"
+#include "interleaved_vertices.hpp"
+#include "render_stats.hpp"
+#include "scoped_bind.hpp"
+
+using namespace std;
+
+namespace tenviz {
+
+namespace {
+/**
+ * @return Whatever both have the same items, in any order.
+ */
+template <typename Value>
+bool SameSlotItems(const vector<SlotItem<Value>> &lfs,
+                   const vector<SlotItem<Value>> &rhs) {
+  if (lfs.size() != rhs.size()) {
+    return false;
+  }
+
+  for (const SlotItem<Value> &item : lfs) {
+    auto found = find_if(rhs.begin(), rhs.end(),
+                         [&item](const SlotItem<Value> &other) {
+                           return other.slot == item.slot;
+                         });
+    if (found == rhs.end() || !(found->value == item.value)) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+void DrawBatcher::Cache::ContextBatches::Release() {
+  for (unique_ptr<BatchObjects> &objects : batches) {
+    if (objects->vao != 0) {
+      glDeleteVertexArrays(1, &objects->vao);
+      GLCheckError();
+    }
+    objects->objects.Release();
+    objects->commands.Release();
+  }
+  batches.clear();
+  GLStateCache::NotifyDeleted();
+  released = true;
+}
+
+DrawBatcher::Cache::BatchObjects &DrawBatcher::Cache::Get(
+    const vector<Attrib> &attribs, GLuint element_buffer,
+    const vector<const BatchObjects *> &used) {
+  lock_guard<mutex> lock(mutex_);
+  for (auto iter = contexts_.begin(); iter != contexts_.end();) {
+    // A new context may take a released one's address.
+    if (iter->second->released) {
+      iter = contexts_.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+
+  shared_ptr<ContextBatches> &context_batches =
+      contexts_[Context::GetCurrent()];
+  if (context_batches == nullptr) {
+    context_batches = make_shared<ContextBatches>();
+    IContextResource::RegisterResourceOnCurrent(context_batches);
+  }
+
+  BatchObjects *found = nullptr;
+  for (unique_ptr<BatchObjects> &objects : context_batches->batches) {
+    if (find(used.begin(), used.end(), objects.get()) != used.end()) {
+      continue;
+    }
+
+    if (objects->attribs == attribs &&
+        objects->element_buffer == element_buffer) {
+      found = objects.get();
+      break;
+    }
+
+    if (found == nullptr) {
+      found = objects.get();
+    }
+  }
+
+  if (found == nullptr) {
+    context_batches->batches.emplace_back(new BatchObjects);
+    found = context_batches->batches.back().get();
+  }
+
+  if (found->vao == 0) {
+    glGenVertexArrays(1, &found->vao);
+    GLCheckError();
+  }
+  return *found;
+}
+
+bool DrawBatcher::IsSupported() {
+  return GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_draw_parameters;
+}
+
+bool DrawBatcher::Add(shared_ptr<ANode> node) {
+  shared_ptr<DrawProgram> draw = dynamic_pointer_cast<DrawProgram>(node);
+  if (draw == nullptr || !draw->program_->UsesObjectBuffer() ||
+      !draw->attrib_divisors_.empty() ||
+      !draw->matrix_placeholders_.empty() || draw->has_draw_ranges_ ||
+      draw->style.alpha_blending || !IsSupported()) {
+    return false;
+  }
+
+  for (auto &group : groups_) {
+    if (SharesState(*group.front(), *draw)) {
+      group.push_back(draw);
+      return true;
+    }
+  }
+
+  groups_.push_back({draw});
+  return true;
+}
+
+bool DrawBatcher::SharesState(const DrawProgram &lfs,
+                              const DrawProgram &rhs) {
+  return lfs.program_ == rhs.program_ && lfs.draw_mode_ == rhs.draw_mode_ &&
+         lfs.style == rhs.style &&
+         SameSlotItems(lfs.uniforms_, rhs.uniforms_) &&
+         SameSlotItems(lfs.textures_, rhs.textures_);
+}
+
+void DrawBatcher::Flush(const Eigen::Matrix4f &projection,
+                        const Eigen::Matrix4f &view) {
+  vector<shared_ptr<DrawProgram>> alone_nodes;
+
+  for (const auto &group : groups_) {
+    if (group.size() == 1) {
+      alone_nodes.push_back(group.front());
+      continue;
+    }
+
+    ScopedBind<GLShaderProgram> program_bind(group.front()->program_);
+
+    // Nodes sharing the state are split by their vertices' buffers.
+    vector<Batch> batches;
+    for (const shared_ptr<DrawProgram> &node : group) {
+      vector<Attrib> attribs;
+      GLuint element_buffer;
+      GLenum index_type;
+      ElementsCommand command;
+      if (!GetNodeDraw(*node, &attribs, &element_buffer, &index_type,
+                       &command)) {
+        alone_nodes.push_back(node);
+        continue;
+      }
+
+      auto batch = find_if(
+          batches.begin(), batches.end(), [&](const Batch &candidate) {
+            return candidate.attribs == attribs &&
+                   candidate.element_buffer == element_buffer &&
+                   candidate.index_type == index_type;
+          });
+      if (batch == batches.end()) {
+        batches.emplace_back();
+        batch = batches.end() - 1;
+        batch->attribs = attribs;
+        batch->element_buffer = element_buffer;
+        batch->index_type = index_type;
+        batch->vertices = 0;
+      }
+
+      batch->nodes.push_back(node);
+      batch->objects.emplace_back(node->GetObjectMatrix(view));
+      if (index_type != GL_NONE) {
+        batch->elements_commands.push_back(command);
+      } else {
+        batch->arrays_commands.push_back(ArraysCommand{
+            command.count, 1, GLuint(command.base_vertex), 0});
+      }
+      batch->vertices += command.count;
+    }
+
+    for (const Batch &batch : batches) {
+      if (batch.nodes.size() == 1) {
+        alone_nodes.push_back(batch.nodes.front());
+        continue;
+      }
+
+      ScopedNodeTimer timer(batch.nodes);
+      DrawBatch(batch);
+    }
+  }
+
+  for (const shared_ptr<DrawProgram> &node : alone_nodes) {
+    ScopedNodeTimer timer(node);
+    node->Draw(projection, view);
+  }
+
+  groups_.clear();
+  used_objects_.clear();
+}
+
+bool DrawBatcher::GetNodeDraw(DrawProgram &node, vector<Attrib> *attribs,
+                              GLuint *element_buffer, GLenum *index_type,
+                              ElementsCommand *command) {
+  GLShaderProgram &program = *node.program_;
+  attribs->clear();
+  int64_t vertex_count = -1;
+
+  // Takes the latest frames of buffers bound to shared memory channels.
+  for (const auto &item : node.buffers_) {
+    item.value->PollChannel();
+  }
+  node.indices->PollChannel();
+
+  for (const auto &item : node.buffers_) {
+    const GLBuffer &buffer = *item.value;
+    const GLint attrib_loc = program.GetAttribLocation(item.slot);
+    if (attrib_loc < 0) {
+      continue;
+    }
+
+    if (buffer.is_stream() || buffer.is_empty() ||
+        (vertex_count > -1 && buffer.get_size(0) != vertex_count)) {
+      return false;
+    }
+    vertex_count = buffer.get_size(0);
+
+    Attrib attrib;
+    attrib.location = attrib_loc;
+    attrib.buffer = buffer.get_buffer_id();
+    attrib.offset = buffer.get_offset();
+    attrib.channels = (buffer.get_dim() > 1) ? buffer.get_size(1) : 1;
+    attrib.gl_type = buffer.get_gl_type();
+    attrib.stride = GetTypeSize(attrib.gl_type) * attrib.channels;
+    attrib.integer = buffer.integer_attrib;
+    attrib.normalize = buffer.normalize;
+    attribs->push_back(attrib);
+  }
+
+  const InterleavedVertices *vertices = node.vertices_.get();
+  if (vertices != nullptr && vertices->get_vertex_count() > 0) {
+    const GLBuffer &buffer = *vertices->get_buffer();
+    for (const VertexAttrib &vertex_attrib : vertices->get_attribs()) {
+      const GLint attrib_loc =
+          program.GetAttribLocation(program.GetAttribSlot(vertex_attrib.name));
+      if (attrib_loc < 0) {
+        continue;
+      }
+
+      if (vertex_count > -1 && vertices->get_vertex_count() != vertex_count) {
+        return false;
+      }
+      vertex_count = vertices->get_vertex_count();
+
+      Attrib attrib;
+      attrib.location = attrib_loc;
+      attrib.buffer = buffer.get_buffer_id();
+      attrib.offset = buffer.get_offset() + vertex_attrib.offset;
+      attrib.stride = vertices->get_stride();
+      attrib.channels = vertex_attrib.channels;
+      attrib.gl_type = vertex_attrib.gl_type;
+      attrib.integer = vertex_attrib.integer;
+      attrib.normalize = vertex_attrib.normalize;
+      attribs->push_back(attrib);
+    }
+  }
+
+  if (attribs->empty()) {
+    return false;
+  }
+
+  // Attributes are pointed at the base vertex's offset, so nodes whose
+  // data lies at different vertices of the same buffers share them.
+  size_t base_vertex = attribs->front().offset / attribs->front().stride;
+  for (const Attrib &attrib : *attribs) {
+    if (attrib.offset < base_vertex * attrib.stride) {
+      base_vertex = 0;
+      break;
+    }
+  }
+
+  for (Attrib &attrib : *attribs) {
+    attrib.offset -= base_vertex * attrib.stride;
+  }
+  sort(attribs->begin(), attribs->end(),
+       [](const Attrib &lfs, const Attrib &rhs) {
+         return lfs.location < rhs.location;
+       });
+
+  command->instance_count = 1;
+  command->base_vertex = GLint(base_vertex);
+  command->base_instance = 0;
+
+  const GLBuffer &indices = *node.indices;
+  if (indices.is_empty()) {
+    *element_buffer = 0;
+    *index_type = GL_NONE;
+    command->count = GLuint(vertex_count);
+    command->first_index = 0;
+    return true;
+  }
+
+  if (indices.is_stream()) {
+    return false;
+  }
+
+  *element_buffer = indices.get_buffer_id();
+  *index_type = node.GetIndexType();
+  const size_t index_size = GetTypeSize(*index_type);
+  if (indices.get_offset() % index_size != 0) {
+    return false;
+  }
+
+  command->count = GLuint(node.GetIndexCount());
+  command->first_index = GLuint(indices.get_offset() / index_size);
+  return true;
+}
+
+void DrawBatcher::DrawBatch(const Batch &batch) {
+  DrawProgram &first = *batch.nodes.front();
+  Cache::BatchObjects &objects =
+      cache_.Get(batch.attribs, batch.element_buffer, used_objects_);
+  used_objects_.push_back(&objects);
+
+  objects.objects.Update(batch.objects.data(),
+                         batch.objects.size() * sizeof(ObjectBlock));
+  objects.objects.Bind(kObjectBufferBinding, GL_SHADER_STORAGE_BUFFER);
+
+  // The VAO keeps its attributes until the batch's buffers change, or
+  // objects are deleted and their names may be reused.
+  GLStateCache::BindVertexArray(objects.vao);
+  const int64_t deletion_epoch = GLStateCache::GetDeletionEpoch();
+  if (objects.attribs != batch.attribs ||
+      objects.element_buffer != batch.element_buffer ||
+      objects.deletion_epoch != deletion_epoch) {
+    for (const Attrib &attrib : objects.attribs) {
+      glDisableVertexAttribArray(attrib.location);
+      GLCheckError();
+    }
+    objects.attribs.clear();
+    objects.deletion_epoch = -1;
+
+    for (const Attrib &attrib : batch.attribs) {
+      GLStateCache::BindBuffer(GL_ARRAY_BUFFER, attrib.buffer);
+      glEnableVertexAttribArray(attrib.location);
+      GLCheckError();
+      glVertexAttribDivisor(attrib.location, 0);
+      GLCheckError();
+      objects.attribs.push_back(attrib);
+
+      DrawProgram::SetAttribPointer(attrib.location, attrib.channels,
+                                    attrib.gl_type, attrib.integer,
+                                    attrib.normalize, attrib.stride,
+                                    attrib.offset);
+    }
+    GLStateCache::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.element_buffer);
+    objects.element_buffer = batch.element_buffer;
+    objects.deletion_epoch = deletion_epoch;
+  }
+
+  if (batch.index_type != GL_NONE) {
+    objects.commands.Update(
+        batch.elements_commands.data(),
+        batch.elements_commands.size() * sizeof(ElementsCommand));
+  } else {
+    objects.commands.Update(
+        batch.arrays_commands.data(),
+        batch.arrays_commands.size() * sizeof(ArraysCommand));
+  }
+  GLStateCache::BindBuffer(GL_DRAW_INDIRECT_BUFFER,
+                           objects.commands.get_buffer());
+
+  first.BindUniforms();
+
+  const GLenum draw_mode = static_cast<GLenum>(first.draw_mode_);
+  {
+    Style::Scoped style_scope(first.style);
+    const GLsizei draw_count = GLsizei(batch.nodes.size());
+    if (batch.index_type != GL_NONE) {
+      glMultiDrawElementsIndirect(draw_mode, batch.index_type, nullptr,
+                                  draw_count, 0);
+    } else {
+      glMultiDrawArraysIndirect(draw_mode, nullptr, draw_count, 0);
+    }
+    GLCheckError();
+    RenderStats::CountDrawCall(batch.vertices);
+  }
+
+  if (GLStateCache::GetCurrent() == nullptr) {
+    GLStateCache::BindVertexArray(0);
+    GLStateCache::BindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+  first.UnbindTextures();
+}
+
+}  // namespace tenviz
@@ -1,15 +1,72 @@
 #include "draw_program.hpp"
 
+#include <algorithm>
+
+#include <pybind11/stl.h>
+
+#include "context.hpp"
+#include "dtype.hpp"
 #include "gl_buffer.hpp"
 #include "gl_error.hpp"
 #include "gl_shader_program.hpp"
+#include "gl_state_cache.hpp"
 #include "gl_texture.hpp"
+#include "interleaved_vertices.hpp"
 #include "math.hpp"
+#include "modification_stamp.hpp"
+#include "render_stats.hpp"
 #include "scoped_bind.hpp"
 
 using namespace std;
 
 namespace tenviz {
+namespace {
+bool IsIntegerType(GLenum type) {
+  switch (type) {
+    case GL_INT:
+    case GL_INT_VEC2:
+    case GL_INT_VEC3:
+    case GL_INT_VEC4:
+    case GL_UNSIGNED_INT:
+    case GL_UNSIGNED_INT_VEC2:
+    case GL_UNSIGNED_INT_VEC3:
+    case GL_UNSIGNED_INT_VEC4:
+      return true;
+    default:
+      return false;
+  }
+}
+
+template <typename Value>
+Value *FindSlotItem(vector<SlotItem<Value>> &items, int slot) {
+  for (SlotItem<Value> &item : items) {
+    if (item.slot == slot) {
+      return &item.value;
+    }
+  }
+  return nullptr;
+}
+
+template <typename Value>
+void SetSlotItem(vector<SlotItem<Value>> &items, int slot, const string &name,
+                 const Value &value) {
+  if (Value *current = FindSlotItem(items, slot)) {
+    *current = value;
+  } else {
+    items.push_back(SlotItem<Value>{slot, name, value});
+  }
+}
+
+template <typename Value>
+void EraseSlotItem(vector<SlotItem<Value>> &items, int slot) {
+  items.erase(remove_if(items.begin(), items.end(),
+                        [slot](const SlotItem<Value> &item) {
+                          return item.slot == slot;
+                        }),
+              items.end());
+}
+}  // namespace
+
 void DrawProgram::RegisterPybind(
     py::module &m, pybind11::class_<ANode, std::shared_ptr<ANode>> &anode) {
   py::enum_<DrawMode>(m, "DrawMode")
@@ -28,7 +85,15 @@ void DrawProgram::RegisterPybind(
       .value("Object", MatPlaceholder::kObject)
       .export_values();
 
-  py::class_<DrawProgram, shared_ptr<DrawProgram>>(m, "DrawProgram", anode)
+  py::enum_<AttribEncoding>(m, "AttribEncoding")
+      .value("Raw", AttribEncoding::kRaw)
+      .value("Half", AttribEncoding::kHalf)
+      .value("NormalizedInt16", AttribEncoding::kNormalizedInt16)
+      .value("Octahedral", AttribEncoding::kOctahedral);
+
+  py::class_<DrawProgram, shared_ptr<DrawProgram>> draw_program(
+      m, "DrawProgram", anode);
+  draw_program
       .def(py::init<DrawMode, shared_ptr<GLShaderProgram>, bool>())
       .def("set_bounds", &DrawProgram::SetBounds)
       .def("__setitem__",
@@ -47,8 +112,24 @@ void DrawProgram::RegisterPybind(
       .def("__setitem__",
            py::overload_cast<const string &, float>(&DrawProgram::SetItem))
       .def("__getitem__", &DrawProgram::GetItem)
-      .def_readwrite("indices", &DrawProgram::indices)
-      .def_readwrite("style", &DrawProgram::style);
+      .def("set_vertices", &DrawProgram::SetVertices)
+      .def("set_attrib",
+           py::overload_cast<const string &, const torch::Tensor &,
+                             AttribEncoding>(&DrawProgram::SetAttrib),
+           py::arg("name"), py::arg("tensor"),
+           py::arg("encoding") = AttribEncoding::kRaw)
+      .def("set_instanced",
+           py::overload_cast<const string &, shared_ptr<GLBuffer>, int>(
+               &DrawProgram::SetInstanced),
+           py::arg("name"), py::arg("buffer"), py::arg("divisor") = 1)
+      .def("set_instanced",
+           py::overload_cast<const string &, const torch::Tensor &, int>(
+               &DrawProgram::SetInstanced),
+           py::arg("name"), py::arg("tensor"), py::arg("divisor") = 1)
+      .def("set_draw_ranges", &DrawProgram::SetDrawRanges)
+      .def("clear_draw_ranges", &DrawProgram::ClearDrawRanges);
+  DefTouchingProperty(draw_program, "indices", &DrawProgram::indices);
+  DefTouchingProperty(draw_program, "style", &DrawProgram::style);
 }
 
 DrawProgram::DrawProgram(DrawMode mode,
@@ -61,162 +142,436 @@ DrawProgram::DrawProgram(DrawMode mode,
 
   indices = GLBuffer::Create(BufferTarget::kElement, BufferUsage::kDynamic);
   max_draw_elems_ = -1;
+  has_draw_ranges_ = false;
   program->Bind(true);
   program->Bind(false);
 
-  glGenVertexArrays(1, &vao_);
+  glGenVertexArrays(1, &vertex_array_.vao);
   GLCheckError();
+  vao_owner_ = Context::GetCurrent();
+  layout_generation_ = 0;
+
+  object_block_ = make_shared<GLUniformBlock>();
+  IContextResource::RegisterResourceOnCurrent(object_block_);
+  has_object_matrix_ = false;
 }
 
-void DrawProgram::Draw(const Eigen::Matrix4f &projection,
-                       const Eigen::Matrix4f &view) {
-  Eigen::Matrix4f modelview = view * transform;
-  Eigen::Matrix4f proj_modelview = projection * modelview;
-  Eigen::Matrix3f normal_modelview = math::ComputeNormalModelview(modelview);
+void DrawProgram::SetAttribPointer(GLint attrib_loc, int channels,
+                                   GLenum gl_type, bool integer,
+                                   bool normalize, size_t stride,
+                                   size_t offset) {
+  const GLvoid *pointer = reinterpret_cast<const GLvoid *>(offset);
+  if (integer || gl_type == GL_INT || gl_type == GL_UNSIGNED_INT) {
+    glVertexAttribIPointer(attrib_loc, channels, gl_type, stride, pointer);
+  } else {
+    glVertexAttribPointer(attrib_loc, channels, gl_type,
+                          normalize ? GL_TRUE : GL_FALSE, stride, pointer);
+  }
+  GLCheckError();
+}
 
-  ScopedBind<GLShaderProgram> program_bind(program_);
-  for (const auto &key_pholder : matrix_placeholders_) {
-    const auto &key = key_pholder.first;
-    const auto &pholder = key_pholder.second;
-
-    switch (pholder) {
-      case MatPlaceholder::kModelview:
-        program_->SetUniformValue(key, modelview);
-        break;
-      case MatPlaceholder::kProjection:
-        program_->SetUniformValue(key, projection);
-        break;
-      case MatPlaceholder::kProjectionModelview:
-        program_->SetUniformValue(key, proj_modelview);
-        break;
-      case MatPlaceholder::kNormalModelview:
-        program_->SetUniformValue(key, normal_modelview);
-        break;
-      case MatPlaceholder::kObject:
-        program_->SetUniformValue(key, transform);
-        break;
-    }
+DrawProgram::VertexArray &DrawProgram::GetVertexArray() {
+  const Context *current = Context::GetCurrent();
+  if (current == nullptr || current == vao_owner_) {
+    return vertex_array_;
   }
 
-  set<int> enabled_attribs;
-  int vertex_size = -1;
-  GLCheckError();
-  glBindVertexArray(vao_);
-  GLCheckError();
-  for (const auto &key_buffer : buffers_) {
-    const auto &key = key_buffer.first;
-    auto &buffer = key_buffer.second;
-    const auto attrib_loc = program_->GetAttribLocation(key);
+  lock_guard<mutex> lock(vao_mutex_);
+  auto iter = context_vertex_arrays_.find(current);
+  if (iter == context_vertex_arrays_.end()) {
+    VertexArray vertex_array;
+    glGenVertexArrays(1, &vertex_array.vao);
+    GLCheckError();
+    iter = context_vertex_arrays_.emplace(current, vertex_array).first;
+  }
+  return iter->second;
+}
 
-    if (vertex_size > -1 && buffer->get_size(0) != vertex_size) {
-      throw Error("Buffers vertices size doesn't match");
+bool DrawProgram::UpdateLayout(vector<uint64_t> &layout) const {
+  const size_t size = buffers_.size() * 3 + (vertices_ != nullptr ? 5 : 2);
+  bool changed = layout.size() != size;
+  layout.resize(size);
+
+  size_t pos = 0;
+  auto update = [&](uint64_t value) {
+    if (layout[pos] != value) {
+      layout[pos] = value;
+      changed = true;
     }
+    ++pos;
+  };
+
+  update(layout_generation_);
+  update(uint64_t(program_->get_link_generation()));
+
+  for (const auto &item : buffers_) {
+    const GLBuffer *buffer = item.value.get();
+    update(reinterpret_cast<uintptr_t>(buffer));
+    update(buffer->get_generation());
+    update((buffer->normalize ? 1 : 0) | (buffer->integer_attrib ? 2 : 0));
+  }
 
+  if (vertices_ != nullptr) {
+    update(vertices_->get_generation());
+    update(vertices_->get_buffer()->get_generation());
+    update(vertices_->get_vertex_count() > 0 ? 1 : 0);
+  }
+
+  return changed;
+}
+
+void DrawProgram::SetupVertexArray(VertexArray &vertex_array) {
+  for (GLint attrib_loc : vertex_array.enabled_attribs) {
+    glDisableVertexAttribArray(attrib_loc);
+    GLCheckError();
+  }
+  vertex_array.enabled_attribs.clear();
+  vertex_array.attrib_buffers.clear();
+  vertex_array.instance_buffers.clear();
+  vertex_array.draws_vertices = false;
+
+  for (const auto &item : buffers_) {
+    const shared_ptr<GLBuffer> &buffer = item.value;
+    const GLint attrib_loc = program_->GetAttribLocation(item.slot);
     if (attrib_loc < 0) {
-      glGetError();
       continue;
     }
 
-    vertex_size = buffer->get_size(0);
-
     ScopedBind<GLBuffer> buffer_bind(buffer);
     glEnableVertexAttribArray(attrib_loc);
     GLCheckError();
 
-    enabled_attribs.insert(attrib_loc);
+    vertex_array.enabled_attribs.insert(attrib_loc);
+
+    // The divisor is part of the VAO, so it's always set.
+    const int divisor = GetDivisor(item.slot);
+    glVertexAttribDivisor(attrib_loc, divisor);
+    GLCheckError();
+    if (divisor > 0) {
+      vertex_array.instance_buffers.emplace_back(buffer, divisor);
+    } else {
+      vertex_array.attrib_buffers.push_back(buffer);
+    }
 
     int channels = 1;
     if (buffer->get_size().size() > 1) {
       channels = buffer->get_size(1);
     }
 
-    const GLenum gl_type = buffer->get_gl_type();
-    if (buffer->integer_attrib || gl_type == GL_INT ||
-        gl_type == GL_UNSIGNED_INT) {
-      glVertexAttribIPointer(attrib_loc, channels, buffer->get_gl_type(), 0,
-                             nullptr);
-    } else {
-      const GLenum normalize = buffer->normalize ? GL_TRUE : GL_FALSE;
-      glVertexAttribPointer(attrib_loc, channels, buffer->get_gl_type(),
-                            normalize, 0, nullptr);
+    SetAttribPointer(attrib_loc, channels, buffer->get_gl_type(),
+                     buffer->integer_attrib, buffer->normalize, 0,
+                     buffer->get_offset());
+  }
+
+  if (vertices_ == nullptr || vertices_->get_vertex_count() == 0) {
+    return;
+  }
+
+  const shared_ptr<GLBuffer> vertex_buffer = vertices_->get_buffer();
+  ScopedBind<GLBuffer> buffer_bind(vertex_buffer);
+  for (const VertexAttrib &attrib : vertices_->get_attribs()) {
+    const GLint attrib_loc =
+        program_->GetAttribLocation(program_->GetAttribSlot(attrib.name));
+    if (attrib_loc < 0) {
+      continue;
     }
+
+    glEnableVertexAttribArray(attrib_loc);
+    GLCheckError();
+    glVertexAttribDivisor(attrib_loc, 0);
     GLCheckError();
+    vertex_array.enabled_attribs.insert(attrib_loc);
+    vertex_array.draws_vertices = true;
+
+    SetAttribPointer(attrib_loc, attrib.channels, attrib.gl_type,
+                     attrib.integer, attrib.normalize, vertices_->get_stride(),
+                     vertex_buffer->get_offset() + attrib.offset);
   }
+}
 
-  auto disable_all_attribs = [&] {
-    for (auto attrib_loc : enabled_attribs) {
-      glDisableVertexAttribArray(attrib_loc);
-      GLCheckError();
+void DrawProgram::Draw(const Eigen::Matrix4f &projection,
+                       const Eigen::Matrix4f &view) {
+  ScopedBind<GLShaderProgram> program_bind(program_);
+  if (program_->UsesObjectBlock() || program_->UsesObjectBuffer()) {
+    BindObjectBlock(view);
+  }
+
+  // Only programs without the uniform blocks compute matrices for
+  // each node.
+  if (!matrix_placeholders_.empty()) {
+    const Eigen::Matrix4f modelview = view * transform;
+    for (const auto &item : matrix_placeholders_) {
+      const int key = item.slot;
+      const auto &pholder = item.value;
+
+      switch (pholder) {
+        case MatPlaceholder::kModelview:
+          program_->SetUniformValue(key, modelview);
+          break;
+        case MatPlaceholder::kProjection:
+          program_->SetUniformValue(key, projection);
+          break;
+        case MatPlaceholder::kProjectionModelview:
+          program_->SetUniformValue(key,
+                                    Eigen::Matrix4f(projection * modelview));
+          break;
+        case MatPlaceholder::kNormalModelview:
+          program_->SetUniformValue(key,
+                                    math::ComputeNormalModelview(modelview));
+          break;
+        case MatPlaceholder::kObject:
+          program_->SetUniformValue(key, transform);
+          break;
+      }
     }
-  };
+  }
 
-  if (vertex_size == -1) {
-    disable_all_attribs();
-    return;
+  // Takes the latest frames of buffers bound to shared memory channels.
+  for (const auto &item : buffers_) {
+    item.value->PollChannel();
+  }
+  indices->PollChannel();
+
+  // The attributes stay set up in the VAO until their buffers change.
+  VertexArray &vertex_array = GetVertexArray();
+  GLStateCache::BindVertexArray(vertex_array.vao);
+  if (UpdateLayout(vertex_array.layout)) {
+    try {
+      SetupVertexArray(vertex_array);
+    } catch (...) {
+      // Sets up again on the next draw.
+      vertex_array.layout.clear();
+      throw;
+    }
   }
 
-  int tex_unit = 0;
-  for (auto name_tex : textures_) {
-    const string &name = name_tex.first;
-    shared_ptr<GLTexture> tex = name_tex.second;
-    tex->Bind(true, tex_unit);
-    program_->SetUniformValue(name, tex_unit);
-    ++tex_unit;
+  int vertex_size = -1;
+  for (const auto &buffer : vertex_array.attrib_buffers) {
+    if (vertex_size > -1 && buffer->get_size(0) != vertex_size) {
+      throw Error("Buffers vertices size doesn't match");
+    }
+    vertex_size = buffer->get_size(0);
   }
 
-  for (auto key_value : uniforms_) {
-    const auto &key = key_value.first;
-    const auto &value = key_value.second;
+  if (vertex_array.draws_vertices) {
+    if (vertex_size > -1 && vertices_->get_vertex_count() != vertex_size) {
+      throw Error("Buffers vertices size doesn't match");
+    }
+    vertex_size = vertices_->get_vertex_count();
+  }
+
+  if (vertex_size == -1) {
+    if (GLStateCache::GetCurrent() == nullptr) {
+      GLStateCache::BindVertexArray(0);
+    }
+    return;
+  }
 
-    program_->SetUniform(key, value);
+  // Instanced attributes bound the number of instances.
+  int instance_count = -1;
+  for (const auto &buffer_divisor : vertex_array.instance_buffers) {
+    const int count =
+        buffer_divisor.first->get_size(0) * buffer_divisor.second;
+    instance_count = (instance_count < 0) ? count : min(instance_count, count);
   }
 
+  BindUniforms();
+
   const GLenum draw_mode = static_cast<GLenum>(draw_mode_);
   Style::Scoped style_scop(style);
   if (!indices->is_empty()) {
+    // The element buffer is part of the VAO, so the state cache skips
+    // rebinding it.
     ScopedBind<GLBuffer> ind_bind(indices);
-    GLenum type;
-    switch (indices->get_gl_type()) {
-      case GL_UNSIGNED_INT:
-      case GL_UNSIGNED_SHORT:
-      case GL_UNSIGNED_BYTE:
-        type = indices->get_gl_type();
-        break;
-      case GL_INT:
-        type = GL_UNSIGNED_INT;
-        break;
-      case GL_SHORT:
-        type = GL_UNSIGNED_SHORT;
-        break;
-      case GL_BYTE:
-        type = GL_UNSIGNED_BYTE;
-        break;
-      default:
-        throw Error("Indice buffer must be integers.");
+    const GLenum type = GetIndexType();
+    const size_t size = GetIndexCount();
+
+    const GLvoid *offset =
+        reinterpret_cast<const GLvoid *>(indices->get_offset());
+    if (has_draw_ranges_) {
+      DrawRanges(draw_mode, type, indices->get_size(0), instance_count);
+    } else {
+      if (instance_count < 0) {
+        glDrawElements(draw_mode, size, type, offset);
+      } else {
+        glDrawElementsInstanced(draw_mode, size, type, offset,
+                                instance_count);
+      }
+      GLCheckError();
+      RenderStats::CountDrawCall(
+          (instance_count < 0) ? size : size * instance_count);
     }
-    size_t size = indices->get_size(0);
-    if (max_draw_elems_ > 0) {
-      size = min(size, size_t(max_draw_elems_));
+  } else if (has_draw_ranges_) {
+    DrawRanges(draw_mode, GL_NONE, vertex_size, instance_count);
+  } else {
+    if (instance_count < 0) {
+      glDrawArrays(draw_mode, 0, vertex_size);
+    } else {
+      glDrawArraysInstanced(draw_mode, 0, vertex_size, instance_count);
     }
-    if (indices->get_dim() == 2) {
-      size *= indices->get_size(1);
+    GLCheckError();
+    RenderStats::CountDrawCall((instance_count < 0)
+                                   ? vertex_size
+                                   : int64_t(vertex_size) * instance_count);
+  }
+
+  // Stream buffers wait this draw before rewriting the slot.
+  for (const auto &item : buffers_) {
+    item.value->FenceStream();
+  }
+  indices->FenceStream();
+
+  if (GLStateCache::GetCurrent() == nullptr) {
+    GLStateCache::BindVertexArray(0);
+  }
+
+  UnbindTextures();
+}
+
+void DrawProgram::BindUniforms() {
+  int tex_unit = 0;
+  for (const auto &item : textures_) {
+    item.value->Bind(true, tex_unit);
+    program_->SetUniformValue(item.slot, tex_unit);
+    ++tex_unit;
+  }
+
+  for (const auto &item : uniforms_) {
+    program_->SetUniform(item.slot, item.value);
+  }
+}
+
+void DrawProgram::UnbindTextures() {
+  int tex_unit = 0;
+  for (const auto &item : textures_) {
+    item.value->Bind(false, tex_unit);
+    ++tex_unit;
+  }
+}
+
+GLenum DrawProgram::GetIndexType() const {
+  switch (indices->get_gl_type()) {
+    case GL_UNSIGNED_INT:
+    case GL_UNSIGNED_SHORT:
+    case GL_UNSIGNED_BYTE:
+      return indices->get_gl_type();
+    case GL_INT:
+      return GL_UNSIGNED_INT;
+    case GL_SHORT:
+      return GL_UNSIGNED_SHORT;
+    case GL_BYTE:
+      return GL_UNSIGNED_BYTE;
+    default:
+      throw Error("Indice buffer must be integers.");
+  }
+}
+
+size_t DrawProgram::GetIndexCount() const {
+  size_t size = indices->get_size(0);
+  if (max_draw_elems_ > 0) {
+    size = min(size, size_t(max_draw_elems_));
+  }
+  if (indices->get_dim() == 2) {
+    size *= indices->get_size(1);
+  }
+  return size;
+}
+
+void DrawProgram::DrawRanges(GLenum draw_mode, GLenum index_type,
+                             int64_t rows, int instance_count) {
+  const bool draws_elements = index_type != GL_NONE;
+  const int64_t row_size =
+      (draws_elements && indices->get_dim() == 2) ? indices->get_size(1) : 1;
+  const size_t row_bytes =
+      draws_elements ? GetTypeSize(index_type) * row_size : 0;
+
+  vector<GLsizei> counts;
+  vector<GLint> firsts;
+  vector<const GLvoid *> offsets;
+  counts.reserve(draw_ranges_.size());
+  int64_t total_count = 0;
+  for (const auto &range : draw_ranges_) {
+    const int64_t first = min(range.first, rows);
+    const int64_t count = min(range.second, rows - first);
+    if (count == 0) {
+      continue;
     }
 
-    glDrawElements(draw_mode, size, type, nullptr);
+    counts.push_back(GLsizei(count * row_size));
+    if (draws_elements) {
+      offsets.push_back(reinterpret_cast<const GLvoid *>(
+          indices->get_offset() + first * row_bytes));
+    } else {
+      firsts.push_back(GLint(first));
+    }
+    total_count += count * row_size;
+  }
+
+  if (counts.empty()) {
+    return;
+  }
+
+  if (instance_count < 0) {
+    if (draws_elements) {
+      glMultiDrawElements(draw_mode, counts.data(), index_type,
+                          offsets.data(), GLsizei(counts.size()));
+    } else {
+      glMultiDrawArrays(draw_mode, firsts.data(), counts.data(),
+                        GLsizei(counts.size()));
+    }
     GLCheckError();
-  } else {
-    glDrawArrays(draw_mode, 0, vertex_size);
+    RenderStats::CountDrawCall(total_count);
+    return;
+  }
+
+  // There's no instanced multi-draw without indirect buffers.
+  for (size_t i = 0; i < counts.size(); ++i) {
+    if (draws_elements) {
+      glDrawElementsInstanced(draw_mode, counts[i], index_type, offsets[i],
+                              instance_count);
+    } else {
+      glDrawArraysInstanced(draw_mode, firsts[i], counts[i], instance_count);
+    }
     GLCheckError();
+    RenderStats::CountDrawCall(int64_t(counts[i]) * instance_count);
   }
-  glBindVertexArray(0);
-  GLCheckError();
+}
+
+Eigen::Matrix4f DrawProgram::GetObjectMatrix(
+    const Eigen::Matrix4f &view) const {
+  const FrameCamera *camera = FrameCamera::GetCurrent();
+  if (camera == nullptr) {
+    throw Error(
+        "Programs with uniform blocks must be drawn by a context or viewer");
+  }
+
+  // Nodes inside transformed scenes receive other views than the
+  // frame's one.
+  if (view == camera->view) {
+    return transform;
+  }
+  return camera->inverse_view * view * transform;
+}
+
+void DrawProgram::BindObjectBlock(const Eigen::Matrix4f &view) {
+  const Eigen::Matrix4f object = GetObjectMatrix(view);
 
-  disable_all_attribs();
+  {
+    lock_guard<mutex> lock(object_block_mutex_);
+    if (!has_object_matrix_ || object != object_matrix_) {
+      const ObjectBlock block(object);
+      object_block_->Update(&block, sizeof(block));
+      object_matrix_ = object;
+      has_object_matrix_ = true;
+    }
+  }
+  if (program_->UsesObjectBlock()) {
+    object_block_->Bind(kObjectBlockBinding);
+  }
 
-  tex_unit = 0;
-  for (auto name_tex : textures_) {
-    shared_ptr<GLTexture> tex = name_tex.second;
-    tex->Bind(false, tex_unit);
+  // Outside batches, the storage block is read at draw 0.
+  if (program_->UsesObjectBuffer()) {
+    object_block_->Bind(kObjectBufferBinding, GL_SHADER_STORAGE_BUFFER);
   }
 }
 
@@ -225,9 +580,14 @@ shared_ptr<DrawProgram> DrawProgram::Clone() {
       new DrawProgram(draw_mode_, program_, ignore_missing_);
 
   new_program->buffers_ = buffers_;
+  new_program->vertices_ = vertices_;
   new_program->matrix_placeholders_ = matrix_placeholders_;
   new_program->uniforms_ = uniforms_;
+  new_program->decoded_attribs_ = decoded_attribs_;
+  new_program->attrib_divisors_ = attrib_divisors_;
   new_program->textures_ = textures_;
+  new_program->draw_ranges_ = draw_ranges_;
+  new_program->has_draw_ranges_ = has_draw_ranges_;
 
   return shared_ptr<DrawProgram>(new_program);
 }
@@ -238,44 +598,146 @@ void DrawProgram::SetBounds(const torch::Tensor &points) {
 
 void DrawProgram::SetItem(const std::string &name,
                           std::shared_ptr<GLBuffer> buffer) {
+  ModificationStamp::Touch();
   if (!ignore_missing_ && !program_->HasAttrib(name)) {
     stringstream format;
     format << "Program parameter `" << name << "` not found";
     throw Error(format);
   }
+
+  const int slot = program_->GetAttribSlot(name);
   if (buffer != nullptr) {
-    buffers_[name] = buffer;
+    SetSlotItem(buffers_, slot, name, buffer);
   } else {
-    buffers_.erase(name);
+    EraseSlotItem(buffers_, slot);
+    SetDivisor(name, 0);
+  }
+  ++layout_generation_;
+}
+
+void DrawProgram::SetInstanced(const string &name,
+                               shared_ptr<GLBuffer> buffer, int divisor) {
+  if (divisor < 1) {
+    throw Error("Instanced attributes' divisor must be at least 1");
+  }
+
+  SetItem(name, buffer);
+  if (buffer != nullptr) {
+    SetDivisor(name, divisor);
+  }
+}
+
+void DrawProgram::SetInstanced(const string &name,
+                               const torch::Tensor &tensor, int divisor) {
+  if (divisor < 1) {
+    throw Error("Instanced attributes' divisor must be at least 1");
+  }
+
+  SetAttrib(name, tensor, AttribEncoding::kRaw, divisor);
+}
+
+void DrawProgram::SetDivisor(const string &name, int divisor) {
+  const int slot = program_->GetAttribSlot(name);
+  if (divisor == GetDivisor(slot)) {
+    return;
+  }
+
+  if (divisor > 0) {
+    attrib_divisors_[slot] = divisor;
+  } else {
+    attrib_divisors_.erase(slot);
+  }
+  ++layout_generation_;
+}
+
+int DrawProgram::GetDivisor(int slot) const {
+  auto iter = attrib_divisors_.find(slot);
+  return (iter != attrib_divisors_.end()) ? iter->second : 0;
+}
+
+void DrawProgram::SetVertices(
+    const std::map<std::string, torch::Tensor> &attributes) {
+  ModificationStamp::Touch();
+  if (!ignore_missing_) {
+    for (const auto &name_tensor : attributes) {
+      if (!program_->HasAttrib(name_tensor.first)) {
+        stringstream format;
+        format << "Program parameter `" << name_tensor.first << "` not found";
+        throw Error(format);
+      }
+    }
   }
+
+  if (vertices_ == nullptr) {
+    vertices_ = make_shared<InterleavedVertices>();
+  }
+  vertices_->FromTensors(attributes);
+
+  for (const auto &name_tensor : attributes) {
+    EraseSlotItem(buffers_, program_->GetAttribSlot(name_tensor.first));
+  }
+  ++layout_generation_;
+}
+
+void DrawProgram::SetDrawRanges(const torch::Tensor &ranges) {
+  if (ranges.dim() != 2 || ranges.size(1) != 2) {
+    throw Error("Draw ranges must be a [N x 2] tensor of (first, count)");
+  }
+
+  if (ranges.is_floating_point()) {
+    throw Error("Draw ranges must be integers");
+  }
+
+  const torch::Tensor cpu_ranges = ranges.to(torch::kInt64).cpu();
+  const auto accessor = cpu_ranges.accessor<int64_t, 2>();
+  vector<pair<int64_t, int64_t>> draw_ranges;
+  draw_ranges.reserve(cpu_ranges.size(0));
+  for (int64_t i = 0; i < cpu_ranges.size(0); ++i) {
+    if (accessor[i][0] < 0 || accessor[i][1] < 0) {
+      throw Error("Draw ranges can't be negative");
+    }
+    draw_ranges.emplace_back(accessor[i][0], accessor[i][1]);
+  }
+
+  ModificationStamp::Touch();
+  draw_ranges_ = move(draw_ranges);
+  has_draw_ranges_ = true;
+}
+
+void DrawProgram::ClearDrawRanges() {
+  ModificationStamp::Touch();
+  draw_ranges_.clear();
+  has_draw_ranges_ = false;
 }
 
 void DrawProgram::SetItem(const std::string &name, MatPlaceholder placeholder) {
+  ModificationStamp::Touch();
+  const GLShaderProgram::Variable *uniform = program_->FindUniform(name);
+  if ((uniform != nullptr && uniform->location < 0) ||
+      (uniform == nullptr && program_->UsesCameraBlock())) {
+    // The program's uniform blocks already provide the matrices.
+    return;
+  }
+
   if (!ignore_missing_ && !program_->HasUniform(name)) {
     stringstream format;
     format << "Program parameter `" << name << "` not found";
     throw Error(format);
   }
-  matrix_placeholders_[name] = placeholder;
+  SetSlotItem(matrix_placeholders_, program_->GetUniformSlot(name), name,
+              placeholder);
 }
 
 void DrawProgram::SetItem(const std::string &name,
                           const torch::Tensor &tensor) {
+  ModificationStamp::Touch();
   if (program_->HasAttrib(name)) {
-    switch (tensor.scalar_type()) {
-      case torch::kDouble:
-        throw Error("Double tensors can't be assigned to GL buffers");
-        break;
-      default:
-        break;
-    }
-    if (!buffers_.count(name)) {
-      buffers_[name] = GLBuffer::Create();
-    }
-
-    buffers_[name]->FromTensor(tensor);
+    // Instanced attributes stay so when updated.
+    SetAttrib(name, tensor, AttribEncoding::kRaw,
+              GetDivisor(program_->GetAttribSlot(name)));
   } else if (program_->HasUniform(name)) {
-    uniforms_[name] = tensor;
+    // Converted once, so drawing doesn't dispatch on the tensor.
+    SetUniformItem(name, UniformValue::FromTensor(tensor));
   } else if (!ignore_missing_) {
     stringstream format;
     format << "Program parameter `" << name << "` not found";
@@ -283,38 +745,151 @@ void DrawProgram::SetItem(const std::string &name,
   }
 }
 
+void DrawProgram::SetUniformItem(const std::string &name,
+                                 const UniformValue &value) {
+  program_->CheckUniformValue(name, value);
+  SetSlotItem(uniforms_, program_->GetUniformSlot(name), name, value);
+}
+
+void DrawProgram::SetAttrib(const std::string &name,
+                            const torch::Tensor &tensor,
+                            AttribEncoding encoding) {
+  SetAttrib(name, tensor, encoding, 0);
+}
+
+void DrawProgram::SetAttrib(const std::string &name,
+                            const torch::Tensor &tensor,
+                            AttribEncoding encoding, int divisor) {
+  ModificationStamp::Touch();
+  if (!program_->HasAttrib(name)) {
+    if (!ignore_missing_) {
+      stringstream format;
+      format << "Program parameter `" << name << "` not found";
+      throw Error(format);
+    }
+    return;
+  }
+
+  if (encoding == AttribEncoding::kRaw &&
+      tensor.scalar_type() == torch::kDouble) {
+    throw Error("Double tensors can't be assigned to GL buffers");
+  }
+
+  const EncodedAttrib encoded = EncodedAttrib::Encode(tensor, encoding);
+  const GLShaderProgram::Variable *var = program_->FindAttrib(name);
+  if (var != nullptr && IsIntegerType(var->type) &&
+      encoded.tensor.is_floating_point()) {
+    stringstream format;
+    format << "Attribute `" << name << "` expects an integer tensor";
+    throw Error(format);
+  }
+
+  const int slot = program_->GetAttribSlot(name);
+  shared_ptr<GLBuffer> *buffer = FindSlotItem(buffers_, slot);
+  if (buffer == nullptr) {
+    SetSlotItem(buffers_, slot, name, GLBuffer::Create());
+    buffer = FindSlotItem(buffers_, slot);
+    ++layout_generation_;
+  }
+
+  (*buffer)->FromTensor(encoded.tensor);
+
+  // Raw uploads keep the normalize flag set by the user, unless it
+  // was set by a previous encoding.
+  if (encoding != AttribEncoding::kRaw || decoded_attribs_.count(name)) {
+    (*buffer)->normalize = encoded.normalize;
+  }
+  SetDecodeUniforms(name, encoded);
+  SetDivisor(name, divisor);
+}
+
+void DrawProgram::SetDecodeUniforms(const std::string &name,
+                                    const EncodedAttrib &encoded) {
+  const bool decodes = encoded.normalize;
+  // Programs without encoded attributes keep the uniforms' defaults.
+  if (!decodes && !decoded_attribs_.count(name)) {
+    return;
+  }
+
+  // Fits the per channel values to the vector declared by the shader.
+  auto set_vector = [this](const string &uniform, const torch::Tensor &values,
+                           float fill) {
+    const GLShaderProgram::Variable *var = program_->FindUniform(uniform);
+    torch::ScalarType scalar_type;
+    vector<int64_t> shape;
+    if (var == nullptr ||
+        !GLShaderProgram::GetUniformShape(var->type, &scalar_type, &shape) ||
+        scalar_type != torch::kFloat || shape.size() != 1) {
+      return;
+    }
+
+    float fitted[4] = {fill, fill, fill, fill};
+    const auto accessor = values.accessor<float, 1>();
+    const int64_t count = min(shape[0], values.size(0));
+    for (int64_t i = 0; i < count; ++i) {
+      fitted[i] = accessor[i];
+    }
+    SetSlotItem(uniforms_, program_->GetUniformSlot(uniform), uniform,
+                UniformValue::Vector(fitted, int(shape[0])));
+  };
+
+  set_vector(name + "_scale", encoded.scale, 1.0f);
+  set_vector(name + "_offset", encoded.offset, 0.0f);
+
+  const string octahedral_name = name + "_octahedral";
+  if (program_->FindUniform(octahedral_name) != nullptr) {
+    SetUniformItem(octahedral_name, UniformValue(encoded.octahedral ? 1 : 0));
+  }
+
+  if (decodes) {
+    decoded_attribs_.insert(name);
+  } else {
+    decoded_attribs_.erase(name);
+  }
+}
+
 void DrawProgram::SetItem(const string &name, shared_ptr<GLTexture> texture) {
+  ModificationStamp::Touch();
   if (!ignore_missing_ && !program_->HasUniform(name)) {
     stringstream format;
     format << "Program parameter `" << name << "` not found";
     throw Error(format);
   }
 
+  const int slot = program_->GetUniformSlot(name);
   if (texture != nullptr) {
-    textures_[name] = texture;
+    SetSlotItem(textures_, slot, name, texture);
   } else {
-    textures_.erase(name);
+    EraseSlotItem(textures_, slot);
   }
 }
 
 void DrawProgram::SetItem(const std::string &name, float value) {
+  ModificationStamp::Touch();
   if (!ignore_missing_ && !program_->HasUniform(name)) {
     stringstream format;
     format << "Program parameter `" << name << "` not found";
     throw Error(format);
   }
 
-  uniforms_[name] = torch::full({1}, value, torch::kFloat);
+  SetUniformItem(name, UniformValue(value));
 }
 
 void DrawProgram::SetItem(const std::string &name, int value) {
+  ModificationStamp::Touch();
   if (!ignore_missing_ && !program_->HasUniform(name)) {
     stringstream format;
     format << "Program parameter `" << name << "` not found";
     throw Error(format);
   }
 
-  uniforms_[name] = torch::full({1}, value, torch::kInt32);
+  // Python's integers also set float uniforms.
+  const GLShaderProgram::Variable *var = program_->FindUniform(name);
+  if (var != nullptr && var->type == GL_FLOAT) {
+    SetUniformItem(name, UniformValue(float(value)));
+  } else {
+    SetUniformItem(name, UniformValue(value));
+  }
 }
 
 pybind11::object DrawProgram::GetItem(const string &name) {
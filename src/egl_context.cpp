@@ -0,0 +1,253 @@
+#include "egl_context.hpp"
+
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef TENVIZ_WITH_EGL
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "error.hpp"
+#include "gl_error.hpp"
+
+using namespace std;
+
+namespace tenviz {
+
+#ifdef TENVIZ_WITH_EGL
+namespace {
+
+// All contexts use the same display, so they can share objects.
+mutex g_egl_mutex;
+EGLDisplay g_egl_display = EGL_NO_DISPLAY;
+int g_egl_use_count = 0;
+
+const int kMaxEGLDevices = 16;
+
+bool HasExtension(const char *extensions, const string &name) {
+  if (extensions == nullptr) return false;
+
+  const string all(extensions);
+  size_t pos = 0;
+  while ((pos = all.find(name, pos)) != string::npos) {
+    const size_t end = pos + name.size();
+    if ((pos == 0 || all[pos - 1] == ' ') &&
+        (end == all.size() || all[end] == ' ')) {
+      return true;
+    }
+    pos = end;
+  }
+  return false;
+}
+
+EGLDisplay InitializeDisplay(EGLDisplay display) {
+  if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr)) {
+    return display;
+  }
+  return EGL_NO_DISPLAY;
+}
+
+EGLDisplay OpenDisplay() {
+  const char *client_exts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+      eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+  if (get_platform_display != nullptr) {
+    if (HasExtension(client_exts, "EGL_EXT_platform_device")) {
+      auto query_devices = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(
+          eglGetProcAddress("eglQueryDevicesEXT"));
+
+      EGLDeviceEXT devices[kMaxEGLDevices];
+      EGLint num_devices = 0;
+      if (query_devices != nullptr &&
+          query_devices(kMaxEGLDevices, devices, &num_devices)) {
+        for (int i = 0; i < num_devices; ++i) {
+          EGLDisplay display = InitializeDisplay(get_platform_display(
+              EGL_PLATFORM_DEVICE_EXT, devices[i], nullptr));
+          if (display != EGL_NO_DISPLAY) return display;
+        }
+      }
+    }
+
+    if (HasExtension(client_exts, "EGL_MESA_platform_surfaceless")) {
+      EGLDisplay display = InitializeDisplay(get_platform_display(
+          EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr));
+      if (display != EGL_NO_DISPLAY) return display;
+    }
+  }
+
+  return InitializeDisplay(eglGetDisplay(EGL_DEFAULT_DISPLAY));
+}
+
+EGLDisplay AcquireDisplay() {
+  lock_guard<mutex> lock(g_egl_mutex);
+  if (g_egl_use_count == 0) {
+    g_egl_display = OpenDisplay();
+    if (g_egl_display == EGL_NO_DISPLAY) {
+      throw Error("Failed to initialize an EGL display");
+    }
+  }
+  g_egl_use_count += 1;
+  return g_egl_display;
+}
+
+void ReleaseDisplay() {
+  lock_guard<mutex> lock(g_egl_mutex);
+  if (g_egl_use_count == 1) {
+    eglTerminate(g_egl_display);
+    g_egl_display = EGL_NO_DISPLAY;
+  }
+  g_egl_use_count -= 1;
+}
+
+void ThrowEGLError(const char *what) {
+  stringstream format;
+  format << "EGL error: " << what << " (0x" << hex << eglGetError() << ")";
+  throw Error(format);
+}
+}  // namespace
+
+bool EGLOffscreenContext::IsSupported() { return true; }
+
+EGLOffscreenContext::EGLOffscreenContext()
+    : display_(EGL_NO_DISPLAY), context_(nullptr), surface_(nullptr) {}
+
+void EGLOffscreenContext::Initialize(int width, int height, bool profile,
+                                     const EGLOffscreenContext *share) {
+  EGLDisplay display = AcquireDisplay();
+
+  const EGLint config_attribs[] = {EGL_SURFACE_TYPE,
+                                   EGL_PBUFFER_BIT,
+                                   EGL_RENDERABLE_TYPE,
+                                   EGL_OPENGL_BIT,
+                                   EGL_RED_SIZE,
+                                   8,
+                                   EGL_GREEN_SIZE,
+                                   8,
+                                   EGL_BLUE_SIZE,
+                                   8,
+                                   EGL_ALPHA_SIZE,
+                                   8,
+                                   EGL_DEPTH_SIZE,
+                                   24,
+                                   EGL_NONE};
+
+  EGLConfig config;
+  EGLint num_configs = 0;
+  if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) ||
+      num_configs == 0) {
+    ReleaseDisplay();
+    ThrowEGLError("no suitable EGL config");
+  }
+
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    ReleaseDisplay();
+    ThrowEGLError("desktop OpenGL is not supported");
+  }
+
+  vector<EGLint> context_attribs;
+  if (profile) {
+    context_attribs = {EGL_CONTEXT_MAJOR_VERSION,
+                       3,
+                       EGL_CONTEXT_MINOR_VERSION,
+                       2,
+                       EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                       EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT};
+  }
+  if (GetGLErrorMode() == GLErrorMode::kDebugOutput) {
+    context_attribs.push_back(EGL_CONTEXT_OPENGL_DEBUG);
+    context_attribs.push_back(EGL_TRUE);
+  }
+  context_attribs.push_back(EGL_NONE);
+
+  EGLContext share_context = EGL_NO_CONTEXT;
+  if (share != nullptr) {
+    share_context = static_cast<EGLContext>(share->context_);
+  }
+
+  EGLContext context = eglCreateContext(display, config, share_context,
+                                        context_attribs.data());
+  if (context == EGL_NO_CONTEXT) {
+    ReleaseDisplay();
+    ThrowEGLError("failed to create the context");
+  }
+
+  // The rendering always goes to framebuffer objects, so a surface is
+  // only needed when the driver can't make current without one.
+  EGLSurface surface = EGL_NO_SURFACE;
+  const char *display_exts = eglQueryString(display, EGL_EXTENSIONS);
+  if (!HasExtension(display_exts, "EGL_KHR_surfaceless_context")) {
+    const EGLint pbuffer_attribs[] = {EGL_WIDTH, width, EGL_HEIGHT, height,
+                                      EGL_NONE};
+    surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+    if (surface == EGL_NO_SURFACE) {
+      eglDestroyContext(display, context);
+      ReleaseDisplay();
+      ThrowEGLError("failed to create a pbuffer surface");
+    }
+  }
+
+  display_ = display;
+  context_ = context;
+  surface_ = surface;
+}
+
+void EGLOffscreenContext::MakeCurrent() {
+  // The bound API is a thread state.
+  eglBindAPI(EGL_OPENGL_API);
+
+  EGLSurface surface = static_cast<EGLSurface>(surface_);
+  if (!eglMakeCurrent(static_cast<EGLDisplay>(display_), surface, surface,
+                      static_cast<EGLContext>(context_))) {
+    ThrowEGLError("failed to make the context current");
+  }
+}
+
+void EGLOffscreenContext::DetachCurrent() {
+  eglMakeCurrent(static_cast<EGLDisplay>(display_), EGL_NO_SURFACE,
+                 EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+void EGLOffscreenContext::Release() {
+  if (context_ == nullptr) {
+    return;
+  }
+
+  EGLDisplay display = static_cast<EGLDisplay>(display_);
+  if (surface_ != EGL_NO_SURFACE) {
+    eglDestroySurface(display, static_cast<EGLSurface>(surface_));
+  }
+  eglDestroyContext(display, static_cast<EGLContext>(context_));
+  ReleaseDisplay();
+
+  display_ = EGL_NO_DISPLAY;
+  context_ = nullptr;
+  surface_ = nullptr;
+}
+
+#else
+
+bool EGLOffscreenContext::IsSupported() { return false; }
+
+EGLOffscreenContext::EGLOffscreenContext()
+    : display_(nullptr), context_(nullptr), surface_(nullptr) {}
+
+void EGLOffscreenContext::Initialize(int, int, bool,
+                                     const EGLOffscreenContext *) {
+  throw Error("TensorViz was built without EGL support");
+}
+
+void EGLOffscreenContext::MakeCurrent() {}
+
+void EGLOffscreenContext::DetachCurrent() {}
+
+void EGLOffscreenContext::Release() {}
+
+#endif
+
+}  // namespace tenviz
@@ -1,12 +1,21 @@
 #include "gl_buffer.hpp"
 
+#include <cstring>
 #include <limits>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <type_traits>
 
+#include <ATen/Parallel.h>
 #include <torch/csrc/utils/pybind.h>
 
-#include "cuda_error.hpp"
+#include "context.hpp"
 #include "cuda_memory.hpp"
 #include "gl_error.hpp"
+#include "gl_state_cache.hpp"
+#include "modification_stamp.hpp"
+#include "render_stats.hpp"
 
 using namespace std;
 
@@ -14,24 +23,25 @@ namespace tenviz {
 
 class ScopedGLBufferMap {
  public:
-  ScopedGLBufferMap(GLenum target, GLuint buffer, GLenum maptype)
+  ScopedGLBufferMap(GLenum target, GLuint buffer, size_t offset,
+                    size_t length, GLbitfield access)
       : target_(target), buffer_(buffer) {
-    glBindBuffer(target, buffer);
-    GLCheckError();
-    data = glMapBuffer(target_, maptype);
+    GLStateCache::BindBuffer(target, buffer);
+    data = reinterpret_cast<uint8_t *>(
+        glMapBufferRange(target_, offset, length, access));
     GLCheckError();
   }
 
   ~ScopedGLBufferMap() {
-    glBindBuffer(target_, buffer_);
-    GLCheckError();
+    GLStateCache::BindBuffer(target_, buffer_);
     glUnmapBuffer(target_);
     GLCheckError();
-    glBindBuffer(target_, 0);
-    GLCheckError();
+    if (GLStateCache::GetCurrent() == nullptr) {
+      GLStateCache::BindBuffer(target_, 0);
+    }
   }
 
-  void *data;
+  uint8_t *data;
 
  private:
   GLenum target_;
@@ -40,7 +50,21 @@ class ScopedGLBufferMap {
 
 namespace {
 const GLuint GL_SENTINEL = numeric_limits<GLuint>::max();
+const GLuint64 kFenceWaitTimeout = 100000000;  // ns
+
+/**
+ * Grows by half of the current capacity at least, so successive
+ * resizes don't reallocate every time.
+ */
+size_t GetGrownCapacity(size_t capacity, size_t size) {
+  if (capacity == 0) {
+    return size;
+  }
+  return max(size, capacity + capacity / 2);
+}
 
+mutex g_channel_mutex;
+set<const GLBuffer *> g_channel_buffers;
 }  // namespace
 
 void GLBuffer::RegisterPybind(pybind11::module &m,
@@ -49,10 +73,20 @@ void GLBuffer::RegisterPybind(pybind11::module &m,
       .def(py::init<BufferTarget, BufferUsage>())
       .def("from_tensor", &GLBuffer::FromTensor)
       .def("to_tensor", &GLBuffer::ToTensor, py::arg("keep_on_device") = true)
+      .def("update", &GLBuffer::Update, py::arg("tensor"),
+           py::arg("offset_rows") = 0)
       .def("allocate", &GLBuffer::Allocate)
       .def("__setitem__", &GLBuffer::IndexPut)
       .def("__getitem__", &GLBuffer::IndexSelect_)
+      .def("index_select", &GLBuffer::IndexSelect, py::arg("indices"),
+           py::arg("keep_on_device") = true)
       .def("as_tensor", &GLBuffer::AsTensor)
+      .def("begin_stream_write", &GLBuffer::BeginStreamWrite)
+      .def("end_stream_write", &GLBuffer::EndStreamWrite)
+      .def("bind_channel", &GLBuffer::BindChannel)
+      .def("poll_channel", &GLBuffer::PollChannel)
+      .def_property_readonly("is_stream", &GLBuffer::is_stream)
+      .def_property_readonly("capacity", &GLBuffer::get_capacity)
       .def_readwrite("normalize", &GLBuffer::normalize)
       .def_readwrite("integer_attrib", &GLBuffer::integer_attrib);
 
@@ -68,26 +102,51 @@ void GLBuffer::RegisterPybind(pybind11::module &m,
   py::enum_<BufferUsage>(m, "BufferUsage")
       .value("Dynamic", kDynamic)
       .value("Static", kStatic)
+      .value("Stream", kStream)
       .export_values();
   py::enum_<DType>(m, "DType")
       .value("Double", DType::kDouble)
       .value("Int64", DType::kInt64)
       .value("Float", DType::kFloat)
       .value("Int32", DType::kInt32)
+      .value("Half", DType::kHalf)
       .value("Int16", DType::kInt16)
       .value("Uint8", DType::kUint8)
       .value("Int8", DType::kInt8)
       .export_values();
 }
 
-GLBuffer::GLBuffer(GLenum target, GLenum usage) {
-  glGenBuffers(1, &buffer_id_);
-  GLCheckError();
+shared_ptr<GLBuffer> GLBuffer::Create(BufferTarget target,
+                                      BufferUsage usage) {
+  shared_ptr<GLBufferArena> arena;
+  Context *context = Context::GetCurrent();
+  if (context != nullptr && usage != kStream) {
+    arena = context->GetBufferArena();
+  }
+
+  auto buf = make_shared<GLBuffer>(target, usage, arena);
+  IContextResource::RegisterResourceOnCurrent(buf);
+  return buf;
+}
+
+GLBuffer::GLBuffer(GLenum target, GLenum usage,
+                   shared_ptr<GLBufferArena> arena)
+    : arena_(arena) {
+  if (arena_ == nullptr) {
+    glGenBuffers(1, &buffer_id_);
+    GLCheckError();
+  } else {
+    buffer_id_ = GL_SENTINEL;
+  }
 
   target_ = target;
   gltype_ = GL_NONE;
   usage_ = usage;
   cuda_resource_ = nullptr;
+  capacity_ = 0;
+  generation_ = 0;
+  stream_current_ = stream_writing_ = -1;
+  channel_frame_ = 0;
   normalize = false;
   integer_attrib = false;
 }
@@ -95,28 +154,131 @@ GLBuffer::GLBuffer(GLenum target, GLenum usage) {
 GLBuffer::~GLBuffer() { Release(); }
 
 void GLBuffer::Release() {
+  BindChannel(nullptr);
+
+  if (arena_ != nullptr) {
+    NextGeneration();
+    arena_->Free(slice_);
+    slice_ = nullptr;
+    capacity_ = 0;
+    return;
+  }
+
   if (buffer_id_ == GL_SENTINEL) {
     return;
   }
 
+#ifdef TENVIZ_WITH_CUDA
   if (cuda_resource_) {
     CudaSafeCall(cudaGraphicsUnregisterResource(cuda_resource_));
     cuda_resource_ = nullptr;
   }
+#endif
 
-  glDeleteBuffers(1, &buffer_id_);
-  GLCheckError();
+  if (!stream_slots_.empty()) {
+    // The current slot's buffer is the buffer_id_.
+    ReleaseStream();
+  } else {
+    glDeleteBuffers(1, &buffer_id_);
+    GLCheckError();
+    GLStateCache::NotifyDeleted();
+  }
 
   buffer_id_ = GL_SENTINEL;
+  NextGeneration();
 }
 
-void GLBuffer::Bind(bool do_binding) const {
-  if (do_binding) {
-    glBindBuffer(target_, buffer_id_);
+void GLBuffer::ReleaseStream() {
+  lock_guard<mutex> lock(fence_mutex_);
+  for (StreamSlot &slot : stream_slots_) {
+    for (auto &context_fence : slot.fences) {
+      glDeleteSync(context_fence.second);
+    }
+    // Deleting also unmaps it.
+    glDeleteBuffers(1, &slot.buffer);
     GLCheckError();
+  }
+  GLStateCache::NotifyDeleted();
+
+  stream_slots_.clear();
+  capacity_ = 0;
+  stream_current_ = stream_writing_ = -1;
+}
+
+void GLBuffer::BindChannel(shared_ptr<SharedBufferChannel> channel) {
+#ifndef TENVIZ_WITH_SHARED_MEMORY
+  if (channel != nullptr) {
+    throw Error("Shared buffer channels aren't supported on this platform");
+  }
+#endif
+  if (channel != nullptr && is_stream()) {
+    throw Error("Stream buffers can't be bound to channels");
+  }
+
+  lock_guard<mutex> poll_lock(channel_mutex_);
+  lock_guard<mutex> lock(g_channel_mutex);
+  channel_ = channel;
+  channel_frame_ = 0;
+  if (channel_ != nullptr) {
+    g_channel_buffers.insert(this);
   } else {
-    glBindBuffer(target_, 0);
-    GLCheckError();
+    g_channel_buffers.erase(this);
+  }
+}
+
+bool GLBuffer::PollChannel() {
+  lock_guard<mutex> lock(channel_mutex_);
+  if (channel_ == nullptr) {
+    return false;
+  }
+
+  SharedBufferChannel::View view;
+  if (!channel_->BeginRead(channel_frame_, &view)) {
+    return false;
+  }
+
+  const DType dtype = channel_->get_dtype();
+  const int64_t rows = channel_->get_rows();
+  const int64_t cols = channel_->get_cols();
+  if (size_ != vector<int64_t>{rows, cols} ||
+      gltype_ != cast_type<GLenum>(dtype)) {
+    Allocate(rows, cols, dtype);
+    view.begin_row = 0;
+    view.end_row = rows;
+  }
+
+  // Uploads straight from the shared memory.
+  const size_t row_size = GetTypeSize(gltype_) * cols;
+  uint8_t *data = reinterpret_cast<uint8_t *>(const_cast<void *>(view.data));
+  Update(torch::from_blob(data + view.begin_row * row_size,
+                          {view.end_row - view.begin_row, cols},
+                          cast_type<torch::ScalarType>(dtype)),
+         view.begin_row);
+
+  // Rows rewritten while uploading are uploaded again on the next poll.
+  if (!channel_->EndRead(view)) {
+    return false;
+  }
+
+  channel_frame_ = view.frame;
+  return true;
+}
+
+bool GLBuffer::HasPendingChannelFrames() {
+  lock_guard<mutex> lock(g_channel_mutex);
+  for (const GLBuffer *buffer : g_channel_buffers) {
+    if (buffer->channel_->get_frame() > buffer->channel_frame_) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void GLBuffer::Bind(bool do_binding) const {
+  if (do_binding) {
+    GLStateCache::BindBuffer(target_, get_buffer_id());
+  } else if (GLStateCache::GetCurrent() == nullptr) {
+    GLStateCache::BindBuffer(target_, 0);
   }
 }
 
@@ -126,48 +288,458 @@ void GLBuffer::Allocate(int rows, int cols, DType btype) {
 
   const size_t size = GetTypeSize(type) * rows * ((cols > 0) ? cols : 1);
   if (size > 0) {
-    AllocateImpl(size);
-    gltype_ = gltype;
+    // The shape sets the slice's alignment.
     if (cols > 0)
-      size_ = {rows, cols};
+      SetShape(gltype, {rows, cols});
     else
-      size_ = {rows};
+      SetShape(gltype, {rows});
+    AllocateImpl(size);
   }
 }
 
-void GLBuffer::AllocateImpl(size_t size) {
+void GLBuffer::SetShape(GLenum gltype, const vector<int64_t> &size) {
+  auto get_cols = [](const vector<int64_t> &size) {
+    return (size.size() > 1) ? size[1] : 1;
+  };
+
+  if (gltype != gltype_ || get_cols(size) != get_cols(size_)) {
+    NextGeneration();
+  }
+  gltype_ = gltype;
+  size_ = size;
+}
+
+void GLBuffer::NextGeneration() {
+  // Carries the slice's count, so get_generation keeps increasing.
+  generation_ += 1 + ((slice_ != nullptr) ? slice_->get_generation() : 0);
+}
+
+void GLBuffer::AllocateImpl(size_t size, const void *data) {
+  ModificationStamp::Touch();
+  if (is_stream()) {
+    if (size > capacity_) {
+      AllocateStream(GetGrownCapacity(capacity_, size));
+    }
+    if (data != nullptr) {
+      memcpy(stream_slots_[stream_current_].data, data, size);
+    }
+    return;
+  }
+
+  if (arena_ != nullptr && size > capacity_ &&
+      GetGrownCapacity(capacity_, size) > kMaxArenaSize) {
+    LeaveArena(false);
+  }
+
+  if (arena_ != nullptr) {
+    const size_t alignment = GetArenaAlignment();
+    if (slice_ == nullptr || size > capacity_ ||
+        slice_->get_offset() % alignment != 0) {
+      NextGeneration();
+      arena_->Free(slice_);
+      // Grows like the own buffers, so growing every frame doesn't
+      // fragment the arena.
+      slice_ = arena_->Allocate(
+          (size > capacity_) ? GetGrownCapacity(capacity_, size) : capacity_,
+          alignment);
+      capacity_ = slice_->get_size();
+    }
+    if (data != nullptr) {
+      Bind(true);
+      glBufferSubData(target_, get_offset(), size, data);
+      GLCheckError();
+      Bind(false);
+    }
+    return;
+  }
+
   Bind(true);
-  glBufferData(target_, size, nullptr, usage_);
+  if (size > capacity_) {
+    const size_t capacity = GetGrownCapacity(capacity_, size);
+#ifdef TENVIZ_WITH_CUDA
+    // The registration doesn't follow the new storage.
+    if (cuda_resource_ != nullptr) {
+      CudaSafeCall(cudaGraphicsUnregisterResource(cuda_resource_));
+      cuda_resource_ = nullptr;
+    }
+#endif
+    if (capacity == size) {
+      glBufferData(target_, size, data, usage_);
+    } else {
+      glBufferData(target_, capacity, nullptr, usage_);
+      if (data != nullptr) {
+        glBufferSubData(target_, 0, size, data);
+      }
+    }
+    capacity_ = capacity;
+  } else if (data != nullptr) {
+    glBufferSubData(target_, 0, size, data);
+  }
   GLCheckError();
   Bind(false);
+}
+
+void GLBuffer::LeaveArena(bool keep_data) {
+  glGenBuffers(1, &buffer_id_);
+  GLCheckError();
+
+  if (slice_ != nullptr && keep_data) {
+    // The copy targets don't touch the bound VAO's element buffer.
+    GLStateCache::BindBuffer(GL_COPY_WRITE_BUFFER, buffer_id_);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity_, nullptr, usage_);
+    GLCheckError();
+    GLStateCache::BindBuffer(GL_COPY_READ_BUFFER, slice_->get_buffer());
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                        slice_->get_offset(), 0, GetByteSize());
+    GLCheckError();
+    if (GLStateCache::GetCurrent() == nullptr) {
+      GLStateCache::BindBuffer(GL_COPY_READ_BUFFER, 0);
+      GLStateCache::BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+  } else {
+    capacity_ = 0;
+  }
+
+  NextGeneration();
+  arena_->Free(slice_);
+  slice_ = nullptr;
+  arena_ = nullptr;
+}
+
+size_t GLBuffer::GetArenaAlignment() const {
+  const size_t alignment = GLBufferArena::kAlignment;
+  if (target_ != GL_ARRAY_BUFFER || size_.empty()) {
+    return alignment;
+  }
+
+  const size_t row_size =
+      GetTypeSize(gltype_) * ((size_.size() > 1) ? size_[1] : 1);
+  return alignment / gcd(alignment, row_size) * row_size;
+}
+
+void GLBuffer::AllocateStream(size_t size) {
+  if (!GLEW_VERSION_4_4 && !GLEW_ARB_buffer_storage) {
+    throw Error("Stream buffers need OpenGL 4.4 or ARB_buffer_storage");
+  }
+
+  ModificationStamp::Touch();
+  if (stream_slots_.empty()) {
+    glDeleteBuffers(1, &buffer_id_);
+    GLCheckError();
+    GLStateCache::NotifyDeleted();
+  } else {
+    ReleaseStream();
+  }
+
+  // The copy target doesn't touch the bound VAO's element buffer.
+  const GLbitfield flags =
+      GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  stream_slots_.resize(kStreamRingSize);
+  for (StreamSlot &slot : stream_slots_) {
+    glGenBuffers(1, &slot.buffer);
+    GLStateCache::BindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+    GLCheckError();
+    slot.data = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+    GLCheckError();
+  }
+  if (GLStateCache::GetCurrent() == nullptr) {
+    GLStateCache::BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  capacity_ = size;
+  stream_current_ = 0;
+  stream_writing_ = -1;
+  buffer_id_ = stream_slots_[stream_current_].buffer;
+  NextGeneration();
+}
+
+torch::Tensor GLBuffer::BeginStreamWrite() {
+  if (stream_slots_.empty()) {
+    throw Error("Only allocated stream buffers can be written as streams");
+  }
+
+  if (stream_writing_ < 0) {
+    stream_writing_ = (stream_current_ + 1) % stream_slots_.size();
+    map<const Context *, GLsync> fences;
+    {
+      lock_guard<mutex> lock(fence_mutex_);
+      fences.swap(stream_slots_[stream_writing_].fences);
+    }
+
+    // Waits every context's draws, as they finish in any order.
+    bool wait_failed = false;
+    for (auto &context_fence : fences) {
+      GLenum wait_result;
+      do {
+        wait_result =
+            glClientWaitSync(context_fence.second, GL_SYNC_FLUSH_COMMANDS_BIT,
+                             kFenceWaitTimeout);
+      } while (wait_result == GL_TIMEOUT_EXPIRED);
+      glDeleteSync(context_fence.second);
+      wait_failed = wait_failed || (wait_result == GL_WAIT_FAILED);
+    }
+
+    if (wait_failed) {
+      stream_writing_ = -1;
+      throw Error("Waiting the stream buffer's draws failed");
+    }
+  }
+
+  return torch::from_blob(
+      stream_slots_[stream_writing_].data, size_,
+      torch::TensorOptions().dtype(cast_type<torch::ScalarType>(gltype_)));
+}
+
+void GLBuffer::EndStreamWrite() {
+  if (stream_writing_ < 0) {
+    return;
+  }
+
+  {
+    // So draws fence the slot they read.
+    lock_guard<mutex> lock(fence_mutex_);
+    stream_current_ = stream_writing_;
+  }
+  stream_writing_ = -1;
+  buffer_id_ = stream_slots_[stream_current_].buffer;
+  NextGeneration();
+
+  ModificationStamp::Touch();
+  RenderStats::CountUpload(GetByteSize());
+}
+
+void GLBuffer::FenceStream() {
+  if (stream_slots_.empty()) {
+    return;
+  }
+
+  // A context's commands finish in order, so its last fence covers
+  // its previous ones.
+  const GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  GLCheckError();
+
+  lock_guard<mutex> lock(fence_mutex_);
+  GLsync &slot_fence =
+      stream_slots_[stream_current_].fences[Context::GetCurrent()];
+  if (slot_fence != nullptr) {
+    glDeleteSync(slot_fence);
+  }
+  slot_fence = fence;
+}
+
+#ifdef TENVIZ_WITH_CUDA
+cudaGraphicsResource_t GLBuffer::GetCudaResource() {
   if (cuda_resource_ == nullptr) {
     CudaSafeCall(cudaGraphicsGLRegisterBuffer(&cuda_resource_, buffer_id_,
                                               cudaGraphicsMapFlagsNone));
   }
+  return cuda_resource_;
 }
+#endif
 
 std::shared_ptr<CudaMappedTensor> GLBuffer::AsTensor() {
+  if (is_stream()) {
+    throw Error("Stream buffers can't be mapped, use BeginStreamWrite");
+  }
+
+  if (arena_ != nullptr) {
+    LeaveArena(true);
+  }
+
+#ifdef TENVIZ_WITH_CUDA
   void *data;
   size_t size;
 
-  CudaSafeCall(cudaGraphicsMapResources(1, &cuda_resource_));
+  cudaGraphicsResource_t cuda_resource = GetCudaResource();
+  CudaSafeCall(cudaGraphicsMapResources(1, &cuda_resource));
   CudaSafeCall(
-      cudaGraphicsResourceGetMappedPointer(&data, &size, cuda_resource_));
+      cudaGraphicsResourceGetMappedPointer(&data, &size, cuda_resource));
 
-  auto map = make_shared<CudaMappedTensor>(cuda_resource_);
+  auto map = make_shared<CudaMappedTensor>(cuda_resource);
   auto opts = torch::TensorOptions(torch::kCUDA, 0)
                   .dtype(cast_type<torch::ScalarType>(gltype_));
   map->tensor = torch::from_blob(data, size_, opts);
 
   return map;
+#else
+  throw Error("Mapping buffers as tensors needs tenviz built with CUDA");
+#endif
+}
+
+namespace {
+/**
+ * Minimum number of indices narrowed by each thread.
+ */
+const int64_t kNarrowGrain = 1 << 16;
+
+/**
+ * @return Whatever the type is one of the unsigned index types chosen
+ * by NarrowIndices.
+ */
+bool IsNarrowedIndexType(GLenum gltype) {
+  return gltype == GL_UNSIGNED_SHORT || gltype == GL_UNSIGNED_INT;
 }
 
-void GLBuffer::FromTensor(const torch::Tensor &tensor) {
-  gltype_ = cast_type<GLenum>(tensor.scalar_type());
+/**
+ * Calls the function with a value of the C++ type of the integer
+ * tensor type.
+ */
+template <typename Function>
+void DispatchIndexType(torch::ScalarType type, Function function) {
+  switch (type) {
+    case torch::kInt64:
+      function(int64_t());
+      break;
+    case torch::kInt32:
+      function(int32_t());
+      break;
+    case torch::kInt16:
+      function(int16_t());
+      break;
+    case torch::kUInt8:
+      function(uint8_t());
+      break;
+    default:
+      throw Error("Indices must be int64, int32, int16 or uint8 tensors");
+  }
+}
+
+/**
+ * @return The minimum and maximum of the indices, or [0, -1] if empty.
+ */
+pair<int64_t, int64_t> GetIndexRange(const torch::Tensor &indices) {
+  if (indices.numel() == 0) {
+    return make_pair(int64_t(0), int64_t(-1));
+  }
+
+  if (indices.is_cuda()) {
+    return make_pair(indices.min().item<int64_t>(),
+                     indices.max().item<int64_t>());
+  }
+
+  pair<int64_t, int64_t> range;
+  DispatchIndexType(indices.scalar_type(), [&](auto type) {
+    using Source = decltype(type);
+    const Source *values = indices.data_ptr<Source>();
+    range = at::parallel_reduce(
+        0, indices.numel(), kNarrowGrain,
+        make_pair(numeric_limits<int64_t>::max(),
+                  numeric_limits<int64_t>::min()),
+        [values](int64_t begin, int64_t end, pair<int64_t, int64_t> range) {
+          for (int64_t i = begin; i < end; ++i) {
+            range.first = min(range.first, int64_t(values[i]));
+            range.second = max(range.second, int64_t(values[i]));
+          }
+          return range;
+        },
+        [](pair<int64_t, int64_t> lfs, pair<int64_t, int64_t> rhs) {
+          return make_pair(min(lfs.first, rhs.first),
+                           max(lfs.second, rhs.second));
+        });
+  });
+  return range;
+}
+
+/**
+ * Converts indices to an unsigned OpenGL index type, checking their
+ * range.
+ *
+ * @param indices Integer tensor.
+ *
+ * @param index_type The type to convert to, GL_UNSIGNED_SHORT or
+ * GL_UNSIGNED_INT. GL_NONE picks the smallest one that holds the
+ * maximum index, and receives it.
+ *
+ * @return The indices' bits in a int16 or int32 tensor, contiguous and
+ * on the same device.
+ */
+torch::Tensor NarrowIndices(const torch::Tensor &indices,
+                            GLenum *index_type) {
+  const torch::Tensor source = indices.contiguous();
+  // Rejects non-integer types before reading the range.
+  DispatchIndexType(source.scalar_type(), [](auto) {});
+
+  const pair<int64_t, int64_t> range = GetIndexRange(source);
+  if (range.first < 0) {
+    stringstream msg;
+    msg << "Indices can't be negative, found " << range.first;
+    throw Error(msg);
+  }
+
+  if (*index_type == GL_NONE) {
+    *index_type = (range.second <= numeric_limits<uint16_t>::max())
+                      ? GL_UNSIGNED_SHORT
+                      : GL_UNSIGNED_INT;
+  }
+
+  const int64_t max_index = (*index_type == GL_UNSIGNED_SHORT)
+                                ? numeric_limits<uint16_t>::max()
+                                : numeric_limits<uint32_t>::max();
+  if (range.second > max_index) {
+    stringstream msg;
+    msg << "Index " << range.second << " doesn't fit the buffer's "
+        << GetTypeSize(*index_type) * 8 << " bits index type";
+    throw Error(msg);
+  }
+
+  const torch::ScalarType dtype = cast_type<torch::ScalarType>(*index_type);
+  if (source.scalar_type() == dtype) {
+    return source;
+  }
+
+  if (source.is_cuda()) {
+    // Values beyond the signed range wrap to the same bits.
+    return source.to(torch::kInt64).to(dtype);
+  }
+
+  torch::Tensor narrowed = torch::empty(source.sizes(), dtype);
+  DispatchIndexType(source.scalar_type(), [&](auto type) {
+    using Source = decltype(type);
+    const Source *values = source.data_ptr<Source>();
+    const auto narrow = [&](auto *dest) {
+      using Dest = typename remove_pointer<decltype(dest)>::type;
+      at::parallel_for(0, source.numel(), kNarrowGrain,
+                       [=](int64_t begin, int64_t end) {
+                         for (int64_t i = begin; i < end; ++i) {
+                           dest[i] = Dest(values[i]);
+                         }
+                       });
+    };
+    if (*index_type == GL_UNSIGNED_SHORT) {
+      narrow(reinterpret_cast<uint16_t *>(narrowed.data_ptr()));
+    } else {
+      narrow(reinterpret_cast<uint32_t *>(narrowed.data_ptr()));
+    }
+  });
+  return narrowed;
+}
+
+/**
+ * Converts the unsigned indices read from the buffer into the next
+ * larger signed type, so they keep their values.
+ */
+torch::Tensor WidenIndices(const torch::Tensor &indices, GLenum index_type) {
+  if (index_type == GL_UNSIGNED_SHORT) {
+    return indices.to(torch::kInt32).bitwise_and(0xFFFF);
+  } else if (index_type == GL_UNSIGNED_INT) {
+    return indices.to(torch::kInt64).bitwise_and(0xFFFFFFFFLL);
+  }
+  return indices;
+}
+}  // namespace
+
+void GLBuffer::FromTensor(const torch::Tensor &_tensor) {
+  GLenum gltype = GL_NONE;
+  torch::Tensor tensor = _tensor;
+  if (target_ == GL_ELEMENT_ARRAY_BUFFER) {
+    tensor = NarrowIndices(_tensor, &gltype);
+  } else {
+    gltype = cast_type<GLenum>(_tensor.scalar_type());
+  }
 
-  auto sizes = tensor.sizes();
-  size_.clear();
-  copy(sizes.begin(), sizes.end(), back_inserter(size_));
+  const auto sizes = tensor.sizes();
+  SetShape(gltype, vector<int64_t>(sizes.begin(), sizes.end()));
 
   const size_t size = GetTypeSize(gltype_) * tensor.numel();
 
@@ -175,43 +747,197 @@ void GLBuffer::FromTensor(const torch::Tensor &tensor) {
     return;
   }
 
-  AllocateImpl(size);
+  if (tensor.is_cuda() && arena_ != nullptr && slice_ == nullptr &&
+      IsCudaInteropAvailable()) {
+    // Keeps CUDA tensors' uploads on the device.
+    LeaveArena(false);
+  }
+
+  if (is_stream() && size <= capacity_) {
+    const torch::Tensor cpu_tensor = tensor.cpu().contiguous();
+    torch::Tensor slot = BeginStreamWrite();
+    memcpy(slot.data_ptr(), cpu_tensor.data_ptr(), size);
+    EndStreamWrite();
+    return;
+  }
+
+  RenderStats::CountUpload(size);
+  if (tensor.is_cuda() && UseCudaInterop()) {
+#ifdef TENVIZ_WITH_CUDA
+    AllocateImpl(size);
+    ScopedCudaMapper map(GetCudaResource());
+    cudaMemcpy(map.get(), tensor.contiguous().data_ptr(), size,
+               cudaMemcpyDeviceToDevice);
+#endif
+  } else {
+    // Uploads straight from the host memory.
+    const torch::Tensor cpu_tensor = tensor.cpu().contiguous();
+    AllocateImpl(size, cpu_tensor.data_ptr());
+  }
+}
+
+void GLBuffer::Update(const torch::Tensor &_tensor, int offset_rows) {
+  if (is_stream()) {
+    throw Error("Stream buffers must be fully rewritten");
+  }
+
+  if (is_empty()) {
+    throw Error("Buffer must be allocated before updating");
+  }
+
+  torch::Tensor tensor = _tensor;
+  if (target_ == GL_ELEMENT_ARRAY_BUFFER && IsNarrowedIndexType(gltype_)) {
+    GLenum index_type = gltype_;
+    tensor = NarrowIndices(_tensor, &index_type);
+  } else if (cast_type<GLenum>(tensor.scalar_type()) != gltype_) {
+    throw Error("Update tensor and buffer types must match");
+  }
+
+  const int64_t cols = (get_dim() == 2) ? size_[1] : 1;
+  if (tensor.numel() % cols != 0) {
+    throw Error("Update tensor must have the buffer's columns");
+  }
+
+  const int64_t rows = tensor.numel() / cols;
+  if (offset_rows < 0 || offset_rows + rows > size_[0]) {
+    stringstream msg;
+    msg << "Update rows [" << offset_rows << ", " << offset_rows + rows
+        << ") are out of the buffer's " << size_[0] << " rows";
+    throw Error(msg);
+  }
+
+  if (rows == 0) {
+    return;
+  }
 
-  ScopedCudaMapper map(cuda_resource_);
-  if (tensor.device().is_cpu()) {
-    cudaMemcpy(map.get(), tensor.data_ptr(), size, cudaMemcpyHostToDevice);
+  const size_t row_size = GetTypeSize(gltype_) * cols;
+  const size_t offset = row_size * offset_rows;
+  const size_t size = row_size * rows;
+
+  ModificationStamp::Touch();
+  RenderStats::CountUpload(size);
+  if (tensor.is_cuda() && UseCudaInterop()) {
+#ifdef TENVIZ_WITH_CUDA
+    ScopedCudaMapper map(GetCudaResource());
+    cudaMemcpy(reinterpret_cast<uint8_t *>(map.get()) + offset,
+               tensor.contiguous().data_ptr(), size,
+               cudaMemcpyDeviceToDevice);
+#endif
   } else {
-    cudaMemcpy(map.get(), tensor.data_ptr(), size, cudaMemcpyDeviceToDevice);
+    const torch::Tensor cpu_tensor = tensor.cpu().contiguous();
+    Bind(true);
+    glBufferSubData(target_, get_offset() + offset, size,
+                    cpu_tensor.data_ptr());
+    GLCheckError();
+    Bind(false);
   }
 }
 
+#ifdef TENVIZ_WITH_CUDA
 void CUDAIndexPut(const torch::Tensor &indices, const torch::Tensor &tensor,
                   void *buffer_data);
+#endif
 
 namespace {
-template <typename ScalarType>
-void CPUIndexPut(const torch::Tensor &_indices, const torch::Tensor &_tensor,
-                 void *_gl_data) {
-  ScalarType *gl_data = reinterpret_cast<ScalarType *>(_gl_data);
-  const auto tensor = _tensor.cpu();
-  const auto tensor_a = tensor.accessor<ScalarType, 2>();
-
-  auto indices = _indices.cpu();
-  auto idx_a = indices.accessor<int64_t, 1>();
-
-  for (int i = 0; i < indices.size(0); ++i) {
-    const int idx = idx_a[i];
-    const size_t offset = tensor.size(1) * idx;
-
-    for (int j = 0; j < tensor.size(1); ++j) {
-      gl_data[offset + j] = tensor_a[i][j];
+/**
+ * Sequence of consecutive buffer rows, read or written as one block.
+ */
+struct RowRun {
+  int64_t row;       /**< First buffer row. */
+  int64_t position;  /**< First position on the sorted indices. */
+  int64_t count;
+};
+
+/**
+ * Fewer runs than this are uploaded with glBufferSubData, without
+ * mapping the buffer.
+ */
+const size_t kMaxSubDataRuns = 8;
+
+/**
+ * Minimum number of runs copied by each thread.
+ */
+const int64_t kRunCopyGrain = 64;
+
+/**
+ * Coalesces sorted indices into runs of consecutive rows.
+ *
+ * @param sorted_indices Sorted int64 CPU tensor.
+ * @param skip_duplicates Whatever to keep only the first position of
+ * repeated indices, so no row is written twice.
+ */
+vector<RowRun> GetRowRuns(const torch::Tensor &sorted_indices,
+                          bool skip_duplicates) {
+  const auto indices_a = sorted_indices.accessor<int64_t, 1>();
+  vector<RowRun> runs;
+  for (int64_t pos = 0; pos < indices_a.size(0); ++pos) {
+    const int64_t row = indices_a[pos];
+    if (!runs.empty()) {
+      RowRun &run = runs.back();
+      const int64_t next_row = run.row + run.count;
+      if (skip_duplicates && row == next_row - 1) {
+        continue;
+      }
+      if (row == next_row && run.position + run.count == pos) {
+        ++run.count;
+        continue;
+      }
     }
+    runs.push_back({row, pos, 1});
   }
+  return runs;
+}
+
+/**
+ * Copies every run between the sorted rows and the buffer's mapped
+ * range, in parallel.
+ *
+ * @param runs The rows runs.
+ * @param row_size Row size in bytes.
+ * @param mapped Mapped buffer memory, starting at the first run's row.
+ * @param sorted_rows Contiguous rows in the runs' order.
+ * @param to_buffer Copy direction.
+ */
+void CopyRowRuns(const vector<RowRun> &runs, size_t row_size,
+                 uint8_t *mapped, uint8_t *sorted_rows, bool to_buffer) {
+  const int64_t first_row = runs.front().row;
+  at::parallel_for(0, runs.size(), kRunCopyGrain,
+                   [&](int64_t begin, int64_t end) {
+                     for (int64_t i = begin; i < end; ++i) {
+                       const RowRun &run = runs[i];
+                       uint8_t *buffer_ptr =
+                           mapped + (run.row - first_row) * row_size;
+                       uint8_t *rows_ptr =
+                           sorted_rows + run.position * row_size;
+                       if (to_buffer) {
+                         memcpy(buffer_ptr, rows_ptr, run.count * row_size);
+                       } else {
+                         memcpy(rows_ptr, buffer_ptr, run.count * row_size);
+                       }
+                     }
+                   });
 }
 }  // namespace
 
+torch::Tensor GLBuffer::GetCPUIndices(const torch::Tensor &indices) const {
+  torch::Tensor cpu_indices = indices.cpu().to(torch::kInt64).contiguous();
+  const int64_t min_index = cpu_indices.min().item<int64_t>();
+  const int64_t max_index = cpu_indices.max().item<int64_t>();
+  if (min_index < 0 || max_index >= size_[0]) {
+    stringstream msg;
+    msg << "Indices [" << min_index << ", " << max_index
+        << "] are out of the buffer's " << size_[0] << " rows";
+    throw Error(msg);
+  }
+  return cpu_indices;
+}
+
 void GLBuffer::IndexPut(const torch::Tensor &dst_indices,
                         const torch::Tensor &_tensor) {
+  if (is_stream()) {
+    throw Error("Stream buffers must be fully rewritten");
+  }
+
   if (dst_indices.size(0) != _tensor.size(0)) {
     throw Error("Put index and tensor must match sizes");
   }
@@ -229,66 +955,94 @@ void GLBuffer::IndexPut(const torch::Tensor &dst_indices,
     cols = size_[1];
   }
 
-  const torch::Tensor tensor = _tensor.view({-1, cols});
-  if (_tensor.device().is_cuda()) {
-    ScopedCudaMapper map(cuda_resource_);
+  torch::Tensor tensor = _tensor.view({-1, cols});
+  if (target_ == GL_ELEMENT_ARRAY_BUFFER && IsNarrowedIndexType(gltype_)) {
+    GLenum index_type = gltype_;
+    tensor = NarrowIndices(tensor, &index_type);
+  }
+
+  ModificationStamp::Touch();
+  RenderStats::CountUpload(tensor.numel() * tensor.element_size());
+  if (_tensor.device().is_cuda() && UseCudaInterop()) {
+#ifdef TENVIZ_WITH_CUDA
+    ScopedCudaMapper map(GetCudaResource());
 
     CUDAIndexPut(dst_indices, tensor, map.get());
+#endif
   } else {
-    ScopedGLBufferMap gl_map(target_, buffer_id_, GL_WRITE_ONLY);
-
-    auto type_id = tensor.options().dtype();
-    AT_DISPATCH_ALL_TYPES(tensor.scalar_type(), "CPUIndexPut", ([&] {
-                            CPUIndexPut<scalar_t>(dst_indices.cpu(), tensor,
-                                                  gl_map.data);
-                          }));
+    torch::Tensor sorted_indices, order;
+    std::tie(sorted_indices, order) = GetCPUIndices(dst_indices).sort();
+    const torch::Tensor sorted_rows =
+        tensor.cpu()
+            .to(cast_type<torch::ScalarType>(gltype_))
+            .index_select(0, order)
+            .contiguous();
+    const vector<RowRun> runs = GetRowRuns(sorted_indices, true);
+
+    const size_t row_size = GetTypeSize(gltype_) * cols;
+    uint8_t *rows_data = reinterpret_cast<uint8_t *>(sorted_rows.data_ptr());
+    if (runs.size() < kMaxSubDataRuns) {
+      Bind(true);
+      for (const RowRun &run : runs) {
+        glBufferSubData(target_, get_offset() + run.row * row_size,
+                        run.count * row_size,
+                        rows_data + run.position * row_size);
+        GLCheckError();
+      }
+      Bind(false);
+    } else {
+      const RowRun &last_run = runs.back();
+      const int64_t first_row = runs.front().row;
+      const int64_t last_row = last_run.row + last_run.count;
+      ScopedGLBufferMap gl_map(target_, get_buffer_id(),
+                               get_offset() + first_row * row_size,
+                               (last_row - first_row) * row_size,
+                               GL_MAP_WRITE_BIT);
+      CopyRowRuns(runs, row_size, gl_map.data, rows_data, true);
+    }
   }
 }
 
-torch::Tensor GLBuffer::ToTensor(bool keep_on_device) {
-  int total_size = 1;
-  for (int dimsize : size_) {
-    total_size *= dimsize;
-  }
-
-  total_size = GetTypeSize(gltype_) * total_size;
-
-  const torch::ScalarType dtype = cast_type<torch::ScalarType>(gltype_);
-  auto opts = torch::TensorOptions().dtype(dtype);
+bool GLBuffer::UseCudaInterop() const {
+  return IsCudaInteropAvailable() && !is_stream() && arena_ == nullptr;
+}
 
-  cudaMemcpyKind cpyKind = cudaMemcpyDeviceToHost;
-  if (keep_on_device) {
-    opts = opts.device(torch::kCUDA, 0);
-    cpyKind = cudaMemcpyDeviceToDevice;
+size_t GLBuffer::GetByteSize() const {
+  size_t size = GetTypeSize(gltype_);
+  for (int64_t dim_size : size_) {
+    size *= dim_size;
   }
-  torch::Tensor tensor = torch::empty(size_, opts);
-  ScopedCudaMapper map(cuda_resource_);
-  cudaMemcpy(tensor.data_ptr(), map.get(), total_size, cpyKind);
-  return tensor;
+  return size;
 }
 
-namespace {
-template <typename ScalarType>
-void CPUIndexSelect(ScalarType *gl_data, const torch::Tensor &_indices,
-                    torch::Tensor &tensor) {
-  auto tensor_a = tensor.accessor<ScalarType, 2>();
-
-  const auto indices = _indices.cpu();
-  auto idx_a = indices.accessor<int64_t, 1>();
-
-  for (int i = 0; i < indices.size(0); ++i) {
-    const int idx = idx_a[i];
-    const size_t offset = tensor.size(1) * idx;
+torch::Tensor GLBuffer::ToTensor(bool keep_on_device) {
+  const size_t total_size = GetByteSize();
 
-    for (int j = 0; j < tensor.size(1); ++j) {
-      tensor_a[i][j] = gl_data[offset + j];
-    }
+  const torch::ScalarType dtype = cast_type<torch::ScalarType>(gltype_);
+  torch::Tensor tensor;
+  if (keep_on_device && UseCudaInterop()) {
+#ifdef TENVIZ_WITH_CUDA
+    tensor = torch::empty(
+        size_, torch::TensorOptions().dtype(dtype).device(torch::kCUDA, 0));
+    ScopedCudaMapper map(GetCudaResource());
+    cudaMemcpy(tensor.data_ptr(), map.get(), total_size,
+               cudaMemcpyDeviceToDevice);
+#endif
+  } else {
+    tensor = torch::empty(size_, dtype);
+    Bind(true);
+    glGetBufferSubData(target_, get_offset(), total_size, tensor.data_ptr());
+    GLCheckError();
+    Bind(false);
   }
+  RenderStats::CountReadback(total_size);
+  return WidenIndices(tensor, gltype_);
 }
-}  // namespace
 
+#ifdef TENVIZ_WITH_CUDA
 void CUDAIndexSelect(const torch::Tensor &indices, const void *buffer_data,
                      torch::Tensor &tensor);
+#endif
 
 torch::Tensor GLBuffer::IndexSelect(torch::Tensor indices,
                                     bool keep_on_device) {
@@ -301,10 +1055,17 @@ torch::Tensor GLBuffer::IndexSelect(torch::Tensor indices,
   const int64_t result_dims[] = {indices.size(0), cols};
 
   if (indices.size(0) == 0) {
-    return torch::empty(result_dims, torch::TensorOptions(dtype));
+    return WidenIndices(torch::empty(result_dims, torch::TensorOptions(dtype)),
+                        gltype_);
+  }
+
+  if (is_stream()) {
+    // Its buffers are already mapped, so they're read by OpenGL.
+    return ToTensor(false).index_select(0, indices.cpu());
   }
 
-  if (keep_on_device) {
+  if (keep_on_device && UseCudaInterop()) {
+#ifdef TENVIZ_WITH_CUDA
     if (!indices.is_cuda()) {
       throw Error(
           "Indices tensor must be on GPU if `keep_on_device` is `true`.");
@@ -314,25 +1075,39 @@ torch::Tensor GLBuffer::IndexSelect(torch::Tensor indices,
         result_dims,
         torch::TensorOptions().device(torch::kCUDA, 0).dtype(dtype));
 
-    ScopedCudaMapper map(cuda_resource_);
+    ScopedCudaMapper map(GetCudaResource());
     CUDAIndexSelect(indices, map.get(), result);
+#endif
   } else {
-    if (indices.is_cuda()) {
+    if (!keep_on_device && indices.is_cuda()) {
       throw Error(
-          "Indices tensor must be on CPU if `keep_on_device` is `true`.");
+          "Indices tensor must be on CPU if `keep_on_device` is `false`.");
+    }
+    torch::Tensor sorted_indices, order;
+    std::tie(sorted_indices, order) = GetCPUIndices(indices).sort();
+    const vector<RowRun> runs = GetRowRuns(sorted_indices, false);
+    torch::Tensor sorted_rows = torch::empty(result_dims, dtype);
+
+    const size_t row_size = GetTypeSize(gltype_) * cols;
+    const RowRun &last_run = runs.back();
+    const int64_t first_row = runs.front().row;
+    const int64_t last_row = last_run.row + last_run.count;
+    {
+      ScopedGLBufferMap gl_map(target_, get_buffer_id(),
+                               get_offset() + first_row * row_size,
+                               (last_row - first_row) * row_size,
+                               GL_MAP_READ_BIT);
+      CopyRowRuns(runs, row_size, gl_map.data,
+                  reinterpret_cast<uint8_t *>(sorted_rows.data_ptr()), false);
     }
-    result = torch::empty(result_dims, dtype);
 
-    ScopedGLBufferMap glmap(target_, buffer_id_, GL_READ_ONLY);
-    AT_DISPATCH_ALL_TYPES(result.scalar_type(), "CPUIndexSelect", ([&] {
-                            CPUIndexSelect<scalar_t>(
-                                reinterpret_cast<scalar_t *>(glmap.data),
-                                indices, result);
-                          }));
+    result = torch::empty(result_dims, dtype);
+    result.index_copy_(0, order, sorted_rows);
   }
 
+  RenderStats::CountReadback(result.numel() * result.element_size());
   if (get_dim() == 1) result = result.squeeze();
-  return result;
+  return WidenIndices(result, gltype_);
 }
 
 }  // namespace tenviz
@@ -0,0 +1,253 @@
+#include "gl_buffer_arena.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include <torch/csrc/utils/pybind.h>
+
+#include "error.hpp"
+#include "gl_error.hpp"
+#include "gl_state_cache.hpp"
+#include "modification_stamp.hpp"
+
+using namespace std;
+
+namespace tenviz {
+
+namespace {
+size_t AlignSize(size_t size, size_t align = GLBufferArena::kAlignment) {
+  return ((size + align - 1) / align) * align;
+}
+
+/**
+ * The copy targets don't touch the bound VAO's element buffer.
+ */
+class ScopedCopyBuffers {
+ public:
+  ScopedCopyBuffers(GLuint read_buffer, GLuint write_buffer) {
+    GLStateCache::BindBuffer(GL_COPY_READ_BUFFER, read_buffer);
+    GLStateCache::BindBuffer(GL_COPY_WRITE_BUFFER, write_buffer);
+  }
+
+  ~ScopedCopyBuffers() {
+    if (GLStateCache::GetCurrent() == nullptr) {
+      GLStateCache::BindBuffer(GL_COPY_READ_BUFFER, 0);
+      GLStateCache::BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+  }
+};
+}  // namespace
+
+void GLBufferArena::RegisterPybind(
+    pybind11::module &m, IContextResource::PythonClassDef &base_class) {
+  pybind11::class_<GLBufferArena, shared_ptr<GLBufferArena>>(m, "BufferArena",
+                                                             base_class)
+      .def("defragment", &GLBufferArena::Defragment)
+      .def_property_readonly("block_count", &GLBufferArena::get_block_count)
+      .def_property_readonly("used_size", &GLBufferArena::get_used_size)
+      .def_property_readonly("allocated_size",
+                             &GLBufferArena::get_allocated_size);
+}
+
+GLBufferArena::GLBufferArena() : used_size_(0), released_(false) {}
+
+GLBufferArena::~GLBufferArena() { Release(); }
+
+shared_ptr<GLBufferArena::Slice> GLBufferArena::Allocate(size_t size,
+                                                        size_t alignment) {
+  if (released_) {
+    throw Error("Buffer arena was already released");
+  }
+
+  if (alignment == 0 || alignment % kAlignment != 0) {
+    throw Error("Arena slices' alignment must be a multiple of 16");
+  }
+
+  size = AlignSize(max(size, size_t(1)));
+
+  // Free ranges starting before the alignment are split.
+  auto fits = [size, alignment](const pair<const size_t, size_t> &free_range) {
+    const size_t offset = AlignSize(free_range.first, alignment);
+    return offset + size <= free_range.first + free_range.second;
+  };
+
+  Block *block = nullptr;
+  map<size_t, size_t>::iterator range;
+  for (Block &candidate : blocks_) {
+    range = find_if(candidate.free_ranges.begin(),
+                    candidate.free_ranges.end(), fits);
+    if (range != candidate.free_ranges.end()) {
+      block = &candidate;
+      break;
+    }
+  }
+
+  if (block == nullptr) {
+    block = CreateBlock(max(size, size_t(kBlockSize)));
+    range = block->free_ranges.begin();
+  }
+
+  const size_t range_offset = range->first;
+  const size_t range_end = range->first + range->second;
+  const size_t offset = AlignSize(range_offset, alignment);
+  block->free_ranges.erase(range);
+  if (offset > range_offset) {
+    block->free_ranges[range_offset] = offset - range_offset;
+  }
+  if (range_end > offset + size) {
+    block->free_ranges[offset + size] = range_end - offset - size;
+  }
+
+  shared_ptr<Slice> slice(new Slice);
+  slice->buffer_ = block->buffer;
+  slice->offset_ = offset;
+  slice->size_ = size;
+  slice->alignment_ = alignment;
+  slice->generation_ = 0;
+  slice->block_ = block;
+  block->slices.insert(slice.get());
+  used_size_ += size;
+
+  return slice;
+}
+
+void GLBufferArena::Free(const shared_ptr<Slice> &slice) {
+  if (released_ || slice == nullptr || slice->block_ == nullptr) {
+    return;
+  }
+
+  Block *block = slice->block_;
+  block->slices.erase(slice.get());
+  slice->block_ = nullptr;
+  used_size_ -= slice->size_;
+
+  size_t offset = slice->offset_;
+  size_t size = slice->size_;
+  auto next = block->free_ranges.lower_bound(offset);
+  if (next != block->free_ranges.end() && offset + size == next->first) {
+    size += next->second;
+    next = block->free_ranges.erase(next);
+  }
+
+  if (next != block->free_ranges.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == offset) {
+      offset = prev->first;
+      size += prev->second;
+      block->free_ranges.erase(prev);
+    }
+  }
+  block->free_ranges[offset] = size;
+
+  if (block->slices.empty() && blocks_.size() > 1) {
+    auto iter = find_if(blocks_.begin(), blocks_.end(),
+                        [block](const Block &b) { return &b == block; });
+    DeleteBlock(iter);
+  }
+}
+
+void GLBufferArena::Defragment() {
+  if (released_) {
+    return;
+  }
+
+  for (Block &block : blocks_) {
+    if (block.free_ranges.size() < 2) {
+      continue;
+    }
+
+    vector<Slice *> slices(block.slices.begin(), block.slices.end());
+    sort(slices.begin(), slices.end(), [](const Slice *lfs, const Slice *rhs) {
+      return lfs->offset_ < rhs->offset_;
+    });
+
+    GLuint new_buffer;
+    glGenBuffers(1, &new_buffer);
+    GLCheckError();
+
+    size_t offset = 0;
+    map<size_t, size_t> free_ranges;
+    {
+      ScopedCopyBuffers copy_bind(block.buffer, new_buffer);
+      glBufferData(GL_COPY_WRITE_BUFFER, block.size, nullptr,
+                   GL_DYNAMIC_DRAW);
+      GLCheckError();
+
+      for (Slice *slice : slices) {
+        const size_t aligned_offset = AlignSize(offset, slice->alignment_);
+        if (aligned_offset > offset) {
+          free_ranges[offset] = aligned_offset - offset;
+        }
+        offset = aligned_offset;
+
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            slice->offset_, offset, slice->size_);
+        GLCheckError();
+        slice->buffer_ = new_buffer;
+        slice->offset_ = offset;
+        ++slice->generation_;
+        offset += slice->size_;
+      }
+    }
+
+    glDeleteBuffers(1, &block.buffer);
+    GLCheckError();
+    GLStateCache::NotifyDeleted();
+
+    block.buffer = new_buffer;
+    block.free_ranges = move(free_ranges);
+    if (offset < block.size) {
+      block.free_ranges[offset] = block.size - offset;
+    }
+  }
+
+  ModificationStamp::Touch();
+}
+
+void GLBufferArena::Release() {
+  if (released_) {
+    return;
+  }
+
+  while (!blocks_.empty()) {
+    DeleteBlock(blocks_.begin());
+  }
+  used_size_ = 0;
+  released_ = true;
+}
+
+size_t GLBufferArena::get_allocated_size() const {
+  size_t size = 0;
+  for (const Block &block : blocks_) {
+    size += block.size;
+  }
+  return size;
+}
+
+GLBufferArena::Block *GLBufferArena::CreateBlock(size_t size) {
+  blocks_.emplace_back();
+  Block &block = blocks_.back();
+  block.size = size;
+  block.free_ranges[0] = size;
+
+  glGenBuffers(1, &block.buffer);
+  GLCheckError();
+  ScopedCopyBuffers copy_bind(0, block.buffer);
+  glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+  GLCheckError();
+
+  return &block;
+}
+
+void GLBufferArena::DeleteBlock(list<Block>::iterator block) {
+  for (Slice *slice : block->slices) {
+    slice->block_ = nullptr;
+  }
+
+  glDeleteBuffers(1, &block->buffer);
+  GLCheckError();
+  GLStateCache::NotifyDeleted();
+  blocks_.erase(block);
+}
+
+}  // namespace tenviz
@@ -1,6 +1,72 @@
 #include "gl_error.hpp"
 
+#include <iostream>
+
+using namespace std;
+
 namespace tenviz {
+
+#ifdef NDEBUG
+atomic<GLErrorMode> g_gl_error_mode(GLErrorMode::kDisabled);
+#else
+atomic<GLErrorMode> g_gl_error_mode(GLErrorMode::kCheck);
+#endif
+
+namespace {
+atomic<const char *> g_checkpoint_file(nullptr);
+atomic<int> g_checkpoint_line(0);
+
+void GLAPIENTRY DebugOutputCallback(GLenum source, GLenum type, GLuint id,
+                                    GLenum severity, GLsizei length,
+                                    const GLchar *message,
+                                    const void *user_param) {
+  // May be called from a driver thread, so it can't throw.
+  const char *file = g_checkpoint_file.load(memory_order_relaxed);
+  cerr << "GL error";
+  if (file != nullptr) {
+    cerr << " after " << file << "("
+         << g_checkpoint_line.load(memory_order_relaxed) << ")";
+  }
+  cerr << ": " << message << endl;
+}
+}  // namespace
+
+void SetGLErrorMode(GLErrorMode mode) { g_gl_error_mode = mode; }
+
+GLErrorMode GetGLErrorMode() { return g_gl_error_mode; }
+
+bool SetGLDebugOutput(bool enable) {
+  if (!GLEW_KHR_debug && !GLEW_VERSION_4_3) {
+    if (enable) {
+      static bool warned = false;
+      if (!warned) {
+        cerr << "GL debug output needs KHR_debug, errors won't be reported"
+             << endl;
+        warned = true;
+      }
+    }
+    return false;
+  }
+
+  if (!enable) {
+    glDisable(GL_DEBUG_OUTPUT);
+    return false;
+  }
+
+  glEnable(GL_DEBUG_OUTPUT);
+  glDebugMessageCallback(DebugOutputCallback, nullptr);
+  // Only errors, the other messages are noise for us.
+  glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr,
+                        GL_FALSE);
+  glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_ERROR, GL_DONT_CARE, 0,
+                        nullptr, GL_TRUE);
+  return true;
+}
+
+void SetGLCheckpoint(const char *file, int line) {
+  g_checkpoint_file.store(file, memory_order_relaxed);
+  g_checkpoint_line.store(line, memory_order_relaxed);
+}
 const char* GetGLErrorString(GLenum gl_err) {
   switch (gl_err) {
     case GL_NO_ERROR:
@@ -3,6 +3,7 @@
 #include <vector>
 
 #include "gl_error.hpp"
+#include "gl_state_cache.hpp"
 #include "scoped_bind.hpp"
 
 using namespace std;
@@ -10,15 +11,14 @@ using namespace std;
 namespace tenviz {
 
 namespace {
-inline void glCheckError(GLenum err, const char *file, const int line) {
-#ifndef NDEBUG
-  if (err != GL_NO_ERROR && err != GL_FRAMEBUFFER_COMPLETE) {
+void CheckFramebufferStatus(const char *file, const int line) {
+  const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
     stringstream format;
     format << "GL call " << file << "(" << line
-           << "): " << GetGLErrorString(err);
+           << "): " << GetGLErrorString(status);
     throw Error(format);
   }
-#endif
 }
 }  // namespace
 
@@ -39,7 +39,9 @@ void GLFramebuffer::RegisterPybind(
 
   py::class_<GLFramebuffer, shared_ptr<GLFramebuffer>>(m, "Framebuffer")
       .def("set_attachment", &GLFramebuffer::SetAttachment)
-      .def("set_size", &GLFramebuffer::SetSize)
+      .def("set_size", &GLFramebuffer::SetSize, py::arg("width"),
+           py::arg("height"), py::arg("layers") = 0)
+      .def_property_readonly("layers", &GLFramebuffer::get_layers)
       .def("get_attachs", &GLFramebuffer::GetAttachments)
       .def("get_depth", &GLFramebuffer::GetDepth)
       .def("__getitem__", &GLFramebuffer::GetAttachment);
@@ -49,6 +51,7 @@ void GLFramebuffer::RegisterPybind(
 
 GLFramebuffer::GLFramebuffer() {
   width_ = height_ = 0;
+  layers_ = 0;
   dirty_ = true;
   glGenFramebuffers(1, &fbo_);
   GLCheckError();
@@ -69,6 +72,7 @@ void GLFramebuffer::Release() {
 
   glDeleteFramebuffers(1, &fbo_);
   GLCheckError();
+  GLStateCache::NotifyDeleted();
   fbo_ = -1;
 }
 
@@ -83,20 +87,110 @@ void GLFramebuffer::SetAttachment(int attach_num, FramebufferTarget target) {
   }
 
   TargetEntry entry;
-  entry.texture = GLTexture::Create(TexTarget::kRectangle);
+  entry.texture = GLTexture::Create(layers_ > 0 ? k2DArray : kRectangle);
   entry.target = target;
 
   targets_[attach_num] = entry;
   dirty_ = true;
 }
 
-void GLFramebuffer::SetSize(int width, int height) {
-  if (width_ == width && height_ == height && !dirty_) {
-    return;
+namespace {
+void AllocateTarget(GLTexture &texture, FramebufferTarget target, int width,
+                    int height, int layers) {
+  GLenum internal_format, format, type;
+  switch (target) {
+    case kRGBAUint8:
+      internal_format = GL_RGBA8;
+      format = GL_RGBA;
+      type = GL_UNSIGNED_BYTE;
+      break;
+    case kRGBAFloat:
+      internal_format = GL_RGBA32F;
+      format = GL_RGBA;
+      type = GL_FLOAT;
+      break;
+    case kRGBAInt32:
+      internal_format = GL_RGBA32I;
+      format = GL_RGBA_INTEGER;
+      type = GL_INT;
+      break;
+
+    case kRGBUint8:
+      internal_format = GL_RGB8;
+      format = GL_RGB;
+      type = GL_UNSIGNED_BYTE;
+      break;
+    case kRGBFloat:
+      internal_format = GL_RGB32F;
+      format = GL_RGB;
+      type = GL_FLOAT;
+      break;
+    case kRGBInt32:
+      internal_format = GL_RGB32I;
+      format = GL_RGB_INTEGER;
+      type = GL_INT;
+      break;
+
+    case kRInt32:
+      internal_format = GL_LUMINANCE32I_EXT;
+      format = GL_LUMINANCE_INTEGER_EXT;
+      type = GL_INT;
+      break;
+    case kRUint32:
+      internal_format = GL_R32UI;
+      format = GL_RED_INTEGER;
+      type = GL_UNSIGNED_INT;
+      break;
+
+    case kRUint8:
+      internal_format = GL_R8UI;
+      format = GL_RED_INTEGER;
+      type = GL_UNSIGNED_BYTE;
+      break;
+    case kRFloat:
+    default:
+      internal_format = GL_R32F;
+      format = GL_RED;
+      type = GL_FLOAT;
+      break;
+  }
+
+  if (layers > 0) {
+    texture.TexImage3D(internal_format, width, height, layers, format, type,
+                       nullptr);
+  } else {
+    texture.TexImage(internal_format, width, height, format, type, nullptr);
   }
+}
 
-  glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+void AttachTexture(GLenum attachment, const GLTexture &texture, int layers,
+                   int layer) {
+  if (layers > 0) {
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, attachment, texture.get_id(), 0,
+                              layer);
+  } else {
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_RECTANGLE,
+                           texture.get_id(), 0);
+  }
   GLCheckError();
+}
+}  // namespace
+
+void GLFramebuffer::SetSize(int width, int height, int layers) {
+  if (width_ == width && height_ == height && layers_ == layers && !dirty_) {
+    return;
+  }
+
+  if ((layers > 0) != (layers_ > 0)) {
+    // Layered framebuffers need array textures.
+    const TexTarget tex_target = layers > 0 ? k2DArray : kRectangle;
+    for (auto &item : targets_) {
+      item.second.texture = GLTexture::Create(tex_target);
+    }
+    depth_ = GLTexture::Create(tex_target);
+  }
+
+  GLStateCache::BindFramebuffer(fbo_);
 
   for (auto item : targets_) {
     const int attach_num = item.first;
@@ -106,98 +200,70 @@ void GLFramebuffer::SetSize(int width, int height) {
     texture->SetParameters(GLTextureParameters(
         GL_NEAREST, GL_NEAREST, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, false));
 
-    switch (target) {
-      case kRGBAUint8:
-        texture->TexImage(GL_RGBA8, width, height, GL_RGBA, GL_UNSIGNED_BYTE,
-                          nullptr);
-        break;
-      case kRGBAFloat:
-        texture->TexImage(GL_RGBA32F, width, height, GL_RGBA, GL_FLOAT,
-                          nullptr);
-        break;
-      case kRGBAInt32:
-        texture->TexImage(GL_RGBA32I, width, height, GL_RGBA_INTEGER, GL_INT,
-                          nullptr);
-        break;
-
-      case kRGBUint8:
-        texture->TexImage(GL_RGB8, width, height, GL_RGB, GL_UNSIGNED_BYTE,
-                          nullptr);
-        break;
-      case kRGBFloat:
-        texture->TexImage(GL_RGB32F, width, height, GL_RGB, GL_FLOAT, nullptr);
-        break;
-      case kRGBInt32:
-        texture->TexImage(GL_RGB32I, width, height, GL_RGB_INTEGER, GL_INT,
-                          nullptr);
-        break;
-
-      case kRInt32:
-        texture->TexImage(GL_LUMINANCE32I_EXT, width, height,
-                          GL_LUMINANCE_INTEGER_EXT, GL_INT, nullptr);
-        break;
-      case kRUint32:
-        texture->TexImage(GL_R32UI, width, height, GL_RED_INTEGER,
-                          GL_UNSIGNED_INT, nullptr);
-        break;
-
-      case kRUint8:
-        texture->TexImage(GL_R8UI, width, height, GL_RED_INTEGER,
-                          GL_UNSIGNED_BYTE, nullptr);
-        break;
-      case kRFloat:
-        texture->TexImage(GL_R32F, width, height, GL_RED, GL_FLOAT, nullptr);
-        break;
-    }
-
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + attach_num,
-                           GL_TEXTURE_RECTANGLE, texture->get_id(), 0);
-    GLCheckError();
+    AllocateTarget(*texture, target, width, height, layers);
+    AttachTexture(GL_COLOR_ATTACHMENT0 + attach_num, *texture, layers, 0);
   }
 
   {
     depth_->SetParameters(GLTextureParameters(
         GL_NEAREST, GL_NEAREST, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, false));
-    depth_->TexImage(GL_DEPTH_COMPONENT24, width, height, GL_DEPTH_COMPONENT,
-                     GL_FLOAT, nullptr);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-                           GL_TEXTURE_RECTANGLE, depth_->get_id(), 0);
+    if (layers > 0) {
+      depth_->TexImage3D(GL_DEPTH_COMPONENT24, width, height, layers,
+                         GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    } else {
+      depth_->TexImage(GL_DEPTH_COMPONENT24, width, height, GL_DEPTH_COMPONENT,
+                       GL_FLOAT, nullptr);
+    }
+    AttachTexture(GL_DEPTH_ATTACHMENT, *depth_, layers, 0);
   }
 
-  glCheckError(glCheckFramebufferStatus(GL_FRAMEBUFFER), __FILE__, __LINE__);
+  CheckFramebufferStatus(__FILE__, __LINE__);
   GLCheckError();
 
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  GLCheckError();
+  GLStateCache::BindFramebuffer(0);
 
   width_ = width;
   height_ = height;
+  layers_ = layers;
   dirty_ = false;
 }
 
+void GLFramebuffer::SetLayer(int layer) {
+  if (layer < 0 || layer >= layers_) {
+    stringstream format;
+    format << "Invalid framebuffer layer " << layer;
+    throw Error(format);
+  }
+
+  for (const auto &item : targets_) {
+    AttachTexture(GL_COLOR_ATTACHMENT0 + item.first, *item.second.texture,
+                  layers_, layer);
+  }
+  AttachTexture(GL_DEPTH_ATTACHMENT, *depth_, layers_, layer);
+}
+
 void GLFramebuffer::Bind(bool bind) {
   if (!bind) {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    GLCheckError();
+    GLStateCache::BindFramebuffer(0);
     return;
   }
 
-  glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
-  GLCheckError();
+  GLStateCache::BindFramebuffer(fbo_);
 
   vector<GLenum> draw_buffers;
   draw_buffers.reserve(targets_.size());
   for (const auto &item : targets_) {
     const int attach_num = item.first;
     draw_buffers.push_back(GL_COLOR_ATTACHMENT0 + attach_num);
-    GLCheckError();
   }
 
   glDrawBuffers(draw_buffers.size(), &draw_buffers[0]);
   GLCheckError();
 
-  glCheckError(glCheckFramebufferStatus(GL_FRAMEBUFFER), __FILE__, __LINE__);
-  GLCheckError();
+  // The status query stalls, so it is only done when checking.
+  if (GetGLErrorMode() == GLErrorMode::kCheck) {
+    CheckFramebufferStatus(__FILE__, __LINE__);
+  }
 }
 
 map<int, shared_ptr<GLTexture>> GLFramebuffer::GetAttachments() {
@@ -0,0 +1,169 @@
+#include "gl_readback.hpp"
+
+#include <cstring>
+
+#include "dtype.hpp"
+#include "error.hpp"
+#include "gl_error.hpp"
+#include "gl_state_cache.hpp"
+#include "render_stats.hpp"
+
+using namespace std;
+
+namespace tenviz {
+
+namespace {
+const GLuint64 kFenceWaitTimeout = 100000000;  // ns
+
+/**
+ * Pixel pack buffers change the meaning of glGetTexImage's and
+ * glReadPixels' pointers, so they're never left bound.
+ */
+class ScopedPixelPackBuffer {
+ public:
+  ScopedPixelPackBuffer(GLuint pbo) {
+    GLStateCache::BindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+  }
+
+  ~ScopedPixelPackBuffer() {
+    GLStateCache::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+};
+}  // namespace
+
+void GLReadback::RegisterPybind(pybind11::module &m) {
+  pybind11::class_<GLReadback, shared_ptr<GLReadback>>(m, "Readback")
+      .def("get", &GLReadback::Get,
+           pybind11::call_guard<pybind11::gil_scoped_release>())
+      .def("is_ready", &GLReadback::IsReady);
+}
+
+GLReadback::GLReadback(GLuint pbo, const vector<int64_t> &sizes,
+                       torch::ScalarType dtype)
+    : pbo_(pbo), fence_(nullptr), sizes_(sizes), dtype_(dtype) {
+  resolved_ = false;
+}
+
+bool GLReadback::IsReady() {
+  if (resolved_) {
+    return true;
+  }
+
+  GLint status = GL_UNSIGNALED;
+  glGetSynciv(fence_, GL_SYNC_STATUS, sizeof(GLint), nullptr, &status);
+  GLCheckError();
+  return status == GL_SIGNALED;
+}
+
+torch::Tensor GLReadback::Get() {
+  Resolve();
+  return result_;
+}
+
+void GLReadback::Resolve() {
+  if (resolved_) {
+    return;
+  }
+
+  GLenum wait_result;
+  do {
+    wait_result = glClientWaitSync(fence_, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                   kFenceWaitTimeout);
+  } while (wait_result == GL_TIMEOUT_EXPIRED);
+  glDeleteSync(fence_);
+  fence_ = nullptr;
+
+  if (wait_result == GL_WAIT_FAILED) {
+    resolved_ = true;
+    throw Error("Waiting the texture readback failed");
+  }
+
+  result_ = torch::empty(sizes_, dtype_);
+  const size_t size = result_.numel() * result_.element_size();
+
+  ScopedPixelPackBuffer pack_bind(pbo_);
+  const void *data =
+      glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+  GLCheckError();
+  memcpy(result_.data_ptr(), data, size);
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  GLCheckError();
+
+  resolved_ = true;
+}
+
+GLReadbackRing::GLReadbackRing(int size) : slots_(size), next_slot_(0) {
+  if (size < 1) {
+    throw Error("Readback ring must have at least one buffer");
+  }
+}
+
+shared_ptr<GLReadback> GLReadbackRing::Read(GLenum target, GLuint texture,
+                                            GLenum format, GLenum type,
+                                            const vector<int64_t> &sizes,
+                                            torch::ScalarType dtype) {
+  Slot &slot = slots_[next_slot_];
+  next_slot_ = (next_slot_ + 1) % slots_.size();
+
+  if (slot.pending != nullptr) {
+    slot.pending->Resolve();
+    slot.pending = nullptr;
+  }
+
+  size_t size = GetTypeSize(dtype);
+  for (int64_t dim_size : sizes) {
+    size *= dim_size;
+  }
+
+  if (slot.pbo == 0) {
+    glGenBuffers(1, &slot.pbo);
+    GLCheckError();
+  }
+
+  ScopedPixelPackBuffer pack_bind(slot.pbo);
+  if (slot.capacity < size) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+    GLCheckError();
+    slot.capacity = size;
+  }
+
+  GLStateCache::BindTexture(target, texture);
+  // Tensors have no row padding. Restores the context's alignment,
+  // which synchronous texture reads rely on.
+  GLint pack_alignment;
+  glGetIntegerv(GL_PACK_ALIGNMENT, &pack_alignment);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  // With a pack buffer bound, the pointer is an offset into it.
+  glGetTexImage(target, 0, format, type, nullptr);
+  glPixelStorei(GL_PACK_ALIGNMENT, pack_alignment);
+  GLCheckError();
+  RenderStats::CountReadback(size);
+
+  shared_ptr<GLReadback> readback(new GLReadback(slot.pbo, sizes, dtype));
+  readback->fence_ = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  GLCheckError();
+  // Makes sure the fence reaches the GPU, so it gets signaled.
+  glFlush();
+
+  slot.pending = readback;
+  return readback;
+}
+
+void GLReadbackRing::Release() {
+  for (Slot &slot : slots_) {
+    if (slot.pending != nullptr) {
+      slot.pending->Resolve();
+      slot.pending = nullptr;
+    }
+
+    if (slot.pbo != 0) {
+      glDeleteBuffers(1, &slot.pbo);
+      GLCheckError();
+      GLStateCache::NotifyDeleted();
+      slot.pbo = 0;
+      slot.capacity = 0;
+    }
+  }
+}
+
+}  // namespace tenviz
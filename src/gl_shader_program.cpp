@@ -1,19 +1,131 @@
 #include "gl_shader_program.hpp"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <tuple>
 
+#include <boost/filesystem.hpp>
 #include <boost/format.hpp>
+#include <pybind11/stl.h>
 
+#include "context.hpp"
 #include "gl_error.hpp"
+#include "gl_state_cache.hpp"
+#include "gl_uniform_block.hpp"
 
 using namespace std;
+namespace fs = boost::filesystem;
 
 namespace tenviz {
 
+namespace {
+/**
+ * Uniform arrays are reported as "name[0]".
+ */
+string StripArraySuffix(const string &name) {
+  const size_t pos = name.rfind("[0]");
+  if (pos != string::npos && pos + 3 == name.size()) {
+    return name.substr(0, pos);
+  }
+  return name;
+}
+
+string FormatShape(const vector<int64_t> &shape) {
+  stringstream format;
+  format << "[";
+  for (size_t i = 0; i < shape.size(); ++i) {
+    format << ((i > 0) ? ", " : "") << shape[i];
+  }
+  format << "]";
+  return format.str();
+}
+
+/**
+ * Assigns a shared block's binding point.
+ *
+ * @return false if the program doesn't declare the block.
+ */
+bool BindUniformBlock(GLuint program_id, const char *name, GLuint binding) {
+  const GLuint index = glGetUniformBlockIndex(program_id, name);
+  GLCheckError();
+  if (index == GL_INVALID_INDEX) {
+    return false;
+  }
+
+  glUniformBlockBinding(program_id, index, binding);
+  GLCheckError();
+  return true;
+}
+
+/**
+ * Assigns a shared storage block's binding point.
+ *
+ * @return false if the program doesn't declare the block, or the
+ * driver lacks storage blocks.
+ */
+bool BindStorageBlock(GLuint program_id, const char *name, GLuint binding) {
+  if (!GLEW_ARB_shader_storage_buffer_object ||
+      !GLEW_ARB_program_interface_query) {
+    return false;
+  }
+
+  const GLuint index =
+      glGetProgramResourceIndex(program_id, GL_SHADER_STORAGE_BLOCK, name);
+  GLCheckError();
+  if (index == GL_INVALID_INDEX) {
+    return false;
+  }
+
+  glShaderStorageBlockBinding(program_id, index, binding);
+  GLCheckError();
+  return true;
+}
+
+/**
+ * Context and shader files of a program loaded by LoadFS.
+ */
+typedef tuple<const Context *, string, string, string> ProgramKey;
+
+mutex g_program_cache_mutex;
+map<ProgramKey, weak_ptr<GLShaderProgram>> g_program_cache;
+
+/**
+ * @return The file's absolute path without "." or "..", so different
+ * spellings of a file find the same program.
+ */
+string GetCanonicalPath(const string &filepath) {
+  if (filepath.empty()) {
+    return filepath;
+  }
+  return fs::weakly_canonical(fs::absolute(filepath)).string();
+}
+}  // namespace
+
 shared_ptr<GLShaderProgram> GLShaderProgram::LoadFS(
     const string &vertex_filepath, const string &frag_filepath,
     const string &geo_filepath) {
+  const ProgramKey key(Context::GetCurrent(), GetCanonicalPath(vertex_filepath),
+                       GetCanonicalPath(frag_filepath),
+                       GetCanonicalPath(geo_filepath));
+
+  lock_guard<mutex> lock(g_program_cache_mutex);
+  for (auto iter = g_program_cache.begin(); iter != g_program_cache.end();) {
+    // Programs of released contexts are dropped too, as a new context
+    // may take the same address.
+    shared_ptr<GLShaderProgram> cached = iter->second.lock();
+    if (cached == nullptr || cached->instance_.program_id == GLuint(-1)) {
+      iter = g_program_cache.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+
+  auto found = g_program_cache.find(key);
+  if (found != g_program_cache.end()) {
+    return found->second.lock();
+  }
+
   auto program = make_shared<GLShaderProgram>();
   if (!vertex_filepath.empty()) program->AddShader(kVertex, vertex_filepath);
   if (!frag_filepath.empty()) program->AddShader(kFragment, frag_filepath);
@@ -24,22 +136,78 @@ shared_ptr<GLShaderProgram> GLShaderProgram::LoadFS(
   program->Bind(true);
   program->Bind(false);
 
+  g_program_cache[key] = program;
   return program;
 }
 
 void GLShaderProgram::RegisterPybind(
     pybind11::module &m, IContextResource::PythonClassDef &base_class) {
   pybind11::class_<GLShaderProgram, shared_ptr<GLShaderProgram>>(
-      m, "GLShaderProgram", base_class);
+      m, "GLShaderProgram", base_class)
+      .def_property_readonly("attribs", &GLShaderProgram::get_attribs)
+      .def_property_readonly("uniforms", &GLShaderProgram::get_uniforms)
+      .def_property_readonly("uses_camera_block",
+                             &GLShaderProgram::UsesCameraBlock)
+      .def_property_readonly("uses_object_block",
+                             &GLShaderProgram::UsesObjectBlock)
+      .def_property_readonly("uses_object_buffer",
+                             &GLShaderProgram::UsesObjectBuffer);
+  pybind11::class_<Variable>(m, "ShaderVariable")
+      .def_readonly("name", &Variable::name)
+      .def_readonly("location", &Variable::location)
+      .def_readonly("type", &Variable::type)
+      .def_readonly("size", &Variable::size);
   m.def("load_program_fs", &GLShaderProgram::LoadFS);
 }
 
+bool GLShaderProgram::GetUniformShape(GLenum type,
+                                      torch::ScalarType *scalar_type,
+                                      vector<int64_t> *shape) {
+  switch (type) {
+    case GL_FLOAT:
+    case GL_FLOAT_VEC2:
+    case GL_FLOAT_VEC3:
+    case GL_FLOAT_VEC4:
+      *scalar_type = torch::kFloat;
+      *shape = {(type == GL_FLOAT) ? 1 : int64_t(type - GL_FLOAT_VEC2 + 2)};
+      return true;
+    case GL_INT:
+    case GL_INT_VEC2:
+    case GL_INT_VEC3:
+    case GL_INT_VEC4:
+      *scalar_type = torch::kInt32;
+      *shape = {(type == GL_INT) ? 1 : int64_t(type - GL_INT_VEC2 + 2)};
+      return true;
+    case GL_BOOL:
+    case GL_BOOL_VEC2:
+    case GL_BOOL_VEC3:
+    case GL_BOOL_VEC4:
+      *scalar_type = torch::kInt32;
+      *shape = {(type == GL_BOOL) ? 1 : int64_t(type - GL_BOOL_VEC2 + 2)};
+      return true;
+    case GL_FLOAT_MAT2:
+      *scalar_type = torch::kFloat;
+      *shape = {2, 2};
+      return true;
+    case GL_FLOAT_MAT3:
+      *scalar_type = torch::kFloat;
+      *shape = {3, 3};
+      return true;
+    case GL_FLOAT_MAT4:
+      *scalar_type = torch::kFloat;
+      *shape = {4, 4};
+      return true;
+    default:
+      return false;
+  }
+}
+
 GLShaderProgram::GLShaderProgram() {
-  program_id_ = glCreateProgram();
+  instance_.program_id = glCreateProgram();
   GLCheckError();
 
-  is_linked_ = false;
-  is_binded_ = false;
+  owner_ = Context::GetCurrent();
+  link_generation_ = 0;
 }
 
 GLShaderProgram::~GLShaderProgram() { Release(); }
@@ -60,82 +228,131 @@ void GLShaderProgram::AddShaderFromSource(ShaderType shader_type,
 }
 
 void GLShaderProgram::AddShader(shared_ptr<GLShader> shader) {
-  glAttachShader(program_id_, shader->get_shader_id());
+  glAttachShader(instance_.program_id, shader->get_shader_id());
   GLCheckError();
 
   shaders_.push_back(shader);
 }
 
 void GLShaderProgram::Release() {
-  if (program_id_ == -1) {
+  if (instance_.program_id == -1) {
     return;
   }
   GLCheckError();
-  glDeleteProgram(program_id_);
-  program_id_ = -1;
+  glDeleteProgram(instance_.program_id);
+  instance_.program_id = -1;
   GLCheckError();
+
+  // Programs live in the share group, so replicas are deleted here
+  // too.
+  for (auto &context_replica : replicas_) {
+    glDeleteProgram(context_replica.second.program_id);
+    GLCheckError();
+  }
+  replicas_.clear();
   shaders_.clear();
+  GLStateCache::NotifyDeleted();
+}
+
+GLShaderProgram::Instance &GLShaderProgram::GetCurrentInstance() {
+  const Context *current = Context::GetCurrent();
+  if (current == nullptr || current == owner_) {
+    return instance_;
+  }
+
+  lock_guard<mutex> lock(mutex_);
+  auto iter = replicas_.find(current);
+  if (iter == replicas_.end()) {
+    Instance replica;
+    replica.program_id = glCreateProgram();
+    GLCheckError();
+
+    for (auto shader : shaders_) {
+      glAttachShader(replica.program_id, shader->get_shader_id());
+      GLCheckError();
+    }
+
+    iter = replicas_.emplace(current, replica).first;
+  }
+  return iter->second;
 }
 
 void GLShaderProgram::Bind(bool bind_it) {
-  is_binded_ = false;
+  Instance &instance = GetCurrentInstance();
+  instance.is_binded = false;
   if (!bind_it) {
-    glUseProgram(0);
-    GLCheckError();
+    if (GLStateCache::GetCurrent() == nullptr) {
+      GLStateCache::UseProgram(0);
+    }
     return;
   }
 
   bool all_success = true;
-  bool link_dirty = false;
-  for (auto ls_iter = shaders_.begin(); ls_iter != shaders_.end(); ++ls_iter) {
-    shared_ptr<GLShader> shader = *ls_iter;
-    const GLShader::RecompileStatus recomp(shader->Recompile());
-    if (recomp.recompiled) {
-      link_dirty = true;
+  {
+    // Shaders are shared by every instance.
+    lock_guard<mutex> lock(mutex_);
+    bool link_dirty = false;
+    for (auto ls_iter = shaders_.begin(); ls_iter != shaders_.end();
+         ++ls_iter) {
+      shared_ptr<GLShader> shader = *ls_iter;
+      const GLShader::RecompileStatus recomp(shader->Recompile());
+      if (recomp.recompiled) {
+        link_dirty = true;
+      }
+      all_success = all_success && recomp.success;
+    }
+
+    if (link_dirty) {
+      ++link_generation_;
     }
-    all_success = all_success && recomp.success;
   }
 
   if (!all_success) return;
 
-  if (link_dirty) {
-    Link();
+  if (instance.link_generation != link_generation_) {
+    Link(instance);
   }
 
-  if (!is_linked_) return;
+  if (!instance.is_linked) return;
 
-  glUseProgram(program_id_);
-  GLCheckError();
+  GLStateCache::UseProgram(instance.program_id);
 
-  is_binded_ = bind_it;
+  instance.is_binded = bind_it;
 }
 
-bool GLShaderProgram::Link() {
-  glLinkProgram(program_id_);
+bool GLShaderProgram::Link() { return Link(GetCurrentInstance()); }
+
+bool GLShaderProgram::Link(Instance &instance) {
+  const GLuint program_id = instance.program_id;
+  instance.link_generation = link_generation_;
+
+  glLinkProgram(program_id);
   GLCheckError();
 
   GLint link_status = GL_FALSE;
-  glGetProgramiv(program_id_, GL_LINK_STATUS, &link_status);
+  glGetProgramiv(program_id, GL_LINK_STATUS, &link_status);
   GLCheckError();
 
+  lock_guard<mutex> lock(mutex_);
   last_link_log_.clear();
 
   if (link_status == GL_TRUE) {
     WriteLog("");
-    is_linked_ = true;
+    Reflect(instance);
+    instance.is_linked = true;
     return true;
   }
 
   GLint log_len;
-  glGetProgramiv(program_id_, GL_INFO_LOG_LENGTH, &log_len);
+  glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, &log_len);
   GLCheckError();
   last_link_log_.resize(log_len, '\0');
 
-  glGetProgramInfoLog(program_id_, log_len, NULL, &last_link_log_[0]);
+  glGetProgramInfoLog(program_id, log_len, NULL, &last_link_log_[0]);
   GLCheckError();
   WriteLog(last_link_log_);
 
-  is_linked_ = false;
+  instance.is_linked = false;
   return false;
 }
 
@@ -150,191 +367,244 @@ void GLShaderProgram::WriteLog(const string &log) {
   output.close();
 }
 
-bool GLShaderProgram::HasUniform(const std::string &name) const {
-  if (!is_linked_) return -1;
-  return glGetUniformLocation(program_id_, name.c_str()) > -1;
-}
-
-bool GLShaderProgram::HasAttrib(const std::string &name) const {
-  if (!is_linked_) return -1;
-  int loc = glGetAttribLocation(program_id_, name.c_str());
-  return loc > -1;
-}
+void GLShaderProgram::Reflect(Instance &instance) {
+  const GLuint program_id = instance.program_id;
+  instance.attribs.clear();
+  instance.uniforms.clear();
+  // Slots are looked up again on their next use.
+  instance.attrib_locations.clear();
+  instance.uniform_locations.clear();
+  // Linking resets the uniforms to their defaults.
+  instance.uniform_values.clear();
+
+  GLint max_length = 0;
+  glGetProgramiv(program_id, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_length);
+  GLint uniform_max_length = 0;
+  glGetProgramiv(program_id, GL_ACTIVE_UNIFORM_MAX_LENGTH,
+                 &uniform_max_length);
+  GLCheckError();
+  vector<GLchar> name_buffer(max(max_length, uniform_max_length) + 1, '\0');
 
-GLint GLShaderProgram::GetUniformLocation(const string &name) {
-  if (!is_linked_) return -1;
-  const GLint loc = glGetUniformLocation(program_id_, name.c_str());
+  GLint count = 0;
+  glGetProgramiv(program_id, GL_ACTIVE_ATTRIBUTES, &count);
   GLCheckError();
-  if (loc < 0) {
-    if (not_found_variables_.count(name) == 0) {
-      not_found_variables_.insert(name);
-      cerr << "Vertex uniform " << name << " not found" << endl;
-    }
+  for (GLint i = 0; i < count; ++i) {
+    Variable var;
+    GLsizei length = 0;
+    glGetActiveAttrib(program_id, i, GLsizei(name_buffer.size()), &length,
+                      &var.size, &var.type, name_buffer.data());
+    GLCheckError();
+    var.name = StripArraySuffix(string(name_buffer.data(), length));
+    var.location = glGetAttribLocation(program_id, var.name.c_str());
+    GLCheckError();
+    instance.attribs[var.name] = var;
   }
-  return loc;
-}
 
-GLint GLShaderProgram::GetAttribLocation(const string &name) {
-  if (!is_linked_) return -1;
-  const GLint loc = glGetAttribLocation(program_id_, name.c_str());
+  count = 0;
+  glGetProgramiv(program_id, GL_ACTIVE_UNIFORMS, &count);
   GLCheckError();
-  if (loc < 0) {
-    if (not_found_variables_.count(name) == 0) {
-      cerr << "Vertex attribute " << name << " not found" << endl;
-      not_found_variables_.insert(name);
-    }
+  for (GLint i = 0; i < count; ++i) {
+    Variable var;
+    GLsizei length = 0;
+    glGetActiveUniform(program_id, i, GLsizei(name_buffer.size()), &length,
+                       &var.size, &var.type, name_buffer.data());
+    GLCheckError();
+    var.name = StripArraySuffix(string(name_buffer.data(), length));
+    var.location = glGetUniformLocation(program_id, var.name.c_str());
+    GLCheckError();
+    instance.uniforms[var.name] = var;
   }
 
-  return loc;
+  instance.has_camera_block =
+      BindUniformBlock(program_id, CameraBlock::kName, kCameraBlockBinding);
+  instance.has_object_block =
+      BindUniformBlock(program_id, ObjectBlock::kName, kObjectBlockBinding);
+  instance.has_object_buffer = BindStorageBlock(
+      program_id, ObjectBlock::kBufferName, kObjectBufferBinding);
 }
 
-namespace {
-template <typename Scalar>
-inline void SetUniform1(int loc, torch::TensorAccessor<Scalar, 1> acs) {
-  assert(false);
+void GLShaderProgram::ResolveSlots(const map<string, Variable> &variables,
+                                   const vector<string> &slot_names,
+                                   vector<GLint> *locations) {
+  for (size_t slot = locations->size(); slot < slot_names.size(); ++slot) {
+    auto iter = variables.find(slot_names[slot]);
+    locations->push_back((iter != variables.end()) ? iter->second.location
+                                                   : -1);
+  }
 }
 
-template <>
-inline void SetUniform1<float>(int loc, torch::TensorAccessor<float, 1> acs) {
-  glUniform1f(loc, acs[0]);
+vector<GLShaderProgram::Variable> GLShaderProgram::get_attribs() const {
+  vector<Variable> attribs;
+  for (const auto &name_var : instance_.attribs) {
+    attribs.push_back(name_var.second);
+  }
+  return attribs;
 }
 
-template <>
-inline void SetUniform1<int>(int loc, torch::TensorAccessor<int, 1> acs) {
-  glUniform1i(loc, acs[0]);
+vector<GLShaderProgram::Variable> GLShaderProgram::get_uniforms() const {
+  vector<Variable> uniforms;
+  for (const auto &name_var : instance_.uniforms) {
+    uniforms.push_back(name_var.second);
+  }
+  return uniforms;
 }
 
-template <typename Scalar>
-inline void SetUniform2(int loc, torch::TensorAccessor<Scalar, 1> acs) {
-  assert(false);
+bool GLShaderProgram::HasUniform(const std::string &name) const {
+  // Unlinked programs accept anything, so items are kept while the
+  // shaders are fixed.
+  if (!instance_.is_linked) return true;
+  return instance_.uniforms.count(name) > 0;
 }
 
-template <>
-inline void SetUniform2<float>(int loc, torch::TensorAccessor<float, 1> acs) {
-  glUniform2f(loc, acs[0], acs[1]);
-  GLCheckError();
+bool GLShaderProgram::HasAttrib(const std::string &name) const {
+  if (!instance_.is_linked) return true;
+  return instance_.attribs.count(name) > 0;
 }
 
-template <>
-inline void SetUniform2<int>(int loc, torch::TensorAccessor<int, 1> acs) {
-  glUniform2i(loc, acs[0], acs[1]);
-  GLCheckError();
+const GLShaderProgram::Variable *GLShaderProgram::FindUniform(
+    const string &name) const {
+  auto iter = instance_.uniforms.find(name);
+  return (iter != instance_.uniforms.end()) ? &iter->second : nullptr;
 }
 
-template <typename Scalar>
-inline void SetUniform3(int loc, torch::TensorAccessor<Scalar, 1> acs) {
-  assert(false);
+const GLShaderProgram::Variable *GLShaderProgram::FindAttrib(
+    const string &name) const {
+  auto iter = instance_.attribs.find(name);
+  return (iter != instance_.attribs.end()) ? &iter->second : nullptr;
 }
 
-template <>
-inline void SetUniform3<float>(int loc, torch::TensorAccessor<float, 1> acs) {
-  glUniform3f(loc, acs[0], acs[1], acs[2]);
-  GLCheckError();
-}
+void GLShaderProgram::CheckUniformValue(const string &name,
+                                        const UniformValue &value) const {
+  const Variable *var = FindUniform(name);
+  torch::ScalarType scalar_type;
+  vector<int64_t> shape;
+  if (var == nullptr || var->size > 1 ||
+      !GetUniformShape(var->type, &scalar_type, &shape)) {
+    return;
+  }
 
-template <>
-inline void SetUniform3<int>(int loc, torch::TensorAccessor<int, 1> acs) {
-  glUniform3i(loc, acs[0], acs[1], acs[2]);
-  GLCheckError();
+  if (value.get_scalar_type() != scalar_type || value.get_shape() != shape) {
+    stringstream format;
+    format << "Uniform `" << name << "` expects a "
+           << ((scalar_type == torch::kFloat) ? "float32" : "int32")
+           << " tensor of shape " << FormatShape(shape);
+    throw Error(format);
+  }
 }
 
-template <typename Scalar>
-inline void SetUniform4(int loc, torch::TensorAccessor<Scalar, 1> acs) {
-  assert(false);
+int GLShaderProgram::GetUniformSlot(const string &name) {
+  lock_guard<mutex> lock(mutex_);
+  auto iter = uniform_slots_.find(name);
+  if (iter == uniform_slots_.end()) {
+    iter = uniform_slots_.emplace(name, int(uniform_slot_names_.size())).first;
+    uniform_slot_names_.push_back(name);
+  }
+  return iter->second;
 }
 
-template <>
-inline void SetUniform4<float>(int loc, torch::TensorAccessor<float, 1> acs) {
-  glUniform4f(loc, acs[0], acs[1], acs[2], acs[3]);
-  GLCheckError();
+int GLShaderProgram::GetAttribSlot(const string &name) {
+  lock_guard<mutex> lock(mutex_);
+  auto iter = attrib_slots_.find(name);
+  if (iter == attrib_slots_.end()) {
+    iter = attrib_slots_.emplace(name, int(attrib_slot_names_.size())).first;
+    attrib_slot_names_.push_back(name);
+  }
+  return iter->second;
 }
 
-template <>
-inline void SetUniform4<int>(int loc, torch::TensorAccessor<int, 1> acs) {
-  glUniform4i(loc, acs[0], acs[1], acs[2], acs[3]);
-  GLCheckError();
+GLint GLShaderProgram::GetUniformLocation(int slot) {
+  Instance &instance = GetCurrentInstance();
+  if (!instance.is_linked) return -1;
+  if (size_t(slot) >= instance.uniform_locations.size()) {
+    lock_guard<mutex> lock(mutex_);
+    ResolveSlots(instance.uniforms, uniform_slot_names_,
+                 &instance.uniform_locations);
+  }
+  return instance.uniform_locations[slot];
 }
 
-}  // namespace
+GLint GLShaderProgram::GetAttribLocation(int slot) {
+  Instance &instance = GetCurrentInstance();
+  if (!instance.is_linked) return -1;
+  if (size_t(slot) >= instance.attrib_locations.size()) {
+    lock_guard<mutex> lock(mutex_);
+    ResolveSlots(instance.attribs, attrib_slot_names_,
+                 &instance.attrib_locations);
+  }
+  return instance.attrib_locations[slot];
+}
 
-void GLShaderProgram::SetUniform(const string &name,
-                                 const torch::Tensor &tensor) {
-  if (!is_binded_) return;
+GLint GLShaderProgram::GetUniformLocation(const string &name) {
+  const Instance &instance = GetCurrentInstance();
+  if (!instance.is_linked) return -1;
+  auto var = instance.uniforms.find(name);
+  const GLint loc =
+      (var != instance.uniforms.end()) ? var->second.location : -1;
+  if (loc < 0) {
+    if (not_found_variables_.count(name) == 0) {
+      not_found_variables_.insert(name);
+      cerr << "Vertex uniform " << name << " not found" << endl;
+    }
+  }
+  return loc;
+}
 
-  if (tensor.is_cuda()) {
-    stringstream msg;
-    msg << "Only CPU tensors can set uniforms: " << name;
-    throw Error(msg);
+GLint GLShaderProgram::GetAttribLocation(const string &name) {
+  const Instance &instance = GetCurrentInstance();
+  if (!instance.is_linked) return -1;
+  auto var = instance.attribs.find(name);
+  const GLint loc =
+      (var != instance.attribs.end()) ? var->second.location : -1;
+  if (loc < 0) {
+    if (not_found_variables_.count(name) == 0) {
+      cerr << "Vertex attribute " << name << " not found" << endl;
+      not_found_variables_.insert(name);
+    }
   }
 
-  const GLint location = GetUniformLocation(name);
-  const int ndims = tensor.ndimension();
+  return loc;
+}
 
-  if (ndims == 1) {
-    switch (tensor.scalar_type()) {
-      case torch::kFloat:
-      case torch::kInt32:
-        break;
-      default:
-        throw Error(
-            "Only float32 or int32 tensors can set scalar or vector uniforms");
-    }
+void GLShaderProgram::SetUniform(const string &name,
+                                 const torch::Tensor &tensor) {
+  SetUniform(GetUniformSlot(name), tensor);
+}
 
-    AT_DISPATCH_ALL_TYPES(tensor.scalar_type(), "Uniform", ([&] {
-                            const auto accessor =
-                                tensor.accessor<scalar_t, 1>();
-                            switch (tensor.size(0)) {
-                              case 1:
-                                SetUniform1<scalar_t>(location, accessor);
-                                break;
-                              case 2:
-                                SetUniform2<scalar_t>(location, accessor);
-                                break;
-                              case 3:
-                                SetUniform3<scalar_t>(location, accessor);
-                                break;
-                              case 4:
-                              default:
-                                SetUniform4<scalar_t>(location, accessor);
-                            }
-                          }));
-
-    if (glGetError() != GL_NO_ERROR) {
-      stringstream err;
-      err << "Uniform " << name
-          << ": cannot set value. Does the type matches the one in shader?";
-      throw Error(err);
-    }
-  } else if (ndims == 2) {
-    const int rows = tensor.size(0);
-    const int cols = tensor.size(1);
+void GLShaderProgram::SetUniform(int slot, const torch::Tensor &tensor) {
+  if (!is_binded()) return;
+  SetUniform(slot, UniformValue::FromTensor(tensor));
+}
 
-    if (tensor.scalar_type() != torch::kFloat) {
-      throw Error("Only float32 tensors can set matrix uniforms");
-    }
+void GLShaderProgram::SetUniform(int slot, const UniformValue &value) {
+  Instance &instance = GetCurrentInstance();
+  if (!instance.is_binded) return;
 
-    auto strides = tensor.strides();
-    // OpenGL matrices are ordered column-wise in memory.
-    GLenum transpose = GL_TRUE;
-    if (strides[0] < strides[1]) transpose = GL_FALSE;
+  const GLint location = GetUniformLocation(slot);
+  if (location < 0) return;
 
-    if (rows == 4 && cols == 4) {
-      glUniformMatrix4fv(location, 1, transpose, tensor.data_ptr<float>());
-      GLCheckError();
-    } else if (rows == 3 && cols == 3) {
-      glUniformMatrix3fv(location, 1, transpose, tensor.data_ptr<float>());
-      GLCheckError();
-    } else if (rows == 2 && cols == 2) {
-      glUniformMatrix2fv(location, 1, transpose, tensor.data_ptr<float>());
-      GLCheckError();
-    } else {
-      throw Error(
-          "Can't set uniform matrix using non square matrix or larger than 4.");
+  if (instance.uniform_values.size() <= size_t(slot)) {
+    instance.uniform_values.resize(slot + 1);
+  }
+  UniformValue &current = instance.uniform_values[slot];
+  if (current == value) return;
+
+  value.Upload(location);
+  if (GetGLErrorMode() == GLErrorMode::kCheck &&
+      glGetError() != GL_NO_ERROR) {
+    // Forgets the value, as it may be partially set.
+    current = UniformValue();
+
+    string name;
+    {
+      lock_guard<mutex> lock(mutex_);
+      name = uniform_slot_names_[slot];
     }
-    GLCheckError();
-  } else {
-    throw Error("Can't set uniform using a tensor larger than 2-dims");
+    stringstream err;
+    err << "Uniform " << name
+        << ": cannot set value. Does the type matches the one in shader?";
+    throw Error(err);
   }
+  current = value;
 }
 
 }  // namespace tenviz
@@ -0,0 +1,269 @@
+#include "gl_state_cache.hpp"
+
+#include <atomic>
+#include <limits>
+
+#include "gl_error.hpp"
+#include "render_stats.hpp"
+
+using namespace std;
+
+namespace tenviz {
+
+namespace {
+const GLuint kUnknown = numeric_limits<GLuint>::max();
+
+thread_local GLStateCache *g_current_cache = nullptr;
+atomic<int64_t> g_deletion_epoch(0);
+
+void SetPolygonOffsetMode(PolygonOffsetMode mode) {
+  if (mode == PolygonOffsetMode::kNone) {
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDisable(GL_POLYGON_OFFSET_LINE);
+    glDisable(GL_POLYGON_OFFSET_POINT);
+  } else {
+    glEnable(static_cast<GLenum>(mode));
+  }
+}
+
+void SetAlphaBlending(bool alpha_blending) {
+  if (alpha_blending) {
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  } else {
+    glDisable(GL_BLEND);
+  }
+}
+}  // namespace
+
+GLStateCache *GLStateCache::GetCurrent() { return g_current_cache; }
+
+GLStateCache *GLStateCache::SetCurrent(GLStateCache *cache) {
+  GLStateCache *previous = g_current_cache;
+  g_current_cache = cache;
+  return previous;
+}
+
+void GLStateCache::NotifyDeleted() {
+  g_deletion_epoch.fetch_add(1, memory_order_relaxed);
+}
+
+int64_t GLStateCache::GetDeletionEpoch() {
+  return g_deletion_epoch.load(memory_order_relaxed);
+}
+
+GLStateCache::GLStateCache() { Invalidate(); }
+
+void GLStateCache::Invalidate() {
+  program_ = vao_ = framebuffer_ = kUnknown;
+  buffers_.clear();
+  indexed_buffers_.clear();
+  vao_elements_.clear();
+  active_unit_ = -1;
+  textures_.clear();
+  enabled_textures_.clear();
+  has_style_ = false;
+  deletion_epoch_ = g_deletion_epoch.load(memory_order_relaxed);
+}
+
+void GLStateCache::Sync() {
+  if (deletion_epoch_ != g_deletion_epoch.load(memory_order_relaxed)) {
+    Invalidate();
+  }
+}
+
+void GLStateCache::UseProgram(GLuint program) {
+  GLStateCache *cache = g_current_cache;
+  if (cache != nullptr) {
+    cache->Sync();
+    if (cache->program_ == program) return;
+    cache->program_ = program;
+  }
+
+  glUseProgram(program);
+  GLCheckError();
+  RenderStats::CountStateChange();
+}
+
+void GLStateCache::BindBuffer(GLenum target, GLuint buffer) {
+  GLStateCache *cache = g_current_cache;
+  if (cache != nullptr) {
+    cache->Sync();
+    auto iter = cache->buffers_.find(target);
+    if (iter != cache->buffers_.end() && iter->second == buffer) return;
+    cache->buffers_[target] = buffer;
+    if (target == GL_ELEMENT_ARRAY_BUFFER && cache->vao_ != kUnknown) {
+      cache->vao_elements_[cache->vao_] = buffer;
+    }
+  }
+
+  glBindBuffer(target, buffer);
+  GLCheckError();
+  RenderStats::CountStateChange();
+}
+
+void GLStateCache::BindBufferBase(GLenum target, GLuint index,
+                                  GLuint buffer) {
+  GLStateCache *cache = g_current_cache;
+  if (cache != nullptr) {
+    cache->Sync();
+    const auto key = make_pair(target, index);
+    auto iter = cache->indexed_buffers_.find(key);
+    if (iter != cache->indexed_buffers_.end() && iter->second == buffer) {
+      return;
+    }
+    cache->indexed_buffers_[key] = buffer;
+    cache->buffers_[target] = buffer;
+  }
+
+  glBindBufferBase(target, index, buffer);
+  GLCheckError();
+  RenderStats::CountStateChange();
+}
+
+void GLStateCache::BindVertexArray(GLuint vao) {
+  GLStateCache *cache = g_current_cache;
+  if (cache != nullptr) {
+    cache->Sync();
+    if (cache->vao_ == vao) return;
+    cache->vao_ = vao;
+    // The element buffer binding is part of the vertex array state.
+    auto iter = cache->vao_elements_.find(vao);
+    if (iter != cache->vao_elements_.end()) {
+      cache->buffers_[GL_ELEMENT_ARRAY_BUFFER] = iter->second;
+    } else {
+      cache->buffers_.erase(GL_ELEMENT_ARRAY_BUFFER);
+    }
+  }
+
+  glBindVertexArray(vao);
+  GLCheckError();
+  RenderStats::CountStateChange();
+}
+
+void GLStateCache::BindFramebuffer(GLuint fbo) {
+  GLStateCache *cache = g_current_cache;
+  if (cache != nullptr) {
+    cache->Sync();
+    if (cache->framebuffer_ == fbo) return;
+    cache->framebuffer_ = fbo;
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  GLCheckError();
+  RenderStats::CountStateChange();
+}
+
+void GLStateCache::ActiveTexture(int unit) {
+  GLStateCache *cache = g_current_cache;
+  if (cache != nullptr) {
+    cache->Sync();
+    if (cache->active_unit_ == unit) return;
+    cache->active_unit_ = unit;
+  }
+
+  glActiveTexture(GL_TEXTURE0 + unit);
+  GLCheckError();
+}
+
+void GLStateCache::BindTexture(GLenum target, GLuint texture) {
+  GLStateCache *cache = g_current_cache;
+  if (cache != nullptr) {
+    cache->Sync();
+  }
+
+  if (cache != nullptr && cache->active_unit_ >= 0) {
+    const auto key = make_pair(cache->active_unit_, target);
+    auto iter = cache->textures_.find(key);
+    if (iter != cache->textures_.end() && iter->second == texture) return;
+    cache->textures_[key] = texture;
+  }
+
+  glBindTexture(target, texture);
+  GLCheckError();
+  RenderStats::CountStateChange();
+}
+
+void GLStateCache::EnableTexture(GLenum target) {
+  GLStateCache *cache = g_current_cache;
+  if (cache != nullptr) {
+    cache->Sync();
+  }
+
+  if (cache != nullptr && cache->active_unit_ >= 0) {
+    if (!cache->enabled_textures_.insert(make_pair(cache->active_unit_, target))
+             .second) {
+      return;
+    }
+  }
+
+  glEnable(target);
+  GLCheckError();
+}
+
+void GLStateCache::ApplyStyle(const Style &style) {
+  GLStateCache *cache = g_current_cache;
+  if (cache == nullptr || !cache->has_style_) {
+    glPolygonMode(GL_FRONT_AND_BACK, static_cast<GLenum>(style.polygon_mode));
+    glLineWidth(style.line_width);
+    glPointSize(style.point_size);
+    SetAlphaBlending(style.alpha_blending);
+    SetPolygonOffsetMode(style.polygon_offset_mode);
+    if (style.polygon_offset_mode != PolygonOffsetMode::kNone) {
+      glPolygonOffset(style.polygon_offset_factor, style.polygon_offset_units);
+    }
+
+    if (cache != nullptr) {
+      cache->style_ = style;
+      cache->has_style_ = true;
+    }
+    RenderStats::CountStateChange();
+    return;
+  }
+
+  Style &current = cache->style_;
+  bool changed = false;
+  if (current.polygon_mode != style.polygon_mode) {
+    glPolygonMode(GL_FRONT_AND_BACK, static_cast<GLenum>(style.polygon_mode));
+    changed = true;
+  }
+
+  if (current.line_width != style.line_width) {
+    glLineWidth(style.line_width);
+    changed = true;
+  }
+
+  if (current.point_size != style.point_size) {
+    glPointSize(style.point_size);
+    changed = true;
+  }
+
+  if (current.alpha_blending != style.alpha_blending) {
+    SetAlphaBlending(style.alpha_blending);
+    changed = true;
+  }
+
+  const bool offset_mode_changed =
+      current.polygon_offset_mode != style.polygon_offset_mode;
+  if (offset_mode_changed) {
+    // Disables the previous mode before enabling the new one.
+    SetPolygonOffsetMode(PolygonOffsetMode::kNone);
+    SetPolygonOffsetMode(style.polygon_offset_mode);
+    changed = true;
+  }
+
+  if (style.polygon_offset_mode != PolygonOffsetMode::kNone &&
+      (offset_mode_changed ||
+       current.polygon_offset_factor != style.polygon_offset_factor ||
+       current.polygon_offset_units != style.polygon_offset_units)) {
+    glPolygonOffset(style.polygon_offset_factor, style.polygon_offset_units);
+    changed = true;
+  }
+
+  if (changed) {
+    current = style;
+    RenderStats::CountStateChange();
+  }
+}
+
+}  // namespace tenviz
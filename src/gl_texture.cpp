@@ -2,12 +2,16 @@
 
 #include <cassert>
 
+#ifdef TENVIZ_WITH_CUDA
 #include <cuda.h>
 #include <cuda_runtime.h>
+#endif
 #include <stdexcept>
 
-#include "cuda_error.hpp"
 #include "dtype.hpp"
+#include "gl_state_cache.hpp"
+#include "modification_stamp.hpp"
+#include "render_stats.hpp"
 
 using namespace std;
 
@@ -16,6 +20,7 @@ namespace {
 const GLuint GL_SENTINEL = numeric_limits<GLuint>::max();
 }
 
+#ifdef TENVIZ_WITH_CUDA
 inline bool IsFomartCudaCompatible(GLenum format) {
   static std::set<GLenum> allowed_formats(
       {GL_RED, GL_RG, GL_RGB, GL_RGBA, GL_LUMINANCE, GL_ALPHA,
@@ -42,6 +47,7 @@ inline bool IsFomartCudaCompatible(GLenum format) {
 
   return allowed_formats.count(format) > 0;
 }
+#endif
 
 inline GLenum GetGLInternalFormat(int channels, torch::ScalarType dtype) {
   switch (channels) {
@@ -171,6 +177,7 @@ void GLTexture::RegisterPybind(pybind11::module &m,
       .def(py::init<TexTarget>())
       .def("to_tensor", &GLTexture::ToTensor, py::arg("keep_device") = true,
            py::arg("non_blocking") = false)
+      .def("to_tensor_async", &GLTexture::ToTensorAsync)
       .def("from_tensor", &GLTexture::FromTensor)
       .def_property("width", &GLTexture::get_width, nullptr)
       .def_property("height", &GLTexture::get_height, nullptr)
@@ -183,6 +190,7 @@ void GLTexture::RegisterPybind(pybind11::module &m,
       .value("k2D", TexTarget::k2D)
       .value("k3D", TexTarget::k3D)
       .value("Rectangle", TexTarget::kRectangle)
+      .value("k2DArray", TexTarget::k2DArray)
       .export_values();
 }
 
@@ -197,21 +205,24 @@ GLTexture::GLTexture(GLenum target) : target_(target) {
 
   cuda_resource_ = nullptr;
 
-  format_ = GL_NONE;
+  internal_format_ = format_ = GL_NONE;
   type_ = GL_NONE;
 }
 
 GLTexture::~GLTexture() { Release(); }
 
 void GLTexture::Release() {
-  if (cuda_resource_ != nullptr) {
-    CudaSafeCall(cudaGraphicsUnregisterResource(cuda_resource_));
-    cuda_resource_ = nullptr;
+  if (readback_ring_ != nullptr) {
+    readback_ring_->Release();
+    readback_ring_ = nullptr;
   }
 
+  UnregisterCuda();
+
   if (tex_ != GL_SENTINEL) {
     glDeleteTextures(1, &tex_);
     tex_ = GL_SENTINEL;
+    GLStateCache::NotifyDeleted();
   }
   GLCheckError();
 }
@@ -252,28 +263,25 @@ void GLTexture::SetParameters(const GLTextureParameters &parms) {
 
 void GLTexture::Bind(bool bind, int texture_unit) const {
   if (texture_unit > -1) {
-    glActiveTexture(GL_TEXTURE0 + texture_unit);
-    GLCheckError();
+    GLStateCache::ActiveTexture(texture_unit);
   }
 
   if (bind) {
-    glEnable(target_);
-    GLCheckError();
+    // Array textures have no fixed-function enable.
+    if (target_ != GL_TEXTURE_2D_ARRAY) {
+      GLStateCache::EnableTexture(target_);
+    }
 
-    glBindTexture(target_, tex_);
-    GLCheckError();
-  } else {
-    glBindTexture(target_, 0);
-    GLCheckError();
+    GLStateCache::BindTexture(target_, tex_);
+  } else if (GLStateCache::GetCurrent() == nullptr) {
+    GLStateCache::BindTexture(target_, 0);
   }
 }
 
 void GLTexture::TexImage(GLenum internal_format, int width, int height,
                          GLenum format, GLenum type, const void *data) {
-  if (cuda_resource_ != nullptr) {
-    CudaSafeCall(cudaGraphicsUnregisterResource(cuda_resource_));
-    cuda_resource_ = nullptr;
-  }
+  // The CUDA registration is redone by the next ToTensor.
+  UnregisterCuda();
 
   Bind(true);
   if (target_ == GL_TEXTURE_1D) {
@@ -284,8 +292,6 @@ void GLTexture::TexImage(GLenum internal_format, int width, int height,
                  data);
     GLCheckError();
 
-    CudaSafeCall(cudaGraphicsGLRegisterImage(&cuda_resource_, tex_, target_,
-                                             cudaGraphicsMapFlagsNone));
     glGenerateMipmap(GL_TEXTURE_2D);
     GLCheckError();
   } else {
@@ -299,13 +305,9 @@ void GLTexture::TexImage(GLenum internal_format, int width, int height,
     }
   }
 
-  if (IsFomartCudaCompatible(internal_format)) {
-    CudaSafeCall(cudaGraphicsGLRegisterImage(&cuda_resource_, tex_, target_,
-                                             cudaGraphicsMapFlagsNone));
-  }
-
   SetParameters(parms_);
   dim_ = Dim3(width, height, 1);
+  internal_format_ = internal_format;
   format_ = format;
   type_ = type;
   Bind(false);
@@ -318,14 +320,18 @@ void GLTexture::TexImage3D(GLenum internal_format, int width, int height,
   glTexImage3D(target_, 0, internal_format, width, height, depth, 0, format,
                type, data);
   GLCheckError();
-  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_REPEAT);
-  GLCheckError();
-  // SetParameters(parms_);
+  if (target_ == GL_TEXTURE_3D) {
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+    GLCheckError();
+  } else {
+    SetParameters(parms_);
+  }
   dim_ = Dim3(width, height, depth);
+  internal_format_ = internal_format;
   format_ = format;
   type_ = type;
   Bind(false);
@@ -364,10 +370,11 @@ int guess_image3d_channels(const torch::IntArrayRef &dims) {
 }  // namespace
 
 void GLTexture::FromTensor(torch::Tensor image) {
-  if (!image.is_contiguous()) {
-    image = image.contiguous();
-  }
+  // Uploads are done by OpenGL from the host memory.
+  image = image.cpu().contiguous();
   GLenum internal_format = GL_NONE;
+  RenderStats::CountUpload(image.numel() * image.element_size());
+  ModificationStamp::Touch();
 
   if (target_ == GL_TEXTURE_1D) {
     const int channels = guess_image2d_channels(image.sizes());
@@ -422,6 +429,7 @@ inline int GLformatToDepth(GLenum format) {
   }
 }
 }  // namespace
+#ifdef TENVIZ_WITH_CUDA
 template <>
 torch::ScalarType cast_type(CUarray_format format) {
   switch (format) {
@@ -454,14 +462,33 @@ torch::ScalarType cast_type(CUarray_format format) {
   }
 }
 
+#endif
+
 torch::Tensor GLTexture::ToTensor(bool keep_on_device, bool non_blocking) {
-  if (cuda_resource_ != nullptr) {
+#ifdef TENVIZ_WITH_CUDA
+  if (IsCudaInteropAvailable() &&
+      (target_ == GL_TEXTURE_2D || target_ == GL_TEXTURE_RECTANGLE) &&
+      IsFomartCudaCompatible(internal_format_)) {
+    if (cuda_resource_ == nullptr) {
+      CudaSafeCall(cudaGraphicsGLRegisterImage(
+          &cuda_resource_, tex_, target_, cudaGraphicsMapFlagsNone));
+    }
     return ToTensorCUDA(keep_on_device, non_blocking);
-  } else {
-    return ToTensorGL();
   }
+#endif
+  return ToTensorGL();
+}
+
+void GLTexture::UnregisterCuda() {
+#ifdef TENVIZ_WITH_CUDA
+  if (cuda_resource_ != nullptr) {
+    CudaSafeCall(cudaGraphicsUnregisterResource(cuda_resource_));
+    cuda_resource_ = nullptr;
+  }
+#endif
 }
 
+#ifdef TENVIZ_WITH_CUDA
 namespace {
 bool AreSizesEqual(const std::vector<int64_t> &lfs, torch::IntArrayRef rhs) {
   if (lfs.size() != rhs.size()) return false;
@@ -522,13 +549,14 @@ torch::Tensor GLTexture::ToTensorCUDA(bool keep_on_device, bool non_blocking) {
 
   if (!non_blocking) CudaSafeCall(cudaDeviceSynchronize());
   CudaSafeCall(cudaGraphicsUnmapResources(1, &cuda_resource_));
+  RenderStats::CountReadback(width_pitch * tex_tensor_.size(0));
   return tex_tensor_.squeeze();
 }
+#endif
 
-torch::Tensor GLTexture::ToTensorGL() {
+vector<int64_t> GLTexture::GetTensorSizes() const {
   vector<int64_t> dim_sizes;
 
-  const auto dtype = cast_type<torch::ScalarType>(type_);
   if (target_ == GL_TEXTURE_2D || target_ == GL_TEXTURE_RECTANGLE) {
     const int depth = GLformatToDepth(format_);
 
@@ -539,20 +567,43 @@ torch::Tensor GLTexture::ToTensorGL() {
     }
   } else if (target_ == GL_TEXTURE_3D) {
     dim_sizes = {dim_.get_height(), dim_.get_width(), dim_.get_depth()};
+  } else if (target_ == GL_TEXTURE_2D_ARRAY) {
+    const int depth = GLformatToDepth(format_);
+
+    dim_sizes = {dim_.get_depth(), dim_.get_height(), dim_.get_width()};
+    if (depth > 1) {
+      dim_sizes.push_back(depth);
+    }
   }
 
-  torch::Tensor tex_tensor = torch::empty(dim_sizes, dtype);
+  return dim_sizes;
+}
 
-  glBindTexture(target_, tex_);
-  GLCheckError();
+torch::Tensor GLTexture::ToTensorGL() {
+  const auto dtype = cast_type<torch::ScalarType>(type_);
+  torch::Tensor tex_tensor = torch::empty(GetTensorSizes(), dtype);
+
+  GLStateCache::BindTexture(target_, tex_);
 
   glGetTexImage(target_, 0, format_, type_, tex_tensor.data_ptr());
   GLCheckError();
+  RenderStats::CountReadback(tex_tensor.numel() * tex_tensor.element_size());
 
-  glBindTexture(target_, 0);
-  GLCheckError();
+  Bind(false);
 
   return tex_tensor;
 }
 
+shared_ptr<GLReadback> GLTexture::ToTensorAsync() {
+  if (readback_ring_ == nullptr) {
+    readback_ring_.reset(new GLReadbackRing);
+  }
+
+  shared_ptr<GLReadback> readback =
+      readback_ring_->Read(target_, tex_, format_, type_, GetTensorSizes(),
+                           cast_type<torch::ScalarType>(type_));
+  Bind(false);
+  return readback;
+}
+
 }  // namespace tenviz
@@ -0,0 +1,112 @@
+#include "gl_uniform_block.hpp"
+
+#include <cstring>
+
+#include "gl_error.hpp"
+#include "gl_state_cache.hpp"
+#include "render_stats.hpp"
+
+using namespace std;
+
+namespace tenviz {
+
+namespace {
+thread_local const FrameCamera *g_current_camera = nullptr;
+
+void StoreMatrix(const Eigen::Matrix4f &matrix, float *dest) {
+  // Eigen is column-major, as std140's mat4.
+  Eigen::Map<Eigen::Matrix4f> dest_map(dest);
+  dest_map = matrix;
+}
+
+Eigen::Matrix4f ComputeNormalMatrix(const Eigen::Matrix4f &matrix) {
+  Eigen::Matrix4f normal = Eigen::Matrix4f::Identity();
+  normal.topLeftCorner<3, 3>() =
+      matrix.topLeftCorner<3, 3>().inverse().transpose();
+  return normal;
+}
+}  // namespace
+
+static_assert(sizeof(CameraBlock) == 4 * 16 * sizeof(float),
+              "CameraBlock must match its std140 layout");
+static_assert(sizeof(ObjectBlock) == 2 * 16 * sizeof(float),
+              "ObjectBlock must match its std140 layout");
+
+const char *const CameraBlock::kName = "CameraBlock";
+
+CameraBlock::CameraBlock(const Eigen::Matrix4f &projection,
+                         const Eigen::Matrix4f &view) {
+  StoreMatrix(projection, this->projection);
+  StoreMatrix(view, this->view);
+  StoreMatrix(projection * view, projection_view);
+  StoreMatrix(ComputeNormalMatrix(view), normal_view);
+}
+
+const char *const ObjectBlock::kName = "ObjectBlock";
+
+const char *const ObjectBlock::kBufferName = "ObjectBuffer";
+
+ObjectBlock::ObjectBlock(const Eigen::Matrix4f &object) {
+  StoreMatrix(object, this->object);
+  StoreMatrix(ComputeNormalMatrix(object), normal_object);
+}
+
+void GLUniformBlock::Update(const void *data, size_t size) {
+  lock_guard<mutex> lock(mutex_);
+  if (ubo_ != 0 && data_.size() == size &&
+      memcmp(data_.data(), data, size) == 0) {
+    return;
+  }
+
+  if (ubo_ == 0) {
+    glGenBuffers(1, &ubo_);
+    GLCheckError();
+  }
+
+  // The copy target doesn't touch the bindings used by draws.
+  GLStateCache::BindBuffer(GL_COPY_WRITE_BUFFER, ubo_);
+  if (data_.size() != size) {
+    glBufferData(GL_COPY_WRITE_BUFFER, size, data, GL_DYNAMIC_DRAW);
+  } else {
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, data);
+  }
+  GLCheckError();
+
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  data_.assign(bytes, bytes + size);
+  RenderStats::CountUpload(size);
+}
+
+void GLUniformBlock::Bind(GLuint binding, GLenum target) const {
+  GLStateCache::BindBufferBase(target, binding, ubo_);
+}
+
+void GLUniformBlock::Release() {
+  lock_guard<mutex> lock(mutex_);
+  if (ubo_ != 0) {
+    glDeleteBuffers(1, &ubo_);
+    GLCheckError();
+    GLStateCache::NotifyDeleted();
+    ubo_ = 0;
+  }
+  data_.clear();
+}
+
+const FrameCamera *FrameCamera::GetCurrent() { return g_current_camera; }
+
+ScopedFrameCamera::ScopedFrameCamera(GLUniformBlock &camera_block,
+                                     const Eigen::Matrix4f &projection,
+                                     const Eigen::Matrix4f &view)
+    : previous_(g_current_camera) {
+  const CameraBlock block(projection, view);
+  camera_block.Update(&block, sizeof(block));
+  camera_block.Bind(kCameraBlockBinding);
+
+  camera_.view = view;
+  camera_.inverse_view = view.inverse();
+  g_current_camera = &camera_;
+}
+
+ScopedFrameCamera::~ScopedFrameCamera() { g_current_camera = previous_; }
+
+}  // namespace tenviz
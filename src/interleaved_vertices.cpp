@@ -0,0 +1,113 @@
+#include "interleaved_vertices.hpp"
+
+#include <cstring>
+#include <sstream>
+
+#include <ATen/Parallel.h>
+
+#include "dtype.hpp"
+#include "error.hpp"
+#include "gl_buffer.hpp"
+
+using namespace std;
+
+namespace tenviz {
+
+namespace {
+/**
+ * Minimum number of vertices packed by each thread.
+ */
+const int64_t kPackGrain = 4096;
+
+size_t AlignTo4(size_t size) { return (size + 3) & ~size_t(3); }
+}  // namespace
+
+InterleavedVertices::InterleavedVertices() {
+  buffer_ = GLBuffer::Create(BufferTarget::kArray, BufferUsage::kDynamic);
+  stride_ = 0;
+  vertex_count_ = 0;
+  generation_ = 0;
+}
+
+void InterleavedVertices::FromTensors(
+    const map<string, torch::Tensor> &attributes) {
+  vector<VertexAttrib> attribs;
+  vector<torch::Tensor> tensors;
+  size_t stride = 0;
+  int64_t vertex_count = -1;
+
+  for (const auto &name_tensor : attributes) {
+    const string &name = name_tensor.first;
+    torch::Tensor tensor = name_tensor.second;
+
+    switch (tensor.scalar_type()) {
+      case torch::kDouble:
+      case torch::kInt64: {
+        stringstream format;
+        format << "Attribute `" << name
+               << "` has a type that can't be assigned to GL buffers";
+        throw Error(format);
+      }
+      default:
+        break;
+    }
+
+    if (tensor.dim() == 1) {
+      tensor = tensor.view({-1, 1});
+    }
+
+    if (tensor.dim() != 2 || tensor.size(1) < 1 || tensor.size(1) > 4) {
+      stringstream format;
+      format << "Attribute `" << name << "` must have 1 to 4 channels";
+      throw Error(format);
+    }
+
+    if (vertex_count > -1 && tensor.size(0) != vertex_count) {
+      throw Error("Attributes vertices size doesn't match");
+    }
+    vertex_count = tensor.size(0);
+
+    VertexAttrib attrib;
+    attrib.name = name;
+    attrib.offset = stride;
+    attrib.channels = int(tensor.size(1));
+    attrib.gl_type = cast_type<GLenum>(tensor.scalar_type());
+    attrib.integer = attrib.gl_type == GL_INT;
+    attrib.normalize = attrib.gl_type != GL_FLOAT &&
+                       attrib.gl_type != GL_HALF_FLOAT && !attrib.integer;
+    attribs.push_back(attrib);
+
+    tensors.push_back(tensor.cpu().contiguous());
+    stride += AlignTo4(tensor.size(1) * tensor.element_size());
+  }
+
+  if (vertex_count < 1) {
+    throw Error("Interleaved vertices must have at least one vertex");
+  }
+
+  torch::Tensor packed = torch::empty(
+      {vertex_count, int64_t(stride)}, torch::TensorOptions(torch::kUInt8));
+  uint8_t *packed_data = packed.data_ptr<uint8_t>();
+  at::parallel_for(0, vertex_count, kPackGrain, [&](int64_t begin,
+                                                    int64_t end) {
+    for (size_t i = 0; i < attribs.size(); ++i) {
+      const torch::Tensor &tensor = tensors[i];
+      const size_t row_size = tensor.size(1) * tensor.element_size();
+      const uint8_t *src = reinterpret_cast<const uint8_t *>(tensor.data_ptr());
+      uint8_t *dst = packed_data + attribs[i].offset;
+      for (int64_t vertex = begin; vertex < end; ++vertex) {
+        memcpy(dst + vertex * stride, src + vertex * row_size, row_size);
+      }
+    }
+  });
+
+  buffer_->FromTensor(packed);
+  if (attribs != attribs_ || stride != stride_) {
+    ++generation_;
+  }
+  attribs_ = attribs;
+  stride_ = stride;
+  vertex_count_ = vertex_count;
+}
+
+}  // namespace tenviz
@@ -0,0 +1,7 @@
+#include "modification_stamp.hpp"
+
+namespace tenviz {
+
+std::atomic<int64_t> ModificationStamp::stamp_(0);
+
+}  // namespace tenviz
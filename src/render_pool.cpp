@@ -0,0 +1,189 @@
+#include "render_pool.hpp"
+
+#include <chrono>
+
+#include <pybind11/eigen.h>
+#include <pybind11/stl.h>
+
+#include "error.hpp"
+#include "gl_texture.hpp"
+#include "scene.hpp"
+
+using namespace std;
+
+namespace tenviz {
+
+void RenderPool::RegisterPybind(pybind11::module &m) {
+  py::class_<RenderFuture>(m, "RenderFuture")
+      .def("get", &RenderFuture::Get,
+           py::call_guard<py::gil_scoped_release>())
+      .def("ready", &RenderFuture::IsReady);
+
+  py::class_<RenderPool>(m, "RenderPool")
+      .def(py::init([](Context &share, int num_workers,
+                       const py::dict &attach_map, bool keep_on_device) {
+             // Framebuffer target maps are opaque types on the module.
+             map<int, FramebufferTarget> attachments;
+             for (auto item : attach_map) {
+               attachments[item.first.cast<int>()] =
+                   item.second.cast<FramebufferTarget>();
+             }
+             return new RenderPool(share, num_workers, attachments,
+                                   keep_on_device);
+           }),
+           py::arg("context"), py::arg("num_workers"), py::arg("attach_map"),
+           py::arg("keep_on_device") = false, py::keep_alive<1, 2>())
+      .def("submit", &RenderPool::Submit, py::arg("projection"),
+           py::arg("view"), py::arg("scene"), py::arg("width") = -1,
+           py::arg("height") = -1)
+      .def("submit_batch", &RenderPool::SubmitBatch, py::arg("projections"),
+           py::arg("views"), py::arg("scene"), py::arg("width") = -1,
+           py::arg("height") = -1)
+      .def("release", &RenderPool::Release,
+           py::call_guard<py::gil_scoped_release>())
+      .def_property_readonly("num_workers", &RenderPool::get_num_workers)
+      .def_readonly_static("DEPTH", &RenderPool::kDepth);
+}
+
+bool RenderFuture::IsReady() const {
+  return future_.wait_for(chrono::seconds(0)) == future_status::ready;
+}
+
+RenderPool::RenderPool(Context &share, int num_workers,
+                       const map<int, FramebufferTarget> &attachments,
+                       bool keep_on_device)
+    : attachments_(attachments), keep_on_device_(keep_on_device) {
+  if (num_workers < 1) {
+    throw Error("RenderPool needs at least one worker");
+  }
+
+  stopping_ = false;
+
+  // Window systems like GLFW only create contexts on the main thread,
+  // so only making them current is left to the workers.
+  for (int i = 0; i < num_workers; ++i) {
+    contexts_.emplace_back(new Context(share.get_width(), share.get_height(),
+                                       false, share.get_backend(), &share));
+    contexts_.back()->EnsureInitialized();
+  }
+
+  for (auto &context : contexts_) {
+    workers_.emplace_back(&RenderPool::WorkerLoop, this, context.get());
+  }
+}
+
+RenderFuture RenderPool::Submit(const Eigen::Matrix4f &projection,
+                                const Eigen::Matrix4f &view,
+                                shared_ptr<Scene> scene, int width,
+                                int height) {
+  if (scene == nullptr) {
+    throw Error("Scene is None");
+  }
+
+  Job job;
+  job.projection = projection;
+  job.view = view;
+  job.scene = scene;
+  job.width = width;
+  job.height = height;
+
+  RenderFuture future(job.promise.get_future().share());
+  {
+    lock_guard<mutex> lock(jobs_mutex_);
+    if (stopping_) {
+      throw Error("RenderPool was released");
+    }
+    jobs_.push_back(move(job));
+  }
+  jobs_cond_.notify_one();
+
+  return future;
+}
+
+vector<RenderFuture> RenderPool::SubmitBatch(const torch::Tensor &projections,
+                                             const torch::Tensor &views,
+                                             shared_ptr<Scene> scene,
+                                             int width, int height) {
+  if (projections.dim() != 3 || views.dim() != 3 ||
+      projections.size(0) != views.size(0)) {
+    throw Error("Projections and views must be [Kx4x4] tensors");
+  }
+
+  const torch::Tensor cpu_projections = projections.cpu();
+  const torch::Tensor cpu_views = views.cpu();
+
+  vector<RenderFuture> futures;
+  futures.reserve(projections.size(0));
+  for (long i = 0; i < projections.size(0); ++i) {
+    futures.push_back(Submit(from_tensorm4<float>(cpu_projections[i]),
+                             from_tensorm4<float>(cpu_views[i]), scene, width,
+                             height));
+  }
+
+  return futures;
+}
+
+void RenderPool::Release() {
+  {
+    lock_guard<mutex> lock(jobs_mutex_);
+    if (stopping_ && workers_.empty()) {
+      return;
+    }
+    stopping_ = true;
+  }
+  jobs_cond_.notify_all();
+
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+
+  // The workers detached their contexts, so this thread can release
+  // them.
+  contexts_.clear();
+}
+
+void RenderPool::WorkerLoop(Context *context) {
+  ScopedCurrent curr(*context);
+
+  shared_ptr<GLFramebuffer> framebuffer = GLFramebuffer::Create();
+  for (const auto &attachment : attachments_) {
+    framebuffer->SetAttachment(attachment.first, attachment.second);
+  }
+
+  while (true) {
+    Job job;
+    {
+      unique_lock<mutex> lock(jobs_mutex_);
+      jobs_cond_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+      if (jobs_.empty()) {
+        return;
+      }
+
+      job = move(jobs_.front());
+      jobs_.pop_front();
+    }
+
+    try {
+      context->Render(job.projection, job.view, framebuffer, job.scene,
+                      job.width, job.height);
+
+      // Textures reuse their download memory, so the results are
+      // copied before the next job.
+      RenderResult result;
+      for (const auto &attachment : framebuffer->GetAttachments()) {
+        result[attachment.first] =
+            attachment.second->ToTensor(keep_on_device_).clone();
+      }
+      result[kDepth] =
+          framebuffer->GetDepth()->ToTensor(keep_on_device_).clone();
+
+      job.scene = nullptr;
+      job.promise.set_value(move(result));
+    } catch (...) {
+      job.promise.set_exception(current_exception());
+    }
+  }
+}
+
+}  // namespace tenviz
@@ -0,0 +1,167 @@
+#include "render_stats.hpp"
+
+#include "anode.hpp"
+#include "gl_error.hpp"
+
+using namespace std;
+
+namespace tenviz {
+
+namespace {
+thread_local RenderStats *g_current_stats = nullptr;
+}
+
+RenderStats *RenderStats::GetCurrent() { return g_current_stats; }
+
+RenderStats *RenderStats::SetCurrent(RenderStats *stats) {
+  RenderStats *previous = g_current_stats;
+  g_current_stats = stats;
+  return previous;
+}
+
+RenderStats::RenderStats() {
+  current_buffer_ = 0;
+  node_depth_ = 0;
+  in_frame_ = false;
+  recording_ = false;
+  frame_count_ = 0;
+  gpu_time_ = 0.0;
+}
+
+void RenderStats::BeginFrame() {
+  in_frame_ = true;
+  node_depth_ = 0;
+
+  // Skips timing while the GPU is a whole ring behind.
+  QueryBuffer &buffer = query_buffers_[current_buffer_];
+  recording_ = !buffer.pending;
+  if (recording_) {
+    buffer.used = 0;
+    buffer.nodes.clear();
+  }
+}
+
+void RenderStats::EndFrame() {
+  in_frame_ = false;
+  frame_counters_ = counters_;
+  counters_.Reset();
+  frame_count_ += 1;
+
+  if (recording_) {
+    query_buffers_[current_buffer_].pending = true;
+    current_buffer_ = (current_buffer_ + 1) % kQueryRingSize;
+  }
+
+  // From the oldest frame, as results come in order.
+  for (int i = 0; i < kQueryRingSize; ++i) {
+    QueryBuffer &buffer =
+        query_buffers_[(current_buffer_ + i) % kQueryRingSize];
+    if (buffer.pending && !CollectQueries(buffer)) {
+      break;
+    }
+  }
+}
+
+void RenderStats::BeginNode(shared_ptr<ANode> node) {
+  BeginNodes({node});
+}
+
+void RenderStats::BeginNodes(const vector<shared_ptr<ANode>> &nodes) {
+  node_depth_ += 1;
+  if (!in_frame_ || !recording_ || node_depth_ > 1) {
+    return;
+  }
+
+  QueryBuffer &buffer = query_buffers_[current_buffer_];
+  if (buffer.used == buffer.queries.size()) {
+    GLuint query;
+    glGenQueries(1, &query);
+    GLCheckError();
+    buffer.queries.push_back(query);
+  }
+
+  glBeginQuery(GL_TIME_ELAPSED, buffer.queries[buffer.used]);
+  GLCheckError();
+  buffer.nodes.emplace_back(nodes.begin(), nodes.end());
+  buffer.used += 1;
+}
+
+void RenderStats::EndNode() {
+  node_depth_ -= 1;
+  if (!in_frame_ || !recording_ || node_depth_ > 0) {
+    return;
+  }
+
+  glEndQuery(GL_TIME_ELAPSED);
+  GLCheckError();
+}
+
+bool RenderStats::CollectQueries(QueryBuffer &buffer) {
+  if (buffer.used > 0) {
+    // Results come in order, so the last one tells about all.
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(buffer.queries[buffer.used - 1],
+                       GL_QUERY_RESULT_AVAILABLE, &available);
+    GLCheckError();
+    if (available != GL_TRUE) {
+      return false;
+    }
+
+    node_times_.clear();
+    gpu_time_ = 0.0;
+    for (size_t i = 0; i < buffer.used; ++i) {
+      GLuint64 elapsed_ns = 0;
+      glGetQueryObjectui64v(buffer.queries[i], GL_QUERY_RESULT, &elapsed_ns);
+      GLCheckError();
+
+      const double elapsed_ms = double(elapsed_ns) * 1.0e-6;
+      const vector<weak_ptr<ANode>> &nodes = buffer.nodes[i];
+      for (const weak_ptr<ANode> &node : nodes) {
+        node_times_.push_back(make_pair(node, elapsed_ms / nodes.size()));
+      }
+      gpu_time_ += elapsed_ms;
+    }
+  }
+
+  buffer.used = 0;
+  buffer.nodes.clear();
+  buffer.pending = false;
+  return true;
+}
+
+void RenderStats::Release() {
+  for (QueryBuffer &buffer : query_buffers_) {
+    if (!buffer.queries.empty()) {
+      glDeleteQueries(buffer.queries.size(), buffer.queries.data());
+      GLCheckError();
+    }
+    buffer.queries.clear();
+    buffer.nodes.clear();
+    buffer.used = 0;
+    buffer.pending = false;
+  }
+}
+
+pybind11::dict RenderStats::ToDict() const {
+  pybind11::dict node_times;
+  for (const auto &node_time : node_times_) {
+    shared_ptr<ANode> node = node_time.first.lock();
+    if (node != nullptr) {
+      node_times[pybind11::cast(node)] = node_time.second;
+    }
+  }
+
+  pybind11::dict stats;
+  stats["frame"] = frame_count_;
+  stats["draw_calls"] = frame_counters_.draw_calls;
+  stats["vertices"] = frame_counters_.vertices;
+  stats["state_changes"] = frame_counters_.state_changes;
+  stats["bytes_uploaded"] = frame_counters_.bytes_uploaded;
+  stats["bytes_read_back"] = frame_counters_.bytes_read_back;
+  stats["gpu_time"] = gpu_time_;
+  stats["node_times"] = node_times;
+
+  return stats;
+}
+
+}  // namespace tenviz
@@ -1,11 +1,24 @@
 #include "scene.hpp"
 
 #include "bounds_glrender.hpp"
+#include "draw_program.hpp"
+#include "modification_stamp.hpp"
+#include "render_stats.hpp"
 
 using namespace std;
 
 namespace tenviz {
 
+namespace {
+/**
+ * @return Whatever the node blends with what was drawn before it.
+ */
+bool IsAlphaBlended(const shared_ptr<ANode> &node) {
+  const DrawProgram *draw = dynamic_cast<const DrawProgram *>(node.get());
+  return draw != nullptr && draw->style.alpha_blending;
+}
+}  // namespace
+
 void Scene::RegisterPybind(
     pybind11::module &m,
     pybind11::class_<ANode, std::shared_ptr<ANode>> &anode) {
@@ -17,17 +30,32 @@ void Scene::RegisterPybind(
       .def("get_bounds", &Scene::GetBounds);
 }
 
-void Scene::Add(shared_ptr<ANode> node) { nodes_.insert(node); }
+void Scene::Add(shared_ptr<ANode> node) {
+  nodes_.insert(node);
+  ModificationStamp::Touch();
+}
 
-void Scene::Erase(shared_ptr<ANode> node) { nodes_.erase(node); }
+void Scene::Erase(shared_ptr<ANode> node) {
+  nodes_.erase(node);
+  ModificationStamp::Touch();
+}
 
-void Scene::Clear() { nodes_.clear(); }
+void Scene::Clear() {
+  nodes_.clear();
+  ModificationStamp::Touch();
+}
 
 void Scene::Draw(const Eigen::Matrix4f &projection,
                  const Eigen::Matrix4f &_view) {
   const Eigen::Matrix4f view = _view * transform;
+  DrawBatcher batcher(batch_cache_);
+  vector<shared_ptr<ANode>> blended_nodes;
   for (shared_ptr<ANode> node : nodes_) {
-    if (node->visible) {
+    if (node->visible && IsAlphaBlended(node)) {
+      // Drawn over the batched nodes, which may lie behind them.
+      blended_nodes.push_back(node);
+    } else if (node->visible && !batcher.Add(node)) {
+      ScopedNodeTimer timer(node);
       node->Draw(projection, view);
     }
 
@@ -40,6 +68,13 @@ void Scene::Draw(const Eigen::Matrix4f &projection,
       // DrawBox // TODO
     }
   }
+
+  batcher.Flush(projection, view);
+
+  for (shared_ptr<ANode> node : blended_nodes) {
+    ScopedNodeTimer timer(node);
+    node->Draw(projection, view);
+  }
 }
 
 Bounds Scene::GetBounds() const {
@@ -0,0 +1,344 @@
+#include "shared_buffer_channel.hpp"
+
+#ifdef TENVIZ_WITH_SHARED_MEMORY
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <sstream>
+
+#include "error.hpp"
+
+using namespace std;
+
+namespace tenviz {
+
+namespace {
+const uint32_t kMagic = 0x7456424d;  // "tVBM"
+const size_t kDataAlignment = 64;
+const char *const kNotSupported =
+    "Shared buffer channels need POSIX shared memory";
+
+size_t AlignUp(size_t size) {
+  return ((size + kDataAlignment - 1) / kDataAlignment) * kDataAlignment;
+}
+
+void ThrowSystemError(const string &what, const string &name) {
+  stringstream format;
+  format << what << " `" << name << "`: " << strerror(errno);
+  throw Error(format);
+}
+}  // namespace
+
+/**
+ * Placed at the start of the shared memory, followed by the slots'
+ * rows.
+ */
+struct SharedBufferChannel::Header {
+  struct Slot {
+    atomic<uint64_t> sequence; /**< Odd while being written. */
+    atomic<uint64_t> frame;
+  };
+
+  struct ChangedRows {
+    atomic<uint64_t> frame; /**< Zero while being written. */
+    atomic<int64_t> begin_row, end_row;
+  };
+
+  atomic<uint32_t> magic;
+  int32_t dtype;
+  int64_t rows, cols;
+  uint64_t slot_size;
+
+  atomic<uint64_t> frame;
+  atomic<int32_t> latest_slot;
+  Slot slots[kSlotCount];
+  ChangedRows history[kHistorySize];
+};
+
+static_assert(atomic<uint64_t>::is_always_lock_free,
+              "Shared memory counters must be lock free");
+
+void SharedBufferChannel::RegisterPybind(pybind11::module &m) {
+  pybind11::class_<SharedBufferChannel, shared_ptr<SharedBufferChannel>>(
+      m, "SharedBufferChannel")
+      .def_static("create", &SharedBufferChannel::Create, py::arg("name"),
+                  py::arg("rows"), py::arg("cols"), py::arg("dtype"))
+      .def_static("open", &SharedBufferChannel::Open, py::arg("name"))
+      .def("publish", &SharedBufferChannel::Publish, py::arg("tensor"),
+           py::arg("offset_row") = 0)
+      .def_property_readonly("frame", &SharedBufferChannel::get_frame)
+      .def_property_readonly("name", &SharedBufferChannel::get_name)
+      .def_property_readonly("rows", &SharedBufferChannel::get_rows)
+      .def_property_readonly("cols", &SharedBufferChannel::get_cols)
+      .def_property_readonly("dtype", &SharedBufferChannel::get_dtype);
+}
+
+shared_ptr<SharedBufferChannel> SharedBufferChannel::Create(
+    const string &name, int64_t rows, int64_t cols, DType dtype) {
+  if (rows <= 0 || cols < 1 || cols > 4) {
+    throw Error("Channel must have at least one row and 1 to 4 columns");
+  }
+
+#ifdef TENVIZ_WITH_SHARED_MEMORY
+  shared_ptr<SharedBufferChannel> channel(
+      new SharedBufferChannel(name, true));
+
+  shm_unlink(name.c_str());
+  channel->fd_ = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (channel->fd_ < 0) {
+    ThrowSystemError("Could not create shared memory", name);
+  }
+
+  const size_t slot_size =
+      AlignUp(GetTypeSize(cast_type<GLenum>(dtype)) * rows * cols);
+  const size_t size = AlignUp(sizeof(Header)) + slot_size * kSlotCount;
+  if (ftruncate(channel->fd_, size) != 0) {
+    ThrowSystemError("Could not resize shared memory", name);
+  }
+  channel->Map(size);
+
+  Header *header = new (channel->header_) Header();
+  header->dtype = int32_t(dtype);
+  header->rows = rows;
+  header->cols = cols;
+  header->slot_size = slot_size;
+  header->frame.store(0);
+  header->latest_slot.store(0);
+  for (int i = 0; i < kSlotCount; ++i) {
+    header->slots[i].sequence.store(0);
+    header->slots[i].frame.store(0);
+  }
+  for (int i = 0; i < kHistorySize; ++i) {
+    header->history[i].frame.store(0);
+  }
+  header->magic.store(kMagic, memory_order_release);
+
+  return channel;
+#else
+  throw Error(kNotSupported);
+#endif
+}
+
+shared_ptr<SharedBufferChannel> SharedBufferChannel::Open(
+    const string &name) {
+#ifdef TENVIZ_WITH_SHARED_MEMORY
+  shared_ptr<SharedBufferChannel> channel(
+      new SharedBufferChannel(name, false));
+
+  channel->fd_ = shm_open(name.c_str(), O_RDWR, 0600);
+  if (channel->fd_ < 0) {
+    ThrowSystemError("Could not open shared memory", name);
+  }
+
+  struct stat info;
+  if (fstat(channel->fd_, &info) != 0) {
+    ThrowSystemError("Could not query shared memory", name);
+  }
+  if (size_t(info.st_size) < sizeof(Header)) {
+    stringstream format;
+    format << "Shared memory `" << name << "` is not a buffer channel";
+    throw Error(format);
+  }
+  channel->Map(info.st_size);
+
+  const Header *header = channel->header_;
+  if (header->magic.load(memory_order_acquire) != kMagic ||
+      size_t(info.st_size) <
+          AlignUp(sizeof(Header)) + header->slot_size * kSlotCount) {
+    stringstream format;
+    format << "Shared memory `" << name << "` is not a buffer channel";
+    throw Error(format);
+  }
+
+  return channel;
+#else
+  throw Error(kNotSupported);
+#endif
+}
+
+SharedBufferChannel::SharedBufferChannel(const string &name, bool owner)
+    : name_(name),
+      owner_(owner),
+      fd_(-1),
+      mapped_size_(0),
+      header_(nullptr) {}
+
+SharedBufferChannel::~SharedBufferChannel() {
+#ifdef TENVIZ_WITH_SHARED_MEMORY
+  if (header_ != nullptr) {
+    munmap(header_, mapped_size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  if (owner_) {
+    shm_unlink(name_.c_str());
+  }
+#endif
+}
+
+void SharedBufferChannel::Map(size_t size) {
+#ifdef TENVIZ_WITH_SHARED_MEMORY
+  void *memory =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (memory == MAP_FAILED) {
+    ThrowSystemError("Could not map shared memory", name_);
+  }
+
+  header_ = reinterpret_cast<Header *>(memory);
+  mapped_size_ = size;
+#endif
+}
+
+void SharedBufferChannel::Publish(const torch::Tensor &tensor,
+                                  int64_t offset_row) {
+  if (cast_type<GLenum>(tensor.scalar_type()) != GLenum(header_->dtype)) {
+    throw Error("Publish tensor and channel types must match");
+  }
+
+  const int64_t cols = header_->cols;
+  if (tensor.numel() % cols != 0) {
+    throw Error("Publish tensor must have the channel's columns");
+  }
+
+  const int64_t rows = tensor.numel() / cols;
+  if (offset_row < 0 || offset_row + rows > header_->rows) {
+    stringstream format;
+    format << "Publish rows [" << offset_row << ", " << offset_row + rows
+           << ") are out of the channel's " << header_->rows << " rows";
+    throw Error(format);
+  }
+
+  const torch::Tensor cpu_tensor = tensor.cpu().contiguous();
+  const size_t row_size = get_row_size();
+
+  const uint64_t frame = header_->frame.load(memory_order_relaxed) + 1;
+  const int latest = header_->latest_slot.load(memory_order_relaxed);
+  const int slot = (frame == 1) ? 0 : (latest + 1) % kSlotCount;
+
+  Header::Slot &slot_header = header_->slots[slot];
+  const uint64_t sequence = slot_header.sequence.load(memory_order_relaxed);
+  slot_header.sequence.store(sequence + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  uint8_t *data = GetSlotData(slot);
+  if (frame > 1) {
+    // Catches up with the rows changed since the slot's last frame.
+    int64_t begin_row, end_row;
+    GetChangedRows(slot_header.frame.load(memory_order_relaxed), frame - 1,
+                   &begin_row, &end_row);
+    if (begin_row < end_row) {
+      memcpy(data + begin_row * row_size,
+             GetSlotData(latest) + begin_row * row_size,
+             (end_row - begin_row) * row_size);
+    }
+  }
+  memcpy(data + offset_row * row_size, cpu_tensor.data_ptr(),
+         rows * row_size);
+  slot_header.frame.store(frame, memory_order_relaxed);
+
+  Header::ChangedRows &changed = header_->history[frame % kHistorySize];
+  changed.frame.store(0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  changed.begin_row.store(offset_row, memory_order_relaxed);
+  changed.end_row.store(offset_row + rows, memory_order_relaxed);
+  changed.frame.store(frame, memory_order_release);
+
+  slot_header.sequence.store(sequence + 2, memory_order_release);
+  header_->latest_slot.store(slot, memory_order_release);
+  header_->frame.store(frame, memory_order_release);
+}
+
+bool SharedBufferChannel::BeginRead(uint64_t since_frame, View *view) const {
+  const uint64_t frame = header_->frame.load(memory_order_acquire);
+  if (frame == 0 || frame <= since_frame) {
+    return false;
+  }
+
+  const int slot = header_->latest_slot.load(memory_order_acquire);
+  const Header::Slot &slot_header = header_->slots[slot];
+  const uint64_t sequence = slot_header.sequence.load(memory_order_acquire);
+  if (sequence % 2 != 0) {
+    return false;
+  }
+
+  const uint64_t slot_frame = slot_header.frame.load(memory_order_relaxed);
+  if (slot_frame <= since_frame) {
+    return false;
+  }
+
+  view->data = GetSlotData(slot);
+  view->frame = slot_frame;
+  view->sequence = sequence;
+  view->slot = slot;
+  GetChangedRows(since_frame, slot_frame, &view->begin_row, &view->end_row);
+  return true;
+}
+
+bool SharedBufferChannel::EndRead(const View &view) const {
+  atomic_thread_fence(memory_order_acquire);
+  return header_->slots[view.slot].sequence.load(memory_order_relaxed) ==
+         view.sequence;
+}
+
+void SharedBufferChannel::GetChangedRows(uint64_t since_frame,
+                                         uint64_t until_frame,
+                                         int64_t *begin_row,
+                                         int64_t *end_row) const {
+  *begin_row = 0;
+  *end_row = header_->rows;
+  if (since_frame == 0 || until_frame - since_frame >= kHistorySize) {
+    return;
+  }
+
+  int64_t begin = header_->rows, end = 0;
+  for (uint64_t frame = since_frame + 1; frame <= until_frame; ++frame) {
+    const Header::ChangedRows &changed =
+        header_->history[frame % kHistorySize];
+    const uint64_t first_frame = changed.frame.load(memory_order_acquire);
+    const int64_t changed_begin =
+        changed.begin_row.load(memory_order_relaxed);
+    const int64_t changed_end = changed.end_row.load(memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    if (first_frame != frame ||
+        changed.frame.load(memory_order_relaxed) != frame) {
+      // Overwritten by newer frames.
+      return;
+    }
+
+    begin = min(begin, changed_begin);
+    end = max(end, changed_end);
+  }
+
+  *begin_row = begin;
+  *end_row = end;
+}
+
+uint64_t SharedBufferChannel::get_frame() const {
+  return header_->frame.load(memory_order_acquire);
+}
+
+int64_t SharedBufferChannel::get_rows() const { return header_->rows; }
+
+int64_t SharedBufferChannel::get_cols() const { return header_->cols; }
+
+DType SharedBufferChannel::get_dtype() const {
+  return DType(header_->dtype);
+}
+
+uint8_t *SharedBufferChannel::GetSlotData(int slot) const {
+  return reinterpret_cast<uint8_t *>(header_) + AlignUp(sizeof(Header)) +
+         header_->slot_size * slot;
+}
+
+size_t SharedBufferChannel::get_row_size() const {
+  return GetTypeSize(GLenum(header_->dtype)) * header_->cols;
+}
+
+}  // namespace tenviz
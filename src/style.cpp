@@ -2,6 +2,9 @@
 
 #include <torch/csrc/utils/pybind.h>
 
+#include "gl_state_cache.hpp"
+#include "modification_stamp.hpp"
+
 namespace tenviz {
 Style::Style() {
   line_width = 1.0f;
@@ -14,26 +17,24 @@ Style::Style() {
   polygon_offset_units = 0.0f;
 }
 
-void Style::Activate() const {
-  glPolygonMode(GL_FRONT_AND_BACK, static_cast<GLenum>(polygon_mode));
-  glLineWidth(line_width);
-  glPointSize(point_size);
-
-  if (alpha_blending) {
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  } else {
-    glDisable(GL_BLEND);
+Style::Scoped::~Scoped() {
+  // With a state cache the next activation changes only what differs,
+  // so resetting is left to whoever draws next.
+  if (GLStateCache::GetCurrent() == nullptr) {
+    Style default_style;
+    default_style.Activate();
   }
+}
 
-  if (polygon_offset_mode == PolygonOffsetMode::kNone) {
-    glDisable(GL_POLYGON_OFFSET_FILL);
-    glDisable(GL_POLYGON_OFFSET_LINE);
-    glDisable(GL_POLYGON_OFFSET_POINT);
-  } else {
-    glEnable(static_cast<GLenum>(polygon_offset_mode));
-    glPolygonOffset(polygon_offset_factor, polygon_offset_units);
-  }
+void Style::Activate() const { GLStateCache::ApplyStyle(*this); }
+
+bool Style::operator==(const Style &other) const {
+  return line_width == other.line_width && point_size == other.point_size &&
+         polygon_mode == other.polygon_mode &&
+         alpha_blending == other.alpha_blending &&
+         polygon_offset_mode == other.polygon_offset_mode &&
+         polygon_offset_factor == other.polygon_offset_factor &&
+         polygon_offset_units == other.polygon_offset_units;
 }
 
 void Style::RegisterPybind(pybind11::module &m) {
@@ -50,13 +51,16 @@ void Style::RegisterPybind(pybind11::module &m) {
       .value("Point", PolygonOffsetMode::kPoint)
       .export_values();
 
-  pybind11::class_<Style>(m, "Style")
-      .def_readwrite("polygon_mode", &Style::polygon_mode)
-      .def_readwrite("line_width", &Style::line_width)
-      .def_readwrite("point_size", &Style::point_size)
-      .def_readwrite("alpha_blending", &Style::alpha_blending)
-      .def_readwrite("polygon_offset_mode", &Style::polygon_offset_mode)
-      .def_readwrite("polygon_offset_factor", &Style::polygon_offset_factor)
-      .def_readwrite("polygon_offset_units", &Style::polygon_offset_units);
+  pybind11::class_<Style> style(m, "Style");
+  DefTouchingProperty(style, "polygon_mode", &Style::polygon_mode);
+  DefTouchingProperty(style, "line_width", &Style::line_width);
+  DefTouchingProperty(style, "point_size", &Style::point_size);
+  DefTouchingProperty(style, "alpha_blending", &Style::alpha_blending);
+  DefTouchingProperty(style, "polygon_offset_mode",
+                      &Style::polygon_offset_mode);
+  DefTouchingProperty(style, "polygon_offset_factor",
+                      &Style::polygon_offset_factor);
+  DefTouchingProperty(style, "polygon_offset_units",
+                      &Style::polygon_offset_units);
 }
 }  // namespace tenviz
@@ -0,0 +1,146 @@
+#include "uniform_value.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "error.hpp"
+
+using namespace std;
+
+namespace tenviz {
+
+UniformValue UniformValue::FromTensor(const torch::Tensor &tensor) {
+  if (tensor.is_cuda()) {
+    throw Error("Only CPU tensors can set uniforms");
+  }
+
+  const int ndims = tensor.dim();
+  if (ndims == 1) {
+    const int64_t size = tensor.size(0);
+    if (size < 1 || size > 4) {
+      throw Error("Uniform vectors must have 1 to 4 values");
+    }
+
+    switch (tensor.scalar_type()) {
+      case torch::kFloat: {
+        const torch::Tensor values = tensor.contiguous();
+        return Vector(values.data_ptr<float>(), int(size));
+      }
+      case torch::kInt32: {
+        const auto accessor = tensor.accessor<int32_t, 1>();
+        UniformValue value;
+        value.type_ = kInt;
+        value.size_ = int(size);
+        for (int i = 0; i < value.size_; ++i) {
+          value.ints_[i] = accessor[i];
+        }
+        return value;
+      }
+      default:
+        throw Error(
+            "Only float32 or int32 tensors can set scalar or vector uniforms");
+    }
+  } else if (ndims == 2) {
+    if (tensor.scalar_type() != torch::kFloat) {
+      throw Error("Only float32 tensors can set matrix uniforms");
+    }
+
+    const int64_t rows = tensor.size(0);
+    if (rows != tensor.size(1) || rows < 2 || rows > 4) {
+      throw Error(
+          "Can't set uniform matrix using non square matrix or larger than 4.");
+    }
+
+    // OpenGL matrices are ordered column-wise in memory.
+    const torch::Tensor columns = tensor.t().contiguous();
+    return Matrix(columns.data_ptr<float>(), int(rows));
+  }
+
+  throw Error("Can't set uniform using a tensor larger than 2-dims");
+}
+
+UniformValue UniformValue::Vector(const float *values, int size) {
+  UniformValue value;
+  value.type_ = kFloat;
+  value.size_ = size;
+  copy(values, values + size, value.floats_);
+  return value;
+}
+
+UniformValue UniformValue::Matrix(const float *values, int size) {
+  UniformValue value;
+  value.type_ = kMatrix;
+  value.size_ = size;
+  copy(values, values + size * size, value.floats_);
+  return value;
+}
+
+void UniformValue::Upload(GLint location) const {
+  switch (type_) {
+    case kFloat:
+      switch (size_) {
+        case 1:
+          glUniform1fv(location, 1, floats_);
+          break;
+        case 2:
+          glUniform2fv(location, 1, floats_);
+          break;
+        case 3:
+          glUniform3fv(location, 1, floats_);
+          break;
+        default:
+          glUniform4fv(location, 1, floats_);
+      }
+      break;
+    case kInt:
+      switch (size_) {
+        case 1:
+          glUniform1iv(location, 1, ints_);
+          break;
+        case 2:
+          glUniform2iv(location, 1, ints_);
+          break;
+        case 3:
+          glUniform3iv(location, 1, ints_);
+          break;
+        default:
+          glUniform4iv(location, 1, ints_);
+      }
+      break;
+    case kMatrix:
+      switch (size_) {
+        case 2:
+          glUniformMatrix2fv(location, 1, GL_FALSE, floats_);
+          break;
+        case 3:
+          glUniformMatrix3fv(location, 1, GL_FALSE, floats_);
+          break;
+        default:
+          glUniformMatrix4fv(location, 1, GL_FALSE, floats_);
+      }
+      break;
+    case kNone:
+      break;
+  }
+}
+
+bool UniformValue::operator==(const UniformValue &other) const {
+  if (type_ != other.type_ || size_ != other.size_) {
+    return false;
+  }
+
+  // Compares bits, so NaNs don't make values always differ.
+  if (type_ == kInt) {
+    return memcmp(ints_, other.ints_, sizeof(int32_t) * size_) == 0;
+  }
+  return memcmp(floats_, other.floats_, sizeof(float) * get_count()) == 0;
+}
+
+vector<int64_t> UniformValue::get_shape() const {
+  if (type_ == kMatrix) {
+    return {size_, size_};
+  }
+  return {size_};
+}
+
+}  // namespace tenviz
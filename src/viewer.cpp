@@ -6,9 +6,12 @@
 
 #include "camera.hpp"
 #include "camera_manipulator.hpp"
+#include "gl_buffer.hpp"
 #include "gl_common.hpp"
 #include "gl_error.hpp"
 #include "gl_shader_program.hpp"
+#include "gl_state_cache.hpp"
+#include "modification_stamp.hpp"
 #include "scene.hpp"
 #include "trackball_camera_manipulator.hpp"
 
@@ -20,6 +23,10 @@ namespace tenviz {
 namespace {
 const int NO_LAST_KEY = std::numeric_limits<int>::min();
 
+// Maximum time sleeping on events before checking for modifications
+// from other threads, in seconds.
+const double kIdleWaitTimeout = 0.1;
+
 void HandleCtrlC(GLFWwindow* window,
                  std::shared_ptr<ICameraManipulator> camera_manip) {
   const Eigen::Matrix4f mtx = camera_manip->GetViewMatrix();
@@ -64,6 +71,7 @@ void HandleCtrlV(GLFWwindow* window,
 void KeyCallback(GLFWwindow* window, int key, int scancode, int action,
                  int mods) {
   Viewer* self = static_cast<Viewer*>(glfwGetWindowUserPointer(window));
+  self->dirty_ = true;
   if (key == GLFW_KEY_ESCAPE && action == GLFW_RELEASE) {
     glfwSetWindowShouldClose(window, 1);
     return;
@@ -91,21 +99,25 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action,
 
 void CursorPositionCallback(GLFWwindow* window, double xpos, double ypos) {
   Viewer* self = static_cast<Viewer*>(glfwGetWindowUserPointer(window));
+  self->dirty_ = true;
   self->camera_manip_->CursorMoved(window, xpos, ypos);
 }
 
 void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
   Viewer* self = static_cast<Viewer*>(glfwGetWindowUserPointer(window));
+  self->dirty_ = true;
   self->camera_manip_->CursorButtonPressed(window, button, action, mods);
 }
 
 void ScrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
   Viewer* self = static_cast<Viewer*>(glfwGetWindowUserPointer(window));
+  self->dirty_ = true;
   self->camera_manip_->CursorScrollMoved(window, xoffset, yoffset);
 }
 
 void WindowSizeCallback(GLFWwindow* window, int width, int height) {
   Viewer* self = static_cast<Viewer*>(glfwGetWindowUserPointer(window));
+  self->dirty_ = true;
   self->UpdateSize(width, height);
 }
 
@@ -150,6 +162,9 @@ Viewer::Viewer(SharedWindow shared_window, Context* orig_context,
           false, Projection::Perspective(45.0f, 1.0f, 1.0f, 1000.0f))) {
   last_key_ = NO_LAST_KEY;
   first_view_ = true;
+  event_driven = true;
+  dirty_ = true;
+  drawn_stamp_ = ModificationStamp::Get();
 
   glfwSetWindowUserPointer(window_.handle, this);
   glfwSetKeyCallback(window_.handle, KeyCallback);
@@ -162,8 +177,6 @@ Viewer::Viewer(SharedWindow shared_window, Context* orig_context,
   glfwGetWindowSize(window_.handle, &width_, &height_);
 }
 
-void Viewer::Release() { window_.Release(); }
-
 void Viewer::UpdateSize(int width, int height) {
   width_ = width;
   height_ = height;
@@ -174,7 +187,10 @@ void Viewer::SetTitle(const std::string& title) {
   title_ = title;
 }
 
-void Viewer::ResetView() { camera_manip_->ResetView(scene_->GetBounds()); }
+void Viewer::ResetView() {
+  camera_manip_->ResetView(scene_->GetBounds());
+  dirty_ = true;
+}
 
 Eigen::Matrix4f Viewer::GetProjectionMatrix() const {
   if (user_projection_.first) {
@@ -187,6 +203,27 @@ Eigen::Matrix4f Viewer::GetProjectionMatrix() const {
 
 void Viewer::SetProjection(const Projection& proj) {
   user_projection_ = make_pair(true, proj);
+  dirty_ = true;
+}
+
+void Viewer::Invalidate() {
+  dirty_ = true;
+  glfwPostEmptyEvent();
+}
+
+bool Viewer::IsAnimating() const {
+  // Manipulators move the camera while keys are held.
+  for (const auto& key_pressed : pressed_key_map_) {
+    if (key_pressed.second) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Viewer::NeedsRedraw() const {
+  return dirty_ || IsAnimating() || drawn_stamp_ != ModificationStamp::Get() ||
+         GLBuffer::HasPendingChannelFrames();
 }
 
 class ScopedContext {
@@ -198,9 +235,32 @@ class ScopedContext {
   SharedWindow wnd_;
 };
 
+void Viewer::Release() {
+  if (window_.handle != nullptr && !window_.is_shared() &&
+      !camera_block_.is_empty()) {
+    ScopedContext curr(window_);
+    camera_block_.Release();
+  }
+  window_.Release();
+}
+
 bool Viewer::Draw(int swap_interval) {
+  RenderFrame(swap_interval);
+
+  glfwPollEvents();
+  UpdateCamera();
+
+  return !glfwWindowShouldClose(window_.handle);
+}
+
+void Viewer::RenderFrame(int swap_interval) {
   ScopedContext curr(window_);
   // orig_context_->MakeCurrent();
+  if (window_.is_shared()) {
+    // The context may have changed the state.
+    state_cache_.Invalidate();
+  }
+  ScopedGLStateCache scoped_cache(&state_cache_);
   glfwSwapInterval(swap_interval);
 
   if (!glfwGetWindowAttrib(window_.handle, GLFW_VISIBLE)) {
@@ -214,15 +274,23 @@ bool Viewer::Draw(int swap_interval) {
 
   Eigen::Matrix4f proj_mtx = GetProjectionMatrix();
 
-  orig_context_->RenderFrameImpl(scene_, proj_mtx, view_mtx);
-  glfwSwapBuffers(window_.handle);
+  // Modifications done while drawing are for the next frame.
+  drawn_stamp_ = ModificationStamp::Get();
+  dirty_ = false;
 
-  glfwPollEvents();
+  // Shared windows draw with the context's OpenGL context.
+  GLUniformBlock &camera_block =
+      window_.is_shared() ? orig_context_->camera_block_ : camera_block_;
+  orig_context_->RenderFrameImpl(scene_, proj_mtx, view_mtx, camera_block,
+                                 window_.is_shared());
+  glfwSwapBuffers(window_.handle);
+}
 
+void Viewer::UpdateCamera() {
   elapsed_ = frame_tick_.Tick();
-  camera_manip_->KeyState(pressed_key_map_, elapsed_, scene_->GetBounds());
-
-  return !glfwWindowShouldClose(window_.handle);
+  if (IsAnimating()) {
+    camera_manip_->KeyState(pressed_key_map_, elapsed_, scene_->GetBounds());
+  }
 }
 
 int Viewer::WaitKey(int swap_interval) {
@@ -233,8 +301,27 @@ int Viewer::WaitKey(int swap_interval) {
 
   TimeMeasurer time_meas;
   while (true) {
-    if (!Draw(swap_interval)) {
-      break;
+    if (!event_driven) {
+      if (!Draw(swap_interval)) {
+        break;
+      }
+    } else {
+      if (NeedsRedraw()) {
+        RenderFrame(swap_interval);
+      }
+
+      if (swap_interval == 0 || IsAnimating()) {
+        glfwPollEvents();
+      } else {
+        glfwWaitEventsTimeout(kIdleWaitTimeout);
+        // Camera motion shouldn't count the time sleeping.
+        frame_tick_.Tick();
+      }
+      UpdateCamera();
+
+      if (glfwWindowShouldClose(window_.handle)) {
+        break;
+      }
     }
 
     if (last_key_ != NO_LAST_KEY) {
@@ -261,6 +348,8 @@ void Viewer::RegisterPybind(pybind11::module& m) {
       .def("draw", &Viewer::Draw, py::arg("swap_interval") = int(2))
       .def("wait_key", &Viewer::WaitKey)
       .def("release", &Viewer::Release)
+      .def("invalidate", &Viewer::Invalidate)
+      .def_readwrite("event_driven", &Viewer::event_driven)
       .def("get_scene", &Viewer::get_scene)
       .def_property("context", &Viewer::get_context, nullptr)
       .def_property("title", &Viewer::get_title, &Viewer::SetTitle)
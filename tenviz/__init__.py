@@ -11,6 +11,7 @@ from . import geometry
 from . import nodes
 
 from .context import Context
+from .render_pool import RenderPool
 from .program import load_program_fs, DrawProgram
 from .projection import Projection
 from .buffer import buffer_from_tensor, buffer_empty
@@ -18,5 +19,8 @@ from .texture import tex_from_tensor, tex_empty
 from .framebuffer import create_framebuffer
 from .viewer import take_screenshot
 from ._ctenviz import (PolygonMode, PolygonOffsetMode, CameraManipulator,
-                       MatPlaceholder, DrawMode, BufferTarget, BufferUsage,
-                       DType, FramebufferTarget, TexTarget, Error)
+                       ContextBackend, MatPlaceholder, DrawMode, AttribEncoding,
+                       BufferTarget, BufferUsage, DType, FramebufferTarget,
+                       TexTarget, Error, GLErrorMode, set_gl_error_mode,
+                       get_gl_error_mode, is_cuda_interop_available,
+                       SharedBufferChannel)
@@ -80,6 +80,171 @@ class TestBuffer(unittest.TestCase):
         TestBuffer._test_torch_memory_impl("cuda:0", torch.float32)
         TestBuffer._test_torch_memory_impl("cuda:0", torch.uint8)
 
+    def test_cpu_transfer(self):
+        """Test the transfers that don't use CUDA interop.
+        """
+        context = tenviz.Context()
+        tensor = torch.rand((1024, 3))
+
+        with context.current():
+            buffer = tenviz.buffer_from_tensor(tensor)
+            btensor = buffer.to_tensor(False)
+            self.assertFalse(btensor.is_cuda)
+            torch.testing.assert_allclose(tensor, btensor)
+
+            indices = torch.tensor([0, 5, 1000], dtype=torch.int64)
+            slice_tensor = torch.tensor([[1, 1, 1],
+                                         [2, 2, 2],
+                                         [3, 3, 3]], dtype=torch.float32)
+            buffer[indices] = slice_tensor
+            tensor[indices] = slice_tensor
+            torch.testing.assert_allclose(tensor, buffer.to_tensor(False))
+
+        if not tenviz.is_cuda_interop_available():
+            with context.current():
+                btensor = buffer.to_tensor(True)
+            self.assertFalse(btensor.is_cuda)
+            torch.testing.assert_allclose(tensor, btensor)
+
+    def test_scattered_index(self):
+        """Test indexing many scattered and consecutive rows.
+        """
+        context = tenviz.Context()
+        tensor = torch.rand((100000, 3))
+        indices = torch.cat([torch.arange(0, 50000, 7),
+                             torch.arange(60000, 61000)])
+        indices = indices[torch.randperm(indices.size(0))]
+        rows = torch.rand((indices.size(0), 3))
+
+        with context.current():
+            buffer = tenviz.buffer_from_tensor(tensor)
+            buffer[indices] = rows
+            tensor[indices] = rows
+            torch.testing.assert_allclose(buffer.to_tensor(False), tensor)
+            torch.testing.assert_allclose(
+                buffer.index_select(indices, False), tensor[indices])
+
+    def test_update(self):
+        """Test updating ranges and reusing the buffer's storage.
+        """
+        context = tenviz.Context()
+        tensor = torch.rand((1024, 3))
+        with context.current():
+            buffer = tenviz.buffer_from_tensor(tensor)
+            capacity = buffer.capacity
+
+            rows = torch.rand((10, 3))
+            buffer.update(rows, 500)
+            tensor[500:510] = rows
+            torch.testing.assert_allclose(buffer.to_tensor(False), tensor)
+
+            with self.assertRaises(tenviz.Error):
+                buffer.update(rows, 1020)
+
+            tensor = torch.rand((512, 3))
+            buffer.from_tensor(tensor)
+            self.assertEqual(capacity, buffer.capacity)
+            torch.testing.assert_allclose(buffer.to_tensor(False), tensor)
+
+            tensor = torch.rand((2048, 3))
+            buffer.from_tensor(tensor)
+            self.assertLess(capacity, buffer.capacity)
+            torch.testing.assert_allclose(buffer.to_tensor(False), tensor)
+
+    def test_stream(self):
+        """Test writing stream buffers through their slots.
+        """
+        context = tenviz.Context()
+        with context.current():
+            buffer = tenviz.buffer_empty(
+                1024, 3, usage=tenviz.BufferUsage.Stream)
+            self.assertTrue(buffer.is_stream)
+
+        for _ in range(5):
+            tensor = torch.rand((1024, 3))
+            with context.current():
+                with buffer.stream_write() as slot:
+                    self.assertFalse(slot.is_cuda)
+                    slot[:] = tensor
+                torch.testing.assert_allclose(buffer.to_tensor(False), tensor)
+
+        tensor = torch.rand((1024, 3))
+        with context.current():
+            buffer.from_tensor(tensor)
+            torch.testing.assert_allclose(buffer.to_tensor(False), tensor)
+
+            indices = torch.tensor([0, 5, 1000], dtype=torch.int64)
+            torch.testing.assert_allclose(buffer[indices], tensor[indices])
+
+    def test_shared_channel(self):
+        """Test uploading frames published through shared memory.
+        """
+        context = tenviz.Context()
+        producer = tenviz.SharedBufferChannel.create(
+            "/tenviz_test_channel", 1024, 3, tenviz.DType.Float)
+        reader = tenviz.SharedBufferChannel.open("/tenviz_test_channel")
+
+        tensor = torch.rand((1024, 3))
+        producer.publish(tensor)
+        with context.current():
+            buffer = tenviz.buffer_empty(1024, 3)
+            buffer.bind_channel(reader)
+            self.assertTrue(buffer.poll_channel())
+            self.assertFalse(buffer.poll_channel())
+            torch.testing.assert_allclose(buffer.to_tensor(False), tensor)
+
+        # Readers skip to the latest frame.
+        for i in range(5):
+            rows = torch.rand((10, 3))
+            producer.publish(rows, i*100)
+            tensor[i*100:i*100 + 10] = rows
+        self.assertEqual(6, reader.frame)
+
+        with context.current():
+            self.assertTrue(buffer.poll_channel())
+            torch.testing.assert_allclose(buffer.to_tensor(False), tensor)
+
+            with self.assertRaises(tenviz.Error):
+                producer.publish(torch.rand((10, 3)), 1020)
+
+    def test_index_narrowing(self):
+        """Test narrowing of element buffers' indices.
+        """
+        context = tenviz.Context()
+        with context.current():
+            for dtype in [torch.int64, torch.int32, torch.int16, torch.uint8]:
+                tensor = torch.randint(0, 255, (1024, 3), dtype=dtype)
+                buffer = tenviz.buffer_from_tensor(
+                    tensor, target=tenviz.BufferTarget.Element)
+                self.assertEqual(1024*3*2, buffer.capacity)
+                torch.testing.assert_allclose(buffer.to_tensor(False),
+                                              tensor.int())
+
+            tensor = torch.tensor([[0, 65535, 40000], [1, 2, 3]])
+            buffer = tenviz.buffer_from_tensor(
+                tensor, target=tenviz.BufferTarget.Element)
+            self.assertEqual(6*2, buffer.capacity)
+            self.assertTrue(torch.equal(buffer.to_tensor(False), tensor.int()))
+
+            buffer.update(torch.tensor([[65000, 4, 5]]), 1)
+            tensor[1] = torch.tensor([65000, 4, 5])
+            self.assertTrue(torch.equal(buffer.to_tensor(False), tensor.int()))
+            with self.assertRaises(tenviz.Error):
+                buffer.update(torch.tensor([[65536, 4, 5]]), 1)
+
+            tensor = torch.tensor([0, 1, 70000, 3000000000])
+            buffer = tenviz.buffer_from_tensor(
+                tensor, target=tenviz.BufferTarget.Element)
+            self.assertEqual(4*4, buffer.capacity)
+            self.assertTrue(torch.equal(buffer.to_tensor(False), tensor))
+
+            with self.assertRaises(tenviz.Error):
+                buffer.from_tensor(torch.tensor([0, -1, 2]))
+            with self.assertRaises(tenviz.Error):
+                buffer.from_tensor(torch.tensor([0, 1 << 32]))
+            with self.assertRaises(tenviz.Error):
+                buffer.from_tensor(torch.rand(10))
+
     @staticmethod
     def test_as_tensor():
         """Test tensor mapping.
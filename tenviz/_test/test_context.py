@@ -61,5 +61,128 @@ class TestContext(unittest.TestCase):
         self.assertEqual(320, framebuffer[0].width)
         self.assertEqual(240, framebuffer[0].height)
 
+    def test_render_many(self):
+        """Test rendering multiple views into a layered framebuffer.
+        """
+        ctx = tenviz.Context(640, 480)
+
+        with ctx.current():
+            pcl = tenviz.nodes.PointCloud(torch.rand(100, 3))
+            framebuffer = tenviz.create_framebuffer(
+                {0: tenviz.FramebufferTarget.RGBAUint8,
+                 1: tenviz.FramebufferTarget.RFloat})
+
+        views = torch.eye(4).repeat(3, 1, 1)
+        views[1, 2, 3] = -1
+        images = ctx.render_many(torch.eye(4).expand(3, 4, 4), views,
+                                 framebuffer, [pcl], width=320, height=240)
+
+        self.assertEqual((3, 240, 320, 4), tuple(images[0].shape))
+        self.assertEqual((3, 240, 320), tuple(images[1].shape))
+        self.assertEqual(3, framebuffer.layers)
+
+        ctx.render(torch.eye(4), torch.eye(4), framebuffer, [pcl])
+        self.assertEqual(0, framebuffer.layers)
+        self.assertEqual(640, framebuffer[0].width)
+
+    def test_stats(self):
+        """Test the rendering statistics.
+        """
+        ctx = tenviz.Context(640, 480)
+        ctx.stats_enabled = True
+
+        with ctx.current():
+            pcl = tenviz.nodes.PointCloud(torch.rand(100, 3))
+            framebuffer = tenviz.create_framebuffer(
+                {0: tenviz.FramebufferTarget.RGBAUint8})
+
+        for _ in range(2):
+            ctx.render(torch.eye(4), torch.eye(4), framebuffer, [pcl])
+        with ctx.current():
+            # Waits the GPU, so the last render collects the timings.
+            framebuffer[0].to_tensor(False)
+        ctx.render(torch.eye(4), torch.eye(4), framebuffer, [pcl])
+
+        stats = ctx.get_stats()
+        self.assertEqual(3, stats["frame"])
+        self.assertEqual(1, stats["draw_calls"])
+        self.assertEqual(100, stats["vertices"])
+        self.assertGreater(stats["state_changes"], 0)
+        self.assertIn(pcl, stats["node_times"])
+        self.assertGreaterEqual(stats["gpu_time"], 0.0)
+
+        with ctx.current():
+            framebuffer[0].to_tensor(False)
+        ctx.render(torch.eye(4), torch.eye(4), framebuffer, [pcl])
+        self.assertEqual(640*480*4, ctx.get_stats()["bytes_read_back"])
+
+    def test_state_cache(self):
+        """Test that redundant state changes are skipped.
+        """
+        ctx = tenviz.Context(640, 480)
+        ctx.stats_enabled = True
+
+        with ctx.current():
+            pcl = tenviz.nodes.PointCloud(torch.rand(100, 3))
+            framebuffer = tenviz.create_framebuffer(
+                {0: tenviz.FramebufferTarget.RGBAUint8})
+
+        state_changes = []
+        for scene in [[], [pcl], [pcl, pcl]]:
+            ctx.render(torch.eye(4), torch.eye(4), framebuffer, scene)
+            state_changes.append(ctx.get_stats()["state_changes"])
+
+        first_draw = state_changes[1] - state_changes[0]
+        second_draw = state_changes[2] - state_changes[1]
+        self.assertLess(second_draw, first_draw)
+
+    def test_gl_error_mode(self):
+        """Test rendering on each OpenGL error mode.
+        """
+        default_mode = tenviz.get_gl_error_mode()
+        try:
+            for mode in [tenviz.GLErrorMode.Check,
+                         tenviz.GLErrorMode.DebugOutput,
+                         tenviz.GLErrorMode.Disabled]:
+                tenviz.set_gl_error_mode(mode)
+                self.assertEqual(mode, tenviz.get_gl_error_mode())
+
+                ctx = tenviz.Context(640, 480)
+                with ctx.current():
+                    pcl = tenviz.nodes.PointCloud(torch.rand(100, 3))
+                    framebuffer = tenviz.create_framebuffer(
+                        {0: tenviz.FramebufferTarget.RGBAUint8})
+
+                ctx.render(torch.eye(4), torch.eye(4), framebuffer, [pcl])
+                with ctx.current():
+                    image = framebuffer[0].to_tensor(False)
+                self.assertEqual((480, 640, 4), tuple(image.shape))
+        finally:
+            tenviz.set_gl_error_mode(default_mode)
+
+    def test_headless_render(self):
+        """Test rendering without a display server.
+        """
+        try:
+            ctx = tenviz.Context(640, 480, backend=tenviz.ContextBackend.EGL)
+        except tenviz.Error:
+            self.skipTest("EGL unavailable")
+
+        self.assertEqual(tenviz.ContextBackend.EGL, ctx.backend)
+
+        with ctx.current():
+            pcl = tenviz.nodes.PointCloud(torch.rand(100, 3))
+            framebuffer = tenviz.create_framebuffer(
+                {0: tenviz.FramebufferTarget.RGBAUint8})
+
+        ctx.render(torch.eye(4), torch.eye(4), framebuffer, [pcl])
+        with ctx.current():
+            image = framebuffer[0].to_tensor(False)
+
+        self.assertEqual((480, 640, 4), tuple(image.shape))
+
+        with self.assertRaises(tenviz.Error):
+            ctx.viewer([pcl])
+
 if __name__ == '__main__':
     unittest.main()
@@ -1,9 +1,13 @@
 """Test the DrawProgram class
 """
 
+import tempfile
 import unittest
 from pathlib import Path
 
+import numpy
+import torch
+
 import tenviz
 import tenviz.io
 
@@ -31,3 +35,491 @@ class TestDrawProgram(unittest.TestCase):
             # TODO: check if vert extists
             mesh['Modelview'] = tenviz.MatPlaceholder.Modelview
             mesh['ProjModelview'] = tenviz.MatPlaceholder.Projection
+
+    def test_set_vertices(self):
+        """Tests drawing interleaved attributes.
+        """
+        context = tenviz.Context(320, 240)
+        torch.manual_seed(10)
+        verts = torch.rand(1000, 3)*2 - 1
+        colors = (torch.rand(1000, 3)*255).byte()
+
+        with context.current():
+            separated = tenviz.nodes.PointCloud(verts, colors, point_size=3)
+            interleaved = tenviz.nodes.PointCloud(verts, point_size=3)
+            interleaved.set_vertices({'in_position': verts,
+                                      'in_color': colors})
+            framebuffer = tenviz.create_framebuffer(
+                {0: tenviz.FramebufferTarget.RGBAUint8})
+
+        images = []
+        for node in [separated, interleaved]:
+            context.render(torch.eye(4), torch.eye(4), framebuffer, [node])
+            with context.current():
+                images.append(framebuffer[0].to_tensor(False))
+
+        torch.testing.assert_allclose(images[0], images[1])
+
+    def test_buffer_arena(self):
+        """Tests drawing programs whose buffers are arena's slices.
+        """
+        context = tenviz.Context(320, 240)
+        shader_dir = Path(tenviz.__file__).parent / "shaders"
+        torch.manual_seed(10)
+
+        nodes = []
+        with context.current():
+            for _ in range(100):
+                node = tenviz.DrawProgram(tenviz.DrawMode.Points,
+                                          shader_dir / "point.vert",
+                                          shader_dir / "point.frag")
+                node['in_position'] = torch.rand(10, 3)*2 - 1
+                node['in_color'] = torch.rand(10, 3)
+                node['ProjModelview'] = tenviz.MatPlaceholder.ProjectionModelview
+                nodes.append(node)
+            framebuffer = tenviz.create_framebuffer(
+                {0: tenviz.FramebufferTarget.RGBAUint8})
+
+        arena = context.buffer_arena
+        self.assertEqual(1, arena.block_count)
+        self.assertLess(0, arena.used_size)
+
+        used_size = arena.used_size
+        nodes = nodes[::2]
+        context.collect_garbage()
+        self.assertGreater(used_size, arena.used_size)
+
+        context.render(torch.eye(4), torch.eye(4), framebuffer, nodes)
+        with context.current():
+            image = framebuffer[0].to_tensor(False)
+            arena.defragment()
+
+        context.render(torch.eye(4), torch.eye(4), framebuffer, nodes)
+        with context.current():
+            torch.testing.assert_allclose(
+                framebuffer[0].to_tensor(False), image)
+
+        # Large buffers keep their own buffer objects.
+        with context.current():
+            used_size = arena.used_size
+            large_node = tenviz.DrawProgram(tenviz.DrawMode.Points,
+                                            shader_dir / "point.vert",
+                                            shader_dir / "point.frag")
+            large_node['in_position'] = torch.rand(100000, 3)
+            self.assertEqual(used_size, arena.used_size)
+
+    def test_attrib_encoding(self):
+        """Tests drawing attributes uploaded as half and int16.
+        """
+        context = tenviz.Context(320, 240)
+        shader_dir = Path(tenviz.__file__).parent / "shaders"
+        torch.manual_seed(10)
+        verts = torch.rand(1000, 3)*2 - 1
+        colors = torch.rand(1000, 3)
+
+        nodes = []
+        with context.current():
+            for encoding in [tenviz.AttribEncoding.Raw,
+                             tenviz.AttribEncoding.Half,
+                             tenviz.AttribEncoding.NormalizedInt16]:
+                node = tenviz.DrawProgram(tenviz.DrawMode.Points,
+                                          shader_dir / "point.vert",
+                                          shader_dir / "point.frag")
+                node.set_attrib('in_position', verts, encoding)
+                node.set_attrib('in_color', colors, encoding)
+                node['ProjModelview'] = tenviz.MatPlaceholder.ProjectionModelview
+                nodes.append(node)
+            framebuffer = tenviz.create_framebuffer(
+                {0: tenviz.FramebufferTarget.RGBAUint8})
+
+            with self.assertRaises(tenviz.Error):
+                nodes[0].set_attrib('in_color', colors[:, :2],
+                                    tenviz.AttribEncoding.Octahedral)
+
+        images = []
+        for node in nodes:
+            context.render(torch.eye(4), torch.eye(4), framebuffer, [node])
+            with context.current():
+                images.append(framebuffer[0].to_tensor(False).float())
+
+        for image in images[1:]:
+            # Rounding may move a few points to a neighbour pixel.
+            mismatch = (image - images[0]).abs().sum(-1) > 0
+            self.assertLess(mismatch.float().mean().item(), 0.01)
+
+    def test_vertex_array_layout(self):
+        """Tests that changing buffers' formats sets up the vertex
+        array again.
+        """
+        context = tenviz.Context(320, 240)
+        shader_dir = Path(tenviz.__file__).parent / "shaders"
+        torch.manual_seed(10)
+        verts = torch.rand(1000, 3)*2 - 1
+        colors = (torch.rand(1000, 3)*255).byte()
+
+        with context.current():
+            node = tenviz.DrawProgram(tenviz.DrawMode.Points,
+                                      shader_dir / "point.vert",
+                                      shader_dir / "point.frag")
+            node['in_position'] = verts
+            node['in_color'] = tenviz.buffer_from_tensor(
+                colors, normalize=True)
+            node['ProjModelview'] = tenviz.MatPlaceholder.ProjectionModelview
+            framebuffer = tenviz.create_framebuffer(
+                {0: tenviz.FramebufferTarget.RGBAUint8})
+
+        def _render():
+            context.render(torch.eye(4), torch.eye(4), framebuffer, [node])
+            with context.current():
+                return framebuffer[0].to_tensor(False)
+
+        image = _render()
+        torch.testing.assert_allclose(_render(), image)
+
+        with context.current():
+            node['in_color'] = colors.float() / 255
+        torch.testing.assert_allclose(_render(), image)
+
+        with context.current():
+            node['in_position'] = torch.cat(
+                [verts, torch.ones(1000, 1)], 1)
+            node['in_color'] = tenviz.buffer_from_tensor(
+                colors, normalize=True)
+        torch.testing.assert_allclose(_render(), image)
+
+    def test_reflection(self):
+        """Tests the program's reflection and the uniforms validation.
+        """
+        context = tenviz.Context(320, 240)
+        shader_dir = Path(tenviz.__file__).parent / "shaders"
+
+        with context.current():
+            program = tenviz.load_program_fs(shader_dir / "point.vert",
+                                             shader_dir / "point.frag")
+            attribs = {var.name: var for var in program.attribs}
+            uniforms = {var.name: var for var in program.uniforms}
+            self.assertIn('in_position', attribs)
+            self.assertIn('in_color', attribs)
+            self.assertIn('ProjectionView', uniforms)
+            self.assertIn('Transparency', uniforms)
+            self.assertLessEqual(0, attribs['in_position'].location)
+
+            node = tenviz.DrawProgram(tenviz.DrawMode.Points,
+                                      program=program)
+            node['Transparency'] = 1
+            node['in_position_scale'] = torch.ones(3)
+
+            with self.assertRaises(tenviz.Error):
+                node['ProjectionView'] = torch.rand(3)
+            with self.assertRaises(tenviz.Error):
+                node['in_position_scale'] = torch.ones(3, dtype=torch.int32)
+
+    def test_uniform_blocks(self):
+        """Tests that programs reading the camera and object uniform
+        blocks draw as the ones with per node matrices.
+        """
+        context = tenviz.Context(320, 240)
+        shader_dir = Path(tenviz.__file__).parent / "shaders"
+        torch.manual_seed(10)
+        verts = torch.rand(1000, 3)*2 - 1
+        colors = torch.rand(1000, 3)
+
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            legacy_vert = Path(tmp_dir) / "legacy.vert"
+            legacy_vert.write_text("""#version 420
+in vec4 in_position;
+in vec3 in_color;
+uniform mat4 ProjModelview;
+out vec3 frag_color;
+void main() {
+  gl_Position = ProjModelview*in_position;
+  frag_color = in_color;
+}
+""")
+            with context.current():
+                legacy_program = tenviz.load_program_fs(
+                    legacy_vert, shader_dir / "point.frag")
+                self.assertFalse(legacy_program.uses_camera_block)
+                legacy = tenviz.DrawProgram(tenviz.DrawMode.Points,
+                                            program=legacy_program)
+                legacy['ProjModelview'] = (
+                    tenviz.MatPlaceholder.ProjectionModelview)
+
+                blocks_program = tenviz.load_program_fs(
+                    shader_dir / "point.vert", shader_dir / "point.frag")
+                self.assertTrue(blocks_program.uses_camera_block)
+                self.assertTrue(blocks_program.uses_object_block)
+                blocks = tenviz.DrawProgram(tenviz.DrawMode.Points,
+                                            program=blocks_program)
+                # Satisfied by the blocks.
+                blocks['ProjModelview'] = (
+                    tenviz.MatPlaceholder.ProjectionModelview)
+
+                for node in [legacy, blocks]:
+                    node['in_position'] = verts
+                    node['in_color'] = colors
+                    node['Transparency'] = 1.0
+                    node.transform = numpy.array(
+                        [[0.5, 0, 0, 0.1],
+                         [0, 0.5, 0, 0.2],
+                         [0, 0, 0.5, 0],
+                         [0, 0, 0, 1]], dtype=numpy.float32)
+                framebuffer = tenviz.create_framebuffer(
+                    {0: tenviz.FramebufferTarget.RGBAUint8})
+
+            view = torch.eye(4)
+            view[0, 3] = -0.3
+            images = []
+            for node in [legacy, blocks]:
+                # Nested scenes draw with views other than the frame's.
+                scene = tenviz.nodes.Scene([node])
+                scene.transform = numpy.array(
+                    [[0, -1, 0, 0],
+                     [1, 0, 0, 0],
+                     [0, 0, 1, 0],
+                     [0, 0, 0, 1]], dtype=numpy.float32)
+                context.render(torch.eye(4), view, framebuffer,
+                               tenviz.nodes.Scene([scene]))
+                with context.current():
+                    images.append(framebuffer[0].to_tensor(False))
+
+            self.assertLess(0, images[0].float().sum().item())
+            torch.testing.assert_allclose(images[1], images[0])
+
+    def test_uniform_values(self):
+        """Tests that nodes sharing a program draw with their own
+        uniform values, which are only uploaded when changed.
+        """
+        context = tenviz.Context(320, 240)
+        shader_dir = Path(tenviz.__file__).parent / "shaders"
+        torch.manual_seed(10)
+        verts = torch.rand(1000, 3)*2 - 1
+        colors = torch.rand(1000, 3)
+
+        with context.current():
+            program = tenviz.load_program_fs(shader_dir / "point.vert",
+                                             shader_dir / "point.frag")
+            nodes = []
+            for transparency in [1.0, 0.5]:
+                node = tenviz.DrawProgram(tenviz.DrawMode.Points,
+                                          program=program)
+                node['in_position'] = verts
+                node['in_color'] = colors
+                node['Transparency'] = transparency
+                nodes.append(node)
+            framebuffer = tenviz.create_framebuffer(
+                {0: tenviz.FramebufferTarget.RGBAUint8})
+
+            with self.assertRaises(tenviz.Error):
+                nodes[0]['Transparency'] = torch.ones(2, 2)
+
+        def _render_alpha(node):
+            context.render(torch.eye(4), torch.eye(4), framebuffer, [node])
+            with context.current():
+                return framebuffer[0].to_tensor(False)[:, :, 3].max().item()
+
+        self.assertEqual(255, _render_alpha(nodes[0]))
+        self.assertAlmostEqual(128, _render_alpha(nodes[1]), delta=1)
+        self.assertEqual(255, _render_alpha(nodes[0]))
+
+        with context.current():
+            nodes[0]['Transparency'] = 0.5
+        self.assertAlmostEqual(128, _render_alpha(nodes[0]), delta=1)
+
+    def test_instanced(self):
+        """Tests drawing per-instance attributes with a single draw
+        call.
+        """
+        context = tenviz.Context(320, 240)
+        context.stats_enabled = True
+        torch.manual_seed(10)
+        pos = torch.rand(1000, 3)*2 - 1
+        vecs = (torch.rand(1000, 3) - 0.5)*0.1
+        colors = torch.ones(1000, 3)
+
+        with context.current():
+            quiver = tenviz.nodes.create_quiver(pos, vecs, colors)
+            framebuffer = tenviz.create_framebuffer(
+                {0: tenviz.FramebufferTarget.RGBAUint8})
+
+            with self.assertRaises(tenviz.Error):
+                quiver.set_instanced('in_vector', vecs, 0)
+
+        context.render(torch.eye(4), torch.eye(4), framebuffer, [quiver])
+        stats = context.get_stats()
+        self.assertEqual(1, stats["draw_calls"])
+        self.assertEqual(2*1000, stats["vertices"])
+
+        with context.current():
+            image = framebuffer[0].to_tensor(False)
+        self.assertLess(0, image[:, :, :3].float().sum().item())
+
+        # Updating keeps the attribute per-instance.
+        with context.current():
+            quiver['in_vector'] = vecs*2
+        context.render(torch.eye(4), torch.eye(4), framebuffer, [quiver])
+        self.assertEqual(2*1000, context.get_stats()["vertices"])
+
+    def test_batched(self):
+        """Tests that nodes sharing a program and differing by their
+        transforms are drawn by a single multi-draw call.
+        """
+        context = tenviz.Context(320, 240)
+        context.stats_enabled = True
+        shader_dir = Path(tenviz.__file__).parent / "shaders"
+        torch.manual_seed(10)
+
+        with context.current():
+            program = tenviz.load_program_fs(shader_dir / "default.vert",
+                                             shader_dir / "default.frag")
+            if not program.uses_object_buffer:
+                self.skipTest("Storage blocks or draw parameters unsupported")
+
+            nodes = []
+            for i in range(50):
+                node = tenviz.DrawProgram(tenviz.DrawMode.Lines,
+                                          program=program)
+                node['in_position'] = torch.rand(10, 3)*0.2 - 0.1
+                node['Color'] = torch.tensor([0.6, 0.8, 0.75])
+                node.indices.from_tensor(
+                    torch.randint(0, 10, (8, 2), dtype=torch.int32))
+                node.transform = numpy.array(
+                    [[1, 0, 0, (i % 10)*0.2 - 0.9],
+                     [0, 1, 0, (i // 10)*0.4 - 0.8],
+                     [0, 0, 1, 0],
+                     [0, 0, 0, 1]], dtype=numpy.float32)
+                nodes.append(node)
+            framebuffer = tenviz.create_framebuffer(
+                {0: tenviz.FramebufferTarget.RGBAUint8})
+
+        def _render(scene):
+            context.render(torch.eye(4), torch.eye(4), framebuffer, scene)
+            with context.current():
+                return framebuffer[0].to_tensor(False)
+
+        batched = _render(nodes)
+        stats = context.get_stats()
+        self.assertEqual(1, stats["draw_calls"])
+        self.assertEqual(50*16, stats["vertices"])
+        self.assertLess(0, batched[:, :, :3].float().sum().item())
+
+        # Batch's time is split among its nodes. Each render reads the
+        # framebuffer back, so the next one collects its timings.
+        for _ in range(2):
+            _render(nodes)
+        node_times = context.get_stats()["node_times"]
+        for node in nodes:
+            self.assertIn(node, node_times)
+
+        # Scenes of a single node aren't batched.
+        separated = torch.zeros_like(batched)
+        for node in nodes:
+            separated = torch.max(separated, _render([node]))
+        torch.testing.assert_allclose(batched, separated)
+
+        # Nodes with other uniforms are drawn by another call.
+        with context.current():
+            nodes[0]['Color'] = torch.tensor([1.0, 0.0, 0.0])
+        _render(nodes)
+        self.assertEqual(2, context.get_stats()["draw_calls"])
+
+    def test_draw_ranges(self):
+        """Tests drawing ranges of the vertices and of the indices with
+        a single call.
+        """
+        context = tenviz.Context(320, 240)
+        context.stats_enabled = True
+        shader_dir = Path(tenviz.__file__).parent / "shaders"
+        torch.manual_seed(10)
+        verts = torch.rand(1000, 3)*2 - 1
+        colors = torch.rand(1000, 3)
+        ranges = torch.tensor([[0, 100], [500, 100], [990, 50]])
+
+        with context.current():
+            program = tenviz.load_program_fs(shader_dir / "point.vert",
+                                             shader_dir / "point.frag")
+            nodes = []
+            for node_verts, node_colors in [
+                    (verts, colors),
+                    (verts, colors),
+                    (torch.cat([verts[:100], verts[500:600], verts[990:]]),
+                     torch.cat([colors[:100], colors[500:600],
+                                colors[990:]]))]:
+                node = tenviz.DrawProgram(tenviz.DrawMode.Points,
+                                          program=program)
+                node['in_position'] = node_verts
+                node['in_color'] = node_colors
+                node['Transparency'] = 1.0
+                nodes.append(node)
+            ranged_arrays, ranged_elements, expected_node = nodes
+
+            ranged_arrays.set_draw_ranges(ranges)
+            ranged_elements.indices.from_tensor(
+                torch.arange(1000, dtype=torch.int32))
+            ranged_elements.set_draw_ranges(ranges)
+
+            with self.assertRaises(tenviz.Error):
+                ranged_arrays.set_draw_ranges(
+                    torch.zeros(3, dtype=torch.int64))
+            with self.assertRaises(tenviz.Error):
+                ranged_arrays.set_draw_ranges(torch.tensor([[-1, 10]]))
+
+            framebuffer = tenviz.create_framebuffer(
+                {0: tenviz.FramebufferTarget.RGBAUint8})
+
+        def _render(node):
+            context.render(torch.eye(4), torch.eye(4), framebuffer, [node])
+            with context.current():
+                return framebuffer[0].to_tensor(False)
+
+        expected = _render(expected_node)
+        self.assertLess(0, expected[:, :, :3].float().sum().item())
+
+        for node in [ranged_arrays, ranged_elements]:
+            torch.testing.assert_allclose(_render(node), expected)
+            stats = context.get_stats()
+            self.assertEqual(1, stats["draw_calls"])
+            # The last range is clipped to the vertices.
+            self.assertEqual(210, stats["vertices"])
+
+        with context.current():
+            ranged_arrays.clear_draw_ranges()
+        _render(ranged_arrays)
+        self.assertEqual(1000, context.get_stats()["vertices"])
+
+    def test_shared_programs(self):
+        """Tests that nodes loading the same shader files share their
+        program, so they're batched.
+        """
+        context = tenviz.Context(320, 240)
+        context.stats_enabled = True
+        shader_dir = Path(tenviz.__file__).parent / "shaders"
+
+        with context.current():
+            program = tenviz.load_program_fs(shader_dir / "default.vert",
+                                             shader_dir / "default.frag")
+            self.assertIs(program, tenviz.load_program_fs(
+                shader_dir / ".." / "shaders" / "default.vert",
+                str(shader_dir / "default.frag")))
+            self.assertIsNot(program, tenviz.load_program_fs(
+                shader_dir / "default.vert", shader_dir / "point.frag"))
+
+            nodes = []
+            for i in range(2):
+                node = tenviz.DrawProgram(tenviz.DrawMode.Lines,
+                                          shader_dir / "default.vert",
+                                          shader_dir / "default.frag")
+                node['in_position'] = torch.rand(10, 3)*0.2 - 0.1 + i*0.5
+                node['Color'] = torch.tensor([0.6, 0.8, 0.75])
+                nodes.append(node)
+            framebuffer = tenviz.create_framebuffer(
+                {0: tenviz.FramebufferTarget.RGBAUint8})
+
+        other_context = tenviz.Context(320, 240)
+        with other_context.current():
+            self.assertIsNot(program, tenviz.load_program_fs(
+                shader_dir / "default.vert", shader_dir / "default.frag"))
+
+        if program.uses_object_buffer:
+            context.render(torch.eye(4), torch.eye(4), framebuffer, nodes)
+            self.assertEqual(1, context.get_stats()["draw_calls"])
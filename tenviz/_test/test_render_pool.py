@@ -0,0 +1,55 @@
+"""Test the render pool.
+"""
+import unittest
+
+import torch
+import tenviz
+
+
+class TestRenderPool(unittest.TestCase):
+    """Test the render pool.
+    """
+
+    def test_submit(self):
+        """Do the workers render the context's geometry?
+        """
+        ctx = tenviz.Context(320, 240)
+        torch.manual_seed(10)
+
+        with ctx.current():
+            pcl = tenviz.nodes.PointCloud(torch.rand(100, 3))
+            framebuffer = tenviz.create_framebuffer(
+                {0: tenviz.FramebufferTarget.RGBAUint8})
+
+        ctx.render(torch.eye(4), torch.eye(4), framebuffer, [pcl])
+        with ctx.current():
+            expected = framebuffer[0].to_tensor(False)
+        self.assertLess(0, expected[:, :, :3].float().sum().item())
+
+        pool = tenviz.RenderPool(ctx, 2, {0: tenviz.FramebufferTarget.RGBAUint8})
+        self.assertEqual(2, pool.num_workers)
+
+        future = pool.submit(torch.eye(4), torch.eye(4), [pcl])
+        result = future.get()
+        self.assertTrue(future.ready())
+
+        self.assertEqual((240, 320, 4), tuple(result[0].shape))
+        torch.testing.assert_allclose(result[0].cpu(), expected)
+        self.assertEqual((240, 320), tuple(
+            result[tenviz.RenderPool.DEPTH].shape))
+
+        futures = pool.submit_batch(torch.eye(4).expand(5, 4, 4),
+                                    torch.eye(4).expand(5, 4, 4), [pcl],
+                                    width=160, height=120)
+        self.assertEqual(5, len(futures))
+        for future in futures:
+            self.assertEqual((120, 160, 4), tuple(future.get()[0].shape))
+
+        pool.release()
+
+        with self.assertRaises(tenviz.Error):
+            pool.submit(torch.eye(4), torch.eye(4), [pcl])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -62,3 +62,28 @@ class TestTexture(unittest.TestCase):
             tex = tenviz.tex_from_tensor(image, tenviz.TexTarget.k3D)
             image2 = tex.to_tensor()
             torch.testing.assert_allclose(image2, image)
+
+    def test_to_tensor_async(self):
+        """Tests the reading through pixel pack buffers.
+        """
+        torch.manual_seed(10)
+        images = [torch.rand((32, 48, 4)) for _ in range(5)]
+        with self.context.current():
+            tex = tenviz.tex_from_tensor(images[0], tenviz.TexTarget.k2D)
+            readbacks = []
+            for image in images:
+                tex.from_tensor(image)
+                readbacks.append(tex.to_tensor_async())
+
+            # The first reads were resolved for reusing their buffers.
+            self.assertTrue(readbacks[0].is_ready())
+            for image, readback in zip(images, readbacks):
+                image2 = readback.get()
+                self.assertFalse(image2.is_cuda)
+                torch.testing.assert_allclose(image2, image)
+
+            # Synchronous reads of unpadded rows still work afterwards.
+            image = torch.randint(0, 255, (7, 13, 3), dtype=torch.uint8)
+            tex = tenviz.tex_from_tensor(image, tenviz.TexTarget.k2D)
+            tex.to_tensor_async().get()
+            self.assertTrue(torch.equal(tex.to_tensor(False), image))
@@ -20,6 +20,20 @@ class CudaMappedTensorContext:
         self.mapped_tensor.unmap()
 
 
+class StreamWriteContext:
+    """Context manager for committing the slot written on stream buffers.
+    """
+
+    def __init__(self, buffer):
+        self.buffer = buffer
+
+    def __enter__(self):
+        return self.buffer.begin_stream_write()
+
+    def __exit__(self, *args):
+        self.buffer.end_stream_write()
+
+
 class Buffer(_ctenviz.Buffer):
     """An array buffer on the GL that can be mapped to tensor (as_tensor),
     or sliced as one. The slicing operator of this class can convert
@@ -66,6 +80,34 @@ class Buffer(_ctenviz.Buffer):
 
         return CudaMappedTensorContext(super().as_tensor())
 
+    def stream_write(self):
+        """Gets the next slot of a stream buffer
+        (:obj:`tenviz.BufferUsage.Stream`) as a CPU tensor that views
+        the GL memory. When the context ends, the slot becomes the one
+        used for drawing. The GPU is only waited if it's still drawing
+        from the slot.
+
+        A context must be current (:func:`tenviz.context.Context.current`).
+
+        Example:
+
+        .. code-block:: python
+
+            with context.current():
+                gl_buffer = tenviz.buffer_empty(
+                    10, 3, usage=tenviz.BufferUsage.Stream)
+
+            while True:
+                with context.current():
+                    with gl_buffer.stream_write() as tensor:
+                        tensor[:] = torch.rand(10, 3)
+
+        Returns:
+            :obj:`StreamWriteContext`: Slot writing context manager.
+
+        """
+        return StreamWriteContext(self)
+
     def as_tensor_(self):
         """Returns a mapped tensor without a context manager. Careful!
         """
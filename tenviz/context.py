@@ -2,7 +2,8 @@
 """
 
 from contextlib import contextmanager
-from ._ctenviz import (Context as _Context, CameraManipulator, Scene)
+from ._ctenviz import (Context as _Context, CameraManipulator,
+                       ContextBackend, Scene)
 
 
 def _asure_scene(scene):
@@ -24,17 +25,23 @@ class Context(_Context):
 
     """
 
-    def __init__(self, width=640, height=480):
+    def __init__(self, width=640, height=480, profile=False,
+                 backend=ContextBackend.GLFW):
         """Initialize the render.
 
         Args:
 
             width (int): Output image width.
             height (int): Output image height.
+            profile (bool): Whatever to use OpenGL's core profile.
+            backend (:obj:`tenviz.ContextBackend`): Window system
+             backend. `ContextBackend.EGL` creates a headless context
+             that doesn't need a display server, but can't open
+             viewers.
         """
         # pylint: disable=useless-super-delegation
         super().__init__(
-            width, height)
+            width, height, profile, backend)
 
     def render(self, projection, view, framebuffer,
                scene=None, width=-1, height=-1):
@@ -65,6 +72,43 @@ class Context(_Context):
             projection, view, framebuffer,
             _asure_scene(scene), width, height)
 
+    def render_many(self, projections, views, framebuffer,
+                    scene=None, width=-1, height=-1):
+        """Off screen rendering of several views in a single call. The
+        framebuffer becomes layered, one layer per view.
+
+        Args:
+
+            projections (:obj:`torch.Tensor`): [Kx4x4] projection
+             matrices.
+
+            views (:obj:`torch.Tensor`): [Kx4x4] camera's view
+             matrices.
+
+            framebuffer (:obj:`tenviz.Framebuffer`): Target
+             framebuffer.
+
+            scene (List[:obj:`tenviz.ANode`]): Target scene.
+
+            width (int): Optional rendering width, override the
+             current context width.
+
+            height (int): Optional rendering height, override the
+             current context height.
+
+        Returns:
+            (Dict[int, :obj:`torch.Tensor`]): Maps the framebuffer
+             locations to their [KxHxWxC] images.
+        """
+
+        super().render_many(
+            projections.float(), views.float(), framebuffer,
+            _asure_scene(scene), width, height)
+
+        with self.current():
+            return {location: texture.to_tensor()
+                    for location, texture in framebuffer.get_attachs().items()}
+
     def viewer(self, scene=None, cam_manip=CameraManipulator.TrackBall):
         """Creates a viewer window.
 
@@ -23,6 +23,17 @@ def create_framebuffer(attach_map):
          image = texture0.to_tensor()
          depth_buffer = fb.get_depth().to_tensor()
 
+    Attachments can also be read without waiting the GPU, for
+    overlapping the transfer with the next rendering:
+
+    .. code-block:: python
+
+       with ctx.current():
+         readback = fb[0].to_tensor_async()
+       # call ctx.render(...) for the next frame
+       with ctx.current():
+         image = readback.get()
+
     Args:
 
         attach_map (Dict[int, :obj:`tenviz.FramebufferTarget`]): The keys
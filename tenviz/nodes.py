@@ -6,7 +6,7 @@ import torch
 
 from .program import DrawProgram
 from .buffer import buffer_from_tensor
-from ._ctenviz import (DrawMode, PolygonMode, MatPlaceholder)
+from ._ctenviz import (DrawMode, PolygonMode)
 from ._ctenviz import Scene as _Scene
 from .geometry import compute_normals
 
@@ -89,10 +89,6 @@ def create_mesh(verts, faces, normals=None, calc_normals=False, texcoords=None):
     mesh['Lightpos'] = torch.tensor([0.0, 50.0, 0.0, 1.0], dtype=torch.float)
     mesh['SpecularExp'] = 127.0
 
-    mesh['Modelview'] = MatPlaceholder.Modelview
-    mesh['ProjModelview'] = MatPlaceholder.ProjectionModelview
-    mesh['NormalModelview'] = MatPlaceholder.NormalModelview
-
     # pylint: disable=no-member
     mesh.indices.from_tensor(faces)
     mesh.set_bounds(verts)
@@ -143,7 +139,6 @@ class PointCloud(DrawProgram):
             colors = colors.repeat(verts.size(0), 1)
         self['in_position'] = buffer_from_tensor(verts.float())
         self['in_color'] = buffer_from_tensor(colors, normalize=True)
-        self['ProjModelview'] = MatPlaceholder.ProjectionModelview
         self._transparency = 1.0
         self.set_bounds(verts)
         self.transparency = self._transparency
@@ -176,24 +171,17 @@ def create_quiver(pos, vecs, colors):
         :obj:`tenviz.program.DrawProgram`: The draw program.
 
     """
-    end_pos = pos + vecs
-
-    lines = torch.empty(pos.size(0)*2, 3)
-    lines[::2, :] = pos
-    lines[1::2, :] = end_pos
-
-    line_colors = torch.empty(pos.size(0)*2, 3, dtype=colors.dtype)
-    line_colors[::2, :] = colors
-    line_colors[1::2, :] = colors
-
     draw = DrawProgram(DrawMode.Lines, _SHADER_DIR / "quiver.vert",
                        _SHADER_DIR / "quiver.frag")
 
-    draw['in_position'] = lines
-    draw['in_color'] = line_colors
-    draw['ProjModelview'] = MatPlaceholder.ProjectionModelview
+    # One line instanced per point, instead of expanding their
+    # endpoints.
+    draw['in_endpoint'] = torch.tensor([0.0, 1.0])
+    draw.set_instanced('in_position', pos.float())
+    draw.set_instanced('in_vector', vecs.float())
+    draw.set_instanced('in_color', colors)
 
-    draw.set_bounds(lines)
+    draw.set_bounds(torch.cat([pos, pos + vecs]).float())
 
     return draw
 
@@ -247,7 +235,6 @@ def create_virtual_camera(proj, extrinsic, color=None, show_axis=True,
 
     draw['in_position'] = verts
     draw['Color'] = color
-    draw['ProjModelview'] = MatPlaceholder.ProjectionModelview
 
     # pylint: disable=no-member
     draw.indices.from_tensor(indices)
@@ -323,7 +310,6 @@ def create_axis_grid(start, end, steps, show_axis=True, grid_color=None):
     if grid_color is None:
         grid_color = torch.tensor([1.0, 1.0, 1.0])
     draw['Color'] = grid_color.float()
-    draw['ProjModelview'] = MatPlaceholder.ProjectionModelview
 
     # pylint: disable=no-member
     draw.indices.from_tensor(indices)
@@ -5,7 +5,9 @@ from tenviz import _ctenviz
 
 def load_program_fs(vert_shader=None, frag_shader=None, geo_shader=None):
     """Load a shader program from a file. Changes on the file are
-    automatically reloaded while drawing.
+    automatically reloaded while drawing. Calls with the same files on
+    the same context return the same program, so nodes using it
+    compile their shaders once and are drawn in batches.
 
     Args:
 
@@ -0,0 +1,89 @@
+"""Concurrent off screen rendering.
+"""
+
+from ._ctenviz import RenderPool as _RenderPool
+from .context import _asure_scene
+
+
+class RenderPool(_RenderPool):
+    """Renders on worker threads that share the objects of a
+    context. Each submission returns a future, so views can be queued
+    without waiting for the previous ones. Example:
+
+    .. code-block:: python
+
+       pool = tenviz.RenderPool(ctx, 4, {0: tenviz.FramebufferTarget.RGBUint8})
+       futures = pool.submit_batch(projections, views, [mesh])
+
+       images = [future.get()[0] for future in futures]
+       depths = [future.get()[tenviz.RenderPool.DEPTH] for future in futures]
+
+    Geometry must be loaded on the context before submitting and
+    must not be modified while its jobs are pending.
+    """
+
+    def __init__(self, context, num_workers, attach_map,
+                 keep_on_device=False):
+        """Creates the workers.
+
+        Args:
+
+            context (:obj:`tenviz.Context`): Context whose objects are
+             rendered.
+
+            num_workers (int): Number of worker threads, each one
+             with its own OpenGL context.
+
+            attach_map (Dict[int, :obj:`tenviz.FramebufferTarget`]):
+             Framebuffer attachments, see
+             :func:`tenviz.create_framebuffer`.
+
+            keep_on_device (bool): Whatever the resulting tensors
+             stay on the GPU.
+        """
+        # pylint: disable=useless-super-delegation
+        super().__init__(context, num_workers, attach_map, keep_on_device)
+
+    def submit(self, projection, view, scene, width=-1, height=-1):
+        """Queues the rendering of a scene.
+
+        Args:
+
+            projection (:obj:`torch.Tensor` or :obj:`numpy.ndarray`):
+             4x4 projection matrix.
+
+            view (:obj:`torch.Tensor` or :obj:`numpy.ndarray`):
+             4x4 camera's view matrix.
+
+            scene (List[:obj:`tenviz.ANode`]): Target scene.
+
+            width (int): Optional rendering width.
+
+            height (int): Optional rendering height.
+
+        Returns:
+            (:obj:`tenviz._ctenviz.RenderFuture`): Its `get()` returns
+             a dictionary from attachment locations to images. The
+             depth buffer is at `RenderPool.DEPTH`.
+        """
+        return super().submit(projection, view, _asure_scene(scene),
+                              width, height)
+
+    def submit_batch(self, projections, views, scene, width=-1, height=-1):
+        """Queues the rendering of several views of the same scene.
+
+        Args:
+
+            projections (:obj:`torch.Tensor`): [Kx4x4] projection
+             matrices.
+
+            views (:obj:`torch.Tensor`): [Kx4x4] view matrices.
+
+            scene (List[:obj:`tenviz.ANode`]): Target scene.
+
+        Returns:
+            (List[:obj:`tenviz._ctenviz.RenderFuture`]): One future
+             per view.
+        """
+        return super().submit_batch(projections.float(), views.float(),
+                                    _asure_scene(scene), width, height)
@@ -1,8 +1,41 @@
 #version 420
+#extension GL_ARB_shader_draw_parameters : enable
+#extension GL_ARB_shader_storage_buffer_object : enable
 
 in vec4 in_position;
-uniform mat4 ProjModelview;
+
+layout(std140) uniform CameraBlock {
+  mat4 Projection;
+  mat4 View;
+  mat4 ProjectionView;
+  mat4 NormalView;
+};
+
+#if defined(GL_ARB_shader_draw_parameters) && defined(GL_ARB_shader_storage_buffer_object)
+// Nodes are drawn in batches, each draw reads its own transform.
+struct ObjectData {
+  mat4 Object;
+  mat4 NormalObject;
+};
+
+layout(std430) readonly buffer ObjectBuffer {
+  ObjectData Objects[];
+};
+
+mat4 GetObject() {
+  return Objects[gl_DrawIDARB].Object;
+}
+#else
+layout(std140) uniform ObjectBlock {
+  mat4 Object;
+  mat4 NormalObject;
+};
+
+mat4 GetObject() {
+  return Object;
+}
+#endif
 
 void main() {
-  gl_Position = ProjModelview*in_position;
+  gl_Position = ProjectionView*(GetObject()*in_position);
 }
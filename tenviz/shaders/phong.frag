@@ -1,8 +1,5 @@
 #version 420
 
-uniform vec4 Lightpos;
-uniform mat4 Modelview;
-
 uniform vec4 AmbientColor;
 uniform vec4 DiffuseColor;
 uniform vec4 SpecularColor;
@@ -12,13 +9,14 @@ uniform sampler2D Tex;
 in vec3 frag_pos;
 in vec3 frag_normal;
 in vec2 frag_texcoord;
+flat in vec3 frag_light_pos;
 
 out vec4 out_frag_color;
 
 void main() {
   // Begin
   vec3 v_normal = normalize(frag_normal);
-  vec3 v_light = normalize((Modelview * Lightpos).xyz - frag_pos);
+  vec3 v_light = normalize(frag_light_pos - frag_pos);
 
   vec3 v_view = normalize(-frag_pos);
   vec3 v_ref = 2 * dot(v_normal, v_light) * v_normal - v_light;
@@ -4,17 +4,47 @@ in vec4 in_position;
 in vec3 in_normal;
 in vec2 in_texcoord;
 
-uniform mat4 Modelview;
-uniform mat3 NormalModelview;
-uniform mat4 ProjModelview;
+layout(std140) uniform CameraBlock {
+  mat4 Projection;
+  mat4 View;
+  mat4 ProjectionView;
+  mat4 NormalView;
+};
+
+layout(std140) uniform ObjectBlock {
+  mat4 Object;
+  mat4 NormalObject;
+};
+
+uniform vec4 Lightpos;
+
+uniform vec3 in_position_scale = vec3(1.0);
+uniform vec3 in_position_offset = vec3(0.0);
+uniform bool in_normal_octahedral = false;
 
 out vec3 frag_pos;
 out vec3 frag_normal;
 out vec2 frag_texcoord;
+flat out vec3 frag_light_pos;
+
+vec3 DecodeOctahedral(vec2 octa) {
+  vec3 normal = vec3(octa, 1.0 - abs(octa.x) - abs(octa.y));
+  if (normal.z < 0.0) {
+    normal.xy = (1.0 - abs(normal.yx))*(step(0.0, normal.xy)*2.0 - 1.0);
+  }
+  return normalize(normal);
+}
 
 void main() {
-  gl_Position = ProjModelview * in_position;
-  frag_pos = (Modelview * in_position).xyz;
-  frag_normal = NormalModelview * in_normal;
+  vec4 position = vec4(in_position.xyz*in_position_scale + in_position_offset,
+                       in_position.w);
+  vec3 normal = in_normal_octahedral ? DecodeOctahedral(in_normal.xy)
+                                     : in_normal;
+
+  vec4 world_position = Object * position;
+  gl_Position = ProjectionView * world_position;
+  frag_pos = (View * world_position).xyz;
+  frag_normal = mat3(NormalView) * (mat3(NormalObject) * normal);
   frag_texcoord = in_texcoord;
+  frag_light_pos = (View * (Object * Lightpos)).xyz;
 }
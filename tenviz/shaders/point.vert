@@ -3,11 +3,26 @@
 in vec4 in_position;
 in vec3 in_color;
 
-uniform mat4 ProjModelview;
+layout(std140) uniform CameraBlock {
+  mat4 Projection;
+  mat4 View;
+  mat4 ProjectionView;
+  mat4 NormalView;
+};
+
+layout(std140) uniform ObjectBlock {
+  mat4 Object;
+  mat4 NormalObject;
+};
+
+uniform vec3 in_position_scale = vec3(1.0);
+uniform vec3 in_position_offset = vec3(0.0);
 
 out vec3 frag_color;
 
 void main() {
-  gl_Position = ProjModelview*in_position;
+  vec4 position = vec4(in_position.xyz*in_position_scale + in_position_offset,
+                       in_position.w);
+  gl_Position = ProjectionView*(Object*position);
   frag_color = in_color;
 }
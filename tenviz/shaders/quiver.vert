@@ -1,13 +1,28 @@
 #version 420
 
-in vec4 in_position;
+in float in_endpoint;
+in vec3 in_position;
+in vec3 in_vector;
 in vec3 in_color;
 
-uniform mat4 ProjModelview;
+layout(std140) uniform CameraBlock {
+  mat4 Projection;
+  mat4 View;
+  mat4 ProjectionView;
+  mat4 NormalView;
+};
+
+layout(std140) uniform ObjectBlock {
+  mat4 Object;
+  mat4 NormalObject;
+};
 
 out vec3 frag_color;
 
 void main() {
-  gl_Position = ProjModelview*in_position;
+  // Each instance is an arrow line, from its position to the
+  // endpoint of its vector.
+  vec4 position = vec4(in_position + in_endpoint*in_vector, 1.0);
+  gl_Position = ProjectionView*(Object*position);
   frag_color = in_color;
 }
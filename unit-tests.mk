@@ -22,15 +22,84 @@ tenviz.buffer.gpu:
 tenviz.buffer.cpu:
 	python3 -m unittest tenviz._test.test_buffer.TestBuffer.test_torch_memory_cpu
 
+tenviz.buffer.cpu_transfer:
+	python3 -m unittest tenviz._test.test_buffer.TestBuffer.test_cpu_transfer
+
+tenviz.buffer.scattered_index:
+	python3 -m unittest tenviz._test.test_buffer.TestBuffer.test_scattered_index
+
+tenviz.buffer.update:
+	python3 -m unittest tenviz._test.test_buffer.TestBuffer.test_update
+
+tenviz.buffer.stream:
+	python3 -m unittest tenviz._test.test_buffer.TestBuffer.test_stream
+
+tenviz.buffer.shared_channel:
+	python3 -m unittest tenviz._test.test_buffer.TestBuffer.test_shared_channel
+
 tenviz.buffer.as_tensor:
 	python3 -m unittest tenviz._test.test_buffer.TestBuffer.test_as_tensor
 
+tenviz.buffer.index_narrowing:
+	python3 -m unittest tenviz._test.test_buffer.TestBuffer.test_index_narrowing
+
 tenviz.draw_program:
 	python3 -m unittest tenviz._test.test_draw_program
 
+tenviz.draw_program.set_vertices:
+	python3 -m unittest tenviz._test.test_draw_program.TestDrawProgram.test_set_vertices
+
+tenviz.draw_program.buffer_arena:
+	python3 -m unittest tenviz._test.test_draw_program.TestDrawProgram.test_buffer_arena
+
+tenviz.draw_program.attrib_encoding:
+	python3 -m unittest tenviz._test.test_draw_program.TestDrawProgram.test_attrib_encoding
+
+tenviz.draw_program.vertex_array_layout:
+	python3 -m unittest tenviz._test.test_draw_program.TestDrawProgram.test_vertex_array_layout
+
+tenviz.draw_program.reflection:
+	python3 -m unittest tenviz._test.test_draw_program.TestDrawProgram.test_reflection
+
+tenviz.draw_program.uniform_blocks:
+	python3 -m unittest tenviz._test.test_draw_program.TestDrawProgram.test_uniform_blocks
+
+tenviz.draw_program.uniform_values:
+	python3 -m unittest tenviz._test.test_draw_program.TestDrawProgram.test_uniform_values
+
+tenviz.draw_program.instanced:
+	python3 -m unittest tenviz._test.test_draw_program.TestDrawProgram.test_instanced
+
+tenviz.draw_program.batched:
+	python3 -m unittest tenviz._test.test_draw_program.TestDrawProgram.test_batched
+
+tenviz.draw_program.draw_ranges:
+	python3 -m unittest tenviz._test.test_draw_program.TestDrawProgram.test_draw_ranges
+
+tenviz.draw_program.shared_programs:
+	python3 -m unittest tenviz._test.test_draw_program.TestDrawProgram.test_shared_programs
+
 tenviz.context:
 	python3 -m unittest tenviz._test.test_context
 
+tenviz.context.render_many:
+	python3 -m unittest tenviz._test.test_context.TestContext.test_render_many
+
+tenviz.context.stats:
+	python3 -m unittest tenviz._test.test_context.TestContext.test_stats
+
+tenviz.context.state_cache:
+	python3 -m unittest tenviz._test.test_context.TestContext.test_state_cache
+
+tenviz.context.gl_error_mode:
+	python3 -m unittest tenviz._test.test_context.TestContext.test_gl_error_mode
+
+tenviz.context.headless:
+	python3 -m unittest tenviz._test.test_context.TestContext.test_headless_render
+
+tenviz.render_pool:
+	python3 -m unittest tenviz._test.test_render_pool
+
 tenviz.program:
 	python3 -m unittest tenviz._test.test_program
 
@@ -43,6 +112,9 @@ tenviz.texture.texture2d:
 tenviz.texture.texture3d:
 	python3 -m unittest tenviz._test.test_texture.TestTexture.test_texture_3d
 
+tenviz.texture.async:
+	python3 -m unittest tenviz._test.test_texture.TestTexture.test_to_tensor_async
+
 tenviz.pose.PoseDict:
 	python3 -m unittest tenviz._test.test_pose.TestPoseDict
 